@@ -0,0 +1,542 @@
+
+// AnvilLoader.cpp
+
+// Implements the cAnvilLoader class that reads an area of a world stored in the Anvil format (.mca region files)
+
+#include "Globals.h"
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include "AnvilLoader.h"
+#include "SchematicLoader.h"
+#include "BlockStates.h"
+#include "StringCompression.h"
+#include "TaskScheduler.h"
+#include "OSSupport/MappedFile.h"
+#include "WorldStorage/FastNBT.h"
+#include "zlib/zlib.h"
+
+
+
+
+
+/** Size of a sector in the region file; the chunk data is aligned to sectors. */
+static const size_t REGION_SECTOR_SIZE = 4096;
+
+/** Size of the region file header (chunk locations + timestamps). */
+static const size_t REGION_HEADER_SIZE = 2 * REGION_SECTOR_SIZE;
+
+/** The first DataVersion (1.16 snapshot 20w17a) where the section BlockStates values don't span across the longs. */
+static const Int32 DATA_VERSION_PADDED_BLOCKSTATES = 2529;
+
+
+
+
+
+/** Decodes the chunks of a region file into the area's schematic.
+Each chunk writes a distinct part of the schematic, so a single decoder can be used by multiple threads at once. */
+class cAnvilAreaDecoder
+{
+public:
+	cAnvilAreaDecoder(cSchematic & a_Schematic, int a_MinX, int a_MinY, int a_MinZ):
+		m_Types(a_Schematic.GetBlockTypes()),
+		m_Metas(a_Schematic.GetBlockMetas()),
+		m_MinX(a_MinX),
+		m_MinY(a_MinY),
+		m_MinZ(a_MinZ),
+		m_SizeX(a_Schematic.GetSizeX()),
+		m_SizeY(a_Schematic.GetSizeY()),
+		m_SizeZ(a_Schematic.GetSizeZ())
+	{
+	}
+
+
+	/** Decodes the specified chunk from the region file data into the schematic.
+	a_Buffer is the calling thread's decompression buffer, reused between the chunks.
+	Returns false if the chunk data is corrupted or in an unsupported format. A chunk not present in the region is not an error. */
+	bool DecodeChunk(const char * a_RegionData, size_t a_RegionSize, int a_ChunkX, int a_ChunkZ, AString & a_Buffer) const
+	{
+		if (a_RegionSize < REGION_HEADER_SIZE)
+		{
+			// An empty region file is created by the server before writing any chunks; a truncated header is corrupted:
+			return (a_RegionSize == 0);
+		}
+		size_t HeaderIdx = static_cast<size_t>((a_ChunkX & 31) + (a_ChunkZ & 31) * 32);
+		UInt32 Location = static_cast<UInt32>(GetBEInt(a_RegionData + 4 * HeaderIdx));
+		size_t Pos = static_cast<size_t>(Location >> 8) * REGION_SECTOR_SIZE;
+		if (Pos == 0)
+		{
+			// The chunk hasn't been generated
+			return true;
+		}
+		if (Pos + 5 > a_RegionSize)
+		{
+			return false;
+		}
+		size_t Length = static_cast<UInt32>(GetBEInt(a_RegionData + Pos));
+		if ((Length < 1) || (Length > a_RegionSize - Pos - 4))
+		{
+			return false;
+		}
+		const char * Data = a_RegionData + Pos + 5;
+		size_t DataLength = Length - 1;
+		a_Buffer.clear();
+		switch (static_cast<Byte>(a_RegionData[Pos + 4]))
+		{
+			case 1:
+			{
+				if (UncompressStringGZIP(Data, DataLength, a_Buffer) != Z_OK)
+				{
+					return false;
+				}
+				break;
+			}
+			case 2:
+			{
+				if (InflateString(Data, DataLength, a_Buffer) != Z_OK)
+				{
+					return false;
+				}
+				break;
+			}
+			case 3:
+			{
+				a_Buffer.assign(Data, DataLength);
+				break;
+			}
+			default:
+			{
+				// LZ4 (4), or stored in an external .mcc file (flag 128)
+				return false;
+			}
+		}
+
+		cParsedNBT NBT(a_Buffer.data(), a_Buffer.size());
+		if (!NBT.IsValid())
+		{
+			return false;
+		}
+		return DecodeChunkNBT(NBT, a_ChunkX * 16, a_ChunkZ * 16);
+	}
+
+protected:
+	Byte * m_Types;
+	Byte * m_Metas;
+	int m_MinX;
+	int m_MinY;
+	int m_MinZ;
+	int m_SizeX;
+	int m_SizeY;
+	int m_SizeZ;
+
+
+	/** Decodes the sections of the chunk that intersect the area. a_BaseX and a_BaseZ are the chunk's block coords. */
+	bool DecodeChunkNBT(const cParsedNBT & a_NBT, int a_BaseX, int a_BaseZ) const
+	{
+		Int32 DataVersion = 0;
+		int DataVersionTag = a_NBT.FindChildByName(0, "DataVersion");
+		if ((DataVersionTag >= 0) && (a_NBT.GetType(DataVersionTag) == TAG_Int))
+		{
+			DataVersion = a_NBT.GetInt(DataVersionTag);
+		}
+
+		// 1.18+ has the sections directly in the root, older versions in the Level compound:
+		int SectionsTag = a_NBT.FindChildByName(0, "sections");
+		if (SectionsTag < 0)
+		{
+			int LevelTag = a_NBT.FindChildByName(0, "Level");
+			if ((LevelTag < 0) || (a_NBT.GetType(LevelTag) != TAG_Compound))
+			{
+				return false;
+			}
+			SectionsTag = a_NBT.FindChildByName(LevelTag, "Sections");
+			if (SectionsTag < 0)
+			{
+				// No sections at all, the chunk is empty
+				return true;
+			}
+		}
+		if (a_NBT.GetType(SectionsTag) != TAG_List)
+		{
+			return false;
+		}
+
+		std::vector<cLegacyBlock> Palette;
+		for (int Section = a_NBT.GetFirstChild(SectionsTag); Section >= 0; Section = a_NBT.GetNextSibling(Section))
+		{
+			int YTag = a_NBT.FindChildByName(Section, "Y");
+			if ((a_NBT.GetType(Section) != TAG_Compound) || (YTag < 0) || (a_NBT.GetType(YTag) != TAG_Byte))
+			{
+				return false;
+			}
+			int BaseY = static_cast<signed char>(a_NBT.GetByte(YTag)) * 16;
+			if ((BaseY + 15 < m_MinY) || (BaseY >= m_MinY + m_SizeY))
+			{
+				continue;
+			}
+
+			int BlockStatesTag = a_NBT.FindChildByName(Section, "block_states");
+			if (BlockStatesTag >= 0)
+			{
+				if (!DecodePaletteSection(
+					a_NBT, a_NBT.FindChildByName(BlockStatesTag, "palette"), a_NBT.FindChildByName(BlockStatesTag, "data"),
+					true, Palette, a_BaseX, BaseY, a_BaseZ
+				))
+				{
+					return false;
+				}
+				continue;
+			}
+			int PaletteTag = a_NBT.FindChildByName(Section, "Palette");
+			if (PaletteTag >= 0)
+			{
+				if (!DecodePaletteSection(
+					a_NBT, PaletteTag, a_NBT.FindChildByName(Section, "BlockStates"),
+					(DataVersion >= DATA_VERSION_PADDED_BLOCKSTATES), Palette, a_BaseX, BaseY, a_BaseZ
+				))
+				{
+					return false;
+				}
+				continue;
+			}
+			if (a_NBT.FindChildByName(Section, "Blocks") < 0)
+			{
+				// A section with only the light data (such as the Y = -1 and Y = 16 sections in 1.14 - 1.17), all air
+				continue;
+			}
+			if (!DecodeLegacySection(a_NBT, Section, a_BaseX, BaseY, a_BaseZ))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	/** Decodes a section stored as a blockstate palette and packed indices into it (1.13+).
+	A missing data tag means the whole section is the single palette entry. */
+	bool DecodePaletteSection(
+		const cParsedNBT & a_NBT, int a_PaletteTag, int a_DataTag, bool a_IsPadded,
+		std::vector<cLegacyBlock> & a_Palette, int a_BaseX, int a_BaseY, int a_BaseZ
+	) const
+	{
+		if (!cSchematicLoader::ReadBlockStatePalette(a_NBT, a_PaletteTag, a_Palette) || a_Palette.empty())
+		{
+			return false;
+		}
+		int Min[3], Max[3];
+		GetSectionRange(a_BaseX, a_BaseY, a_BaseZ, Min, Max);
+
+		if (a_DataTag < 0)
+		{
+			const auto & Block = a_Palette[0];
+			for (int y = Min[1]; y <= Max[1]; y++)
+			{
+				for (int z = Min[2]; z <= Max[2]; z++)
+				{
+					size_t Idx = GetIndex(a_BaseX + Min[0], a_BaseY + y, a_BaseZ + z);
+					for (int x = Min[0]; x <= Max[0]; x++, Idx++)
+					{
+						m_Types[Idx] = Block.m_BlockType;
+						m_Metas[Idx] = Block.m_BlockMeta;
+					}
+				}
+			}
+			return true;
+		}
+
+		if (a_NBT.GetType(a_DataTag) != TAG_LongArray)
+		{
+			return false;
+		}
+		int BitsPerEntry = 4;
+		while ((static_cast<size_t>(1) << BitsPerEntry) < a_Palette.size())
+		{
+			BitsPerEntry++;
+		}
+		cPackedLongArrayReader Reader(a_NBT.GetData(a_DataTag), a_NBT.GetDataLength(a_DataTag) / 8, BitsPerEntry, !a_IsPadded);
+		if (Reader.GetNumValues() < 4096)
+		{
+			return false;
+		}
+
+		// The values are ordered YZX; the whole section has to be read in order, only the part inside the area is stored:
+		size_t PaletteSize = a_Palette.size();
+		for (int y = 0; y < 16; y++)
+		{
+			bool IsInY = ((y >= Min[1]) && (y <= Max[1]));
+			for (int z = 0; z < 16; z++)
+			{
+				bool IsInYZ = IsInY && (z >= Min[2]) && (z <= Max[2]);
+				size_t Idx = IsInYZ ? GetIndex(a_BaseX + Min[0], a_BaseY + y, a_BaseZ + z) : 0;
+				for (int x = 0; x < 16; x++)
+				{
+					UInt32 Index = Reader.Next();
+					if (!IsInYZ || (x < Min[0]) || (x > Max[0]))
+					{
+						continue;
+					}
+					if (Index >= PaletteSize)
+					{
+						return false;
+					}
+					m_Types[Idx] = a_Palette[Index].m_BlockType;
+					m_Metas[Idx] = a_Palette[Index].m_BlockMeta;
+					Idx++;
+				}
+			}
+		}
+		return true;
+	}
+
+
+	/** Decodes a pre-1.13 section, stored as the Blocks byte array and the Data nibble array.
+	The Add nibble array (block types above 255) is ignored, the schematic block types are bytes only. */
+	bool DecodeLegacySection(const cParsedNBT & a_NBT, int a_SectionTag, int a_BaseX, int a_BaseY, int a_BaseZ) const
+	{
+		int BlocksTag = a_NBT.FindChildByName(a_SectionTag, "Blocks");
+		int DataTag = a_NBT.FindChildByName(a_SectionTag, "Data");
+		if (
+			(BlocksTag < 0) || (a_NBT.GetType(BlocksTag) != TAG_ByteArray) || (a_NBT.GetDataLength(BlocksTag) < 4096) ||
+			(DataTag < 0) || (a_NBT.GetType(DataTag) != TAG_ByteArray) || (a_NBT.GetDataLength(DataTag) < 2048)
+		)
+		{
+			return false;
+		}
+		auto Blocks = reinterpret_cast<const Byte *>(a_NBT.GetData(BlocksTag));
+		auto Data = reinterpret_cast<const Byte *>(a_NBT.GetData(DataTag));
+		int Min[3], Max[3];
+		GetSectionRange(a_BaseX, a_BaseY, a_BaseZ, Min, Max);
+		for (int y = Min[1]; y <= Max[1]; y++)
+		{
+			for (int z = Min[2]; z <= Max[2]; z++)
+			{
+				size_t Idx = GetIndex(a_BaseX + Min[0], a_BaseY + y, a_BaseZ + z);
+				for (int x = Min[0]; x <= Max[0]; x++, Idx++)
+				{
+					int SectionIdx = x + z * 16 + y * 256;
+					m_Types[Idx] = Blocks[SectionIdx];
+					m_Metas[Idx] = (Data[SectionIdx / 2] >> ((SectionIdx & 1) * 4)) & 0x0f;
+				}
+			}
+		}
+		return true;
+	}
+
+
+	/** Calculates the section-relative range of coords (inclusive) that lies within the area.
+	The caller has checked that the section intersects the area. */
+	void GetSectionRange(int a_BaseX, int a_BaseY, int a_BaseZ, int (&a_Min)[3], int (&a_Max)[3]) const
+	{
+		a_Min[0] = std::max(0, m_MinX - a_BaseX);
+		a_Min[1] = std::max(0, m_MinY - a_BaseY);
+		a_Min[2] = std::max(0, m_MinZ - a_BaseZ);
+		a_Max[0] = std::min(15, m_MinX + m_SizeX - 1 - a_BaseX);
+		a_Max[1] = std::min(15, m_MinY + m_SizeY - 1 - a_BaseY);
+		a_Max[2] = std::min(15, m_MinZ + m_SizeZ - 1 - a_BaseZ);
+	}
+
+
+	/** Returns the index into the schematic's arrays of the specified world coords, which must be inside the area. */
+	size_t GetIndex(int a_WorldX, int a_WorldY, int a_WorldZ) const
+	{
+		return
+			static_cast<size_t>(a_WorldX - m_MinX) +
+			static_cast<size_t>(a_WorldZ - m_MinZ) * static_cast<size_t>(m_SizeX) +
+			static_cast<size_t>(a_WorldY - m_MinY) * static_cast<size_t>(m_SizeX) * static_cast<size_t>(m_SizeZ);
+	}
+};
+
+
+
+
+
+
+/** The state of a single cAnvilLoader::LoadArea() call, shared by the calling thread and the helper tasks.
+The helper tasks may start only after the call has returned, so everything they use is kept here instead of on the caller's stack. */
+struct cAnvilAreaLoad
+{
+	struct cChunkJob
+	{
+		const cMappedFile * m_Region;
+		int m_ChunkX;
+		int m_ChunkZ;
+	};
+
+	cSchematicPtr m_Schematic;
+	std::map<std::pair<int, int>, std::unique_ptr<cMappedFile>> m_Regions;
+	std::vector<cChunkJob> m_Chunks;
+	std::unique_ptr<cAnvilAreaDecoder> m_Decoder;
+
+	/** The index of the next chunk to be picked by a decoding thread. */
+	std::atomic<size_t> m_NextChunk;
+
+	std::atomic<size_t> m_NumFailed;
+
+	/** The number of chunks decoded so far; LoadArea() waits for all of them. Protected by m_Mutex. */
+	size_t m_NumDone;
+
+	std::mutex m_Mutex;
+
+	/** Signalled when the last chunk has been decoded. */
+	std::condition_variable m_CondDone;
+
+
+	cAnvilAreaLoad(void):
+		m_NextChunk(0),
+		m_NumFailed(0),
+		m_NumDone(0)
+	{
+	}
+
+
+	/** Picks the next chunk from the list and decodes it, until all the chunks are picked. */
+	void DecodeChunks(void)
+	{
+		AString Buffer;
+		size_t NumDecoded = 0;
+		for (;;)
+		{
+			size_t Idx = m_NextChunk++;
+			if (Idx >= m_Chunks.size())
+			{
+				break;
+			}
+			const auto & Job = m_Chunks[Idx];
+			if (!m_Decoder->DecodeChunk(Job.m_Region->GetData(), Job.m_Region->GetSize(), Job.m_ChunkX, Job.m_ChunkZ, Buffer))
+			{
+				m_NumFailed++;
+			}
+			NumDecoded++;
+		}
+		if (NumDecoded == 0)
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_NumDone += NumDecoded;
+		if (m_NumDone == m_Chunks.size())
+		{
+			m_CondDone.notify_all();
+		}
+	}
+};
+
+
+
+
+
+cSchematicPtr cAnvilLoader::LoadArea(
+	const AString & a_WorldFolder,
+	int a_MinX, int a_MinY, int a_MinZ,
+	int a_MaxX, int a_MaxY, int a_MaxZ,
+	cTaskScheduler * a_Scheduler,
+	AString & a_ErrorMsg
+)
+{
+	// Check the area size:
+	Int64 Sizes[3] =
+	{
+		static_cast<Int64>(a_MaxX) - a_MinX + 1,
+		static_cast<Int64>(a_MaxY) - a_MinY + 1,
+		static_cast<Int64>(a_MaxZ) - a_MinZ + 1,
+	};
+	for (int i = 0; i < 3; i++)
+	{
+		if ((Sizes[i] < 1) || (Sizes[i] > cSchematic::MAX_DIMENSION))
+		{
+			a_ErrorMsg = Printf("Invalid area size {%lld, %lld, %lld}!",
+				static_cast<long long>(Sizes[0]), static_cast<long long>(Sizes[1]), static_cast<long long>(Sizes[2])
+			);
+			return nullptr;
+		}
+	}
+	if (static_cast<size_t>(Sizes[0]) * static_cast<size_t>(Sizes[1]) * static_cast<size_t>(Sizes[2]) > cSchematic::MAX_VOLUME)
+	{
+		a_ErrorMsg = Printf("The area is too large ({%lld, %lld, %lld})!",
+			static_cast<long long>(Sizes[0]), static_cast<long long>(Sizes[1]), static_cast<long long>(Sizes[2])
+		);
+		return nullptr;
+	}
+
+	// Find the region folder:
+	AString Folder = a_WorldFolder;
+	if (!Folder.empty() && (Folder.back() != '/') && (Folder.back() != cFile::PathSeparator))
+	{
+		Folder.push_back(cFile::PathSeparator);
+	}
+	if (cFile::IsFolder(Folder + "region"))
+	{
+		Folder.append("region");
+		Folder.push_back(cFile::PathSeparator);
+	}
+	else if (!cFile::IsFolder(Folder))
+	{
+		a_ErrorMsg = Printf("World folder %s not found!", a_WorldFolder.c_str());
+		return nullptr;
+	}
+
+	// Map the region files intersecting the area and list the chunks to decode; missing region files are left as air:
+	auto State = std::make_shared<cAnvilAreaLoad>();
+	int MinChunkX = a_MinX >> 4, MaxChunkX = a_MaxX >> 4;
+	int MinChunkZ = a_MinZ >> 4, MaxChunkZ = a_MaxZ >> 4;
+	for (int RegionZ = MinChunkZ >> 5; RegionZ <= (MaxChunkZ >> 5); RegionZ++)
+	{
+		for (int RegionX = MinChunkX >> 5; RegionX <= (MaxChunkX >> 5); RegionX++)
+		{
+			std::unique_ptr<cMappedFile> Region(new cMappedFile);
+			if (!Region->Open(Printf("%sr.%d.%d.mca", Folder.c_str(), RegionX, RegionZ)))
+			{
+				continue;
+			}
+			int ChunkZStart = std::max(MinChunkZ, RegionZ * 32), ChunkZEnd = std::min(MaxChunkZ, RegionZ * 32 + 31);
+			int ChunkXStart = std::max(MinChunkX, RegionX * 32), ChunkXEnd = std::min(MaxChunkX, RegionX * 32 + 31);
+			for (int ChunkZ = ChunkZStart; ChunkZ <= ChunkZEnd; ChunkZ++)
+			{
+				for (int ChunkX = ChunkXStart; ChunkX <= ChunkXEnd; ChunkX++)
+				{
+					State->m_Chunks.push_back({Region.get(), ChunkX, ChunkZ});
+				}
+			}
+			State->m_Regions[std::make_pair(RegionX, RegionZ)] = std::move(Region);
+		}
+	}
+	if (State->m_Regions.empty())
+	{
+		a_ErrorMsg = Printf("No region files intersecting the area found in %s!", Folder.c_str());
+		return nullptr;
+	}
+
+	// Decode the chunks in parallel: the helper tasks on the idle workers and the calling thread all pick the next chunk
+	// from the list until all are picked, then the calling thread waits for the chunks still being decoded by the helpers.
+	// The helper tasks that start only after all the chunks are picked return right away:
+	State->m_Schematic = std::make_shared<cSchematic>(static_cast<int>(Sizes[0]), static_cast<int>(Sizes[1]), static_cast<int>(Sizes[2]));
+	State->m_Decoder.reset(new cAnvilAreaDecoder(*State->m_Schematic, a_MinX, a_MinY, a_MinZ));
+	if (a_Scheduler != nullptr)
+	{
+		size_t NumHelpers = std::min(static_cast<size_t>(std::max(a_Scheduler->GetNumWorkers() - 1, 0)), State->m_Chunks.size() - 1);
+		for (size_t i = 0; i < NumHelpers; i++)
+		{
+			a_Scheduler->Submit([State]() { State->DecodeChunks(); });
+		}
+	}
+	State->DecodeChunks();
+	{
+		std::unique_lock<std::mutex> Lock(State->m_Mutex);
+		State->m_CondDone.wait(Lock, [&State]() { return (State->m_NumDone == State->m_Chunks.size()); });
+	}
+
+	size_t NumFailed = State->m_NumFailed.load();
+	if (NumFailed > 0)
+	{
+		LOGWARNING("%s: " SIZE_T_FMT " chunks in the area {%d, %d, %d} - {%d, %d, %d} are corrupted or in an unsupported format, they were left as air.",
+			a_WorldFolder.c_str(), NumFailed, a_MinX, a_MinY, a_MinZ, a_MaxX, a_MaxY, a_MaxZ
+		);
+	}
+	return State->m_Schematic;
+}
+
+
+
+
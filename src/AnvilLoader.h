@@ -0,0 +1,55 @@
+
+// AnvilLoader.h
+
+// Declares the cAnvilLoader class that reads an area of a world stored in the Anvil format (.mca region files)
+
+/*
+Only the region files intersecting the area are mapped into memory, and only the chunks intersecting the area
+are decompressed; of those, only the sections intersecting the area are decoded, straight into the resulting schematic.
+The chunks are independent of each other, so they are decoded in parallel by the calling thread and helper tasks
+on the task scheduler's idle workers.
+Supported chunk formats:
+	- pre-1.13: legacy Blocks / Data arrays in the sections
+	- 1.13 - 1.17: Palette / BlockStates in the sections (values spanning the longs before 1.16, padded since)
+	- 1.18+: block_states compound with palette / data in the sections
+Chunks stored using the LZ4 compression or in external .mcc files are not supported, they are left as air.
+*/
+
+
+
+
+
+#pragma once
+
+#include "Schematic.h"
+
+
+
+
+
+class cTaskScheduler;
+
+
+
+
+
+class cAnvilLoader
+{
+public:
+	/** Loads the blocks in the specified area of the world, the area includes both its min and max coords.
+	a_WorldFolder is the world's folder (containing the "region" folder), or the region folder itself.
+	Chunks that don't exist are left as air. If a_Scheduler is given, its idle workers help with decoding the chunks,
+	otherwise all the chunks are decoded on the calling thread.
+	Returns nullptr and sets a_ErrorMsg on failure. */
+	static cSchematicPtr LoadArea(
+		const AString & a_WorldFolder,
+		int a_MinX, int a_MinY, int a_MinZ,
+		int a_MaxX, int a_MaxY, int a_MaxZ,
+		cTaskScheduler * a_Scheduler,
+		AString & a_ErrorMsg
+	);
+};
+
+
+
+
@@ -0,0 +1,448 @@
+
+// ArchiveWriter.cpp
+
+// Implements the cArchiveWriter class that stores files into a single tar or zip archive, written sequentially
+
+#include "Globals.h"
+#include "ArchiveWriter.h"
+#include "zlib/zlib.h"
+
+
+
+
+
+/** The size of a tar block; headers take one block, entry data is padded to whole blocks. */
+static const size_t TAR_BLOCK_SIZE = 512;
+
+/** The largest entry size representable in a ustar header (11 octal digits). */
+static const UInt64 TAR_MAX_ENTRY_SIZE = 077777777777ULL;
+
+/** The value of the zip fields that have overflowed into the Zip64 extensions. */
+static const UInt32 ZIP_OVERFLOW_32 = 0xffffffff;
+static const UInt16 ZIP_OVERFLOW_16 = 0xffff;
+
+/** The zip version needed for plain entries, and for the Zip64 extensions. */
+static const UInt16 ZIP_VERSION_DEFAULT = 20;
+static const UInt16 ZIP_VERSION_ZIP64 = 45;
+
+/** The zip general purpose flag marking the entry name as UTF-8. */
+static const UInt16 ZIP_FLAG_UTF8 = 0x0800;
+
+
+
+
+
+static void AppendUInt16LE(AString & a_Dest, UInt16 a_Value)
+{
+	a_Dest.push_back(static_cast<char>(a_Value & 0xff));
+	a_Dest.push_back(static_cast<char>(a_Value >> 8));
+}
+
+
+
+
+
+static void AppendUInt32LE(AString & a_Dest, UInt32 a_Value)
+{
+	AppendUInt16LE(a_Dest, static_cast<UInt16>(a_Value & 0xffff));
+	AppendUInt16LE(a_Dest, static_cast<UInt16>(a_Value >> 16));
+}
+
+
+
+
+
+static void AppendUInt64LE(AString & a_Dest, UInt64 a_Value)
+{
+	AppendUInt32LE(a_Dest, static_cast<UInt32>(a_Value & 0xffffffff));
+	AppendUInt32LE(a_Dest, static_cast<UInt32>(a_Value >> 32));
+}
+
+
+
+
+
+/** Writes the value as a zero-padded octal number into the tar header field, terminated by a NUL. */
+static void SetTarOctal(char * a_Field, size_t a_FieldSize, UInt64 a_Value)
+{
+	for (size_t i = a_FieldSize - 1; i > 0; i--)
+	{
+		a_Field[i - 1] = static_cast<char>('0' + (a_Value & 7));
+		a_Value >>= 3;
+	}
+	a_Field[a_FieldSize - 1] = 0;
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cArchiveWriter:
+
+cArchiveWriter::cArchiveWriter(void):
+	m_Format(afTar),
+	m_Offset(0),
+	m_HasFailed(false),
+	m_Time(0),
+	m_DosTime(0),
+	m_DosDate(0)
+{
+}
+
+
+
+
+
+cArchiveWriter::~cArchiveWriter()
+{
+	if (m_File.IsOpen())
+	{
+		Close();
+	}
+}
+
+
+
+
+
+bool cArchiveWriter::Open(const AString & a_FileName)
+{
+	m_FileName = a_FileName;
+	m_Format = (
+		(a_FileName.size() >= 4) && (NoCaseCompare(a_FileName.substr(a_FileName.size() - 4), ".zip") == 0)
+	) ? afZip : afTar;
+	m_Offset = 0;
+	m_HasFailed = false;
+	m_ZipEntries.clear();
+
+	// All the entries get the time the archive was created:
+	m_Time = time(nullptr);
+	struct tm * Local = localtime(&m_Time);
+	if ((Local != nullptr) && (Local->tm_year >= 80))
+	{
+		m_DosTime = static_cast<UInt16>((Local->tm_hour << 11) | (Local->tm_min << 5) | (Local->tm_sec / 2));
+		m_DosDate = static_cast<UInt16>(((Local->tm_year - 80) << 9) | ((Local->tm_mon + 1) << 5) | Local->tm_mday);
+	}
+	else
+	{
+		m_DosTime = 0;
+		m_DosDate = (1 << 5) | 1;  // 1980-01-01
+	}
+
+	return m_File.Open(a_FileName, cFile::fmWrite);
+}
+
+
+
+
+
+bool cArchiveWriter::AddEntry(const AString & a_Name, const AString & a_Data)
+{
+	if (!m_File.IsOpen() || m_HasFailed)
+	{
+		return false;
+	}
+
+	// Normalize the name into a relative path with forward slashes, without any "." or ".." components,
+	// so that the entry cannot escape the folder into which the archive is extracted:
+	AString FullName(a_Name);
+	std::replace(FullName.begin(), FullName.end(), '\\', '/');
+	if ((FullName.size() >= 2) && (FullName[1] == ':'))
+	{
+		FullName.erase(0, 2);
+	}
+	AStringVector Components;
+	for (const auto & Component: StringSplit(FullName, "/"))
+	{
+		if (Component.empty() || (Component == "."))
+		{
+			continue;
+		}
+		if (Component == "..")
+		{
+			// Go up a folder, but never above the archive's root:
+			if (!Components.empty())
+			{
+				Components.pop_back();
+			}
+			continue;
+		}
+		Components.push_back(Component);
+	}
+	AString Name = StringsConcat(Components, '/');
+	if (Name.empty())
+	{
+		LOGWARNING("Cannot add an entry named \"%s\" into archive %s", a_Name.c_str(), m_FileName.c_str());
+		return false;
+	}
+
+	switch (m_Format)
+	{
+		case afTar: return AddTarEntry(Name, a_Data);
+		case afZip: return AddZipEntry(Name, a_Data);
+	}
+	return false;
+}
+
+
+
+
+
+bool cArchiveWriter::Close(void)
+{
+	if (!m_File.IsOpen())
+	{
+		return false;
+	}
+	if (!m_HasFailed)
+	{
+		switch (m_Format)
+		{
+			case afTar:
+			{
+				// Two zero blocks terminate the archive:
+				Write(AString(2 * TAR_BLOCK_SIZE, '\0'));
+				break;
+			}
+			case afZip:
+			{
+				WriteZipCentralDirectory();
+				break;
+			}
+		}
+	}
+	m_File.Close();
+	m_ZipEntries.clear();
+	if (m_HasFailed)
+	{
+		LOGWARNING("Cannot write archive %s", m_FileName.c_str());
+	}
+	return !m_HasFailed;
+}
+
+
+
+
+
+bool cArchiveWriter::AddTarEntry(const AString & a_Name, const AString & a_Data)
+{
+	if (a_Data.size() > TAR_MAX_ENTRY_SIZE)
+	{
+		LOGWARNING("Entry %s is too large for a tar archive", a_Name.c_str());
+		return false;
+	}
+
+	// Fit the name into the ustar name and prefix fields, split at a slash; use a GNU long name entry if it doesn't fit:
+	AString Name(a_Name), Prefix;
+	if (a_Name.size() > 100)
+	{
+		size_t Slash = a_Name.find('/', (a_Name.size() > 101) ? a_Name.size() - 101 : 0);
+		if ((Slash != AString::npos) && (Slash <= 155) && (Slash + 1 < a_Name.size()))
+		{
+			Prefix = a_Name.substr(0, Slash);
+			Name = a_Name.substr(Slash + 1);
+		}
+		else
+		{
+			AString LongName(a_Name);
+			LongName.push_back('\0');
+			LongName.resize((LongName.size() + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE, '\0');
+			if (
+				!WriteTarHeader("././@LongLink", AString(), 'L', a_Name.size() + 1) ||
+				!Write(LongName)
+			)
+			{
+				return false;
+			}
+			Name = a_Name.substr(0, 100);
+		}
+	}
+
+	if (!WriteTarHeader(Name, Prefix, '0', a_Data.size()) || !Write(a_Data))
+	{
+		return false;
+	}
+	size_t Padding = (TAR_BLOCK_SIZE - a_Data.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+	return (Padding == 0) || Write(AString(Padding, '\0'));
+}
+
+
+
+
+
+bool cArchiveWriter::AddZipEntry(const AString & a_Name, const AString & a_Data)
+{
+	if ((a_Data.size() >= ZIP_OVERFLOW_32) || (a_Name.size() >= ZIP_OVERFLOW_16))
+	{
+		LOGWARNING("Entry %s is too large for a zip archive", a_Name.c_str());
+		return false;
+	}
+
+	sZipEntry Entry;
+	Entry.m_Name = a_Name;
+	Entry.m_CRC = static_cast<UInt32>(crc32(crc32(0, nullptr, 0), reinterpret_cast<const Bytef *>(a_Data.data()), static_cast<uInt>(a_Data.size())));
+	Entry.m_Size = static_cast<UInt32>(a_Data.size());
+	Entry.m_Offset = m_Offset;
+
+	// Local file header, the data is stored uncompressed:
+	AString Header;
+	Header.reserve(30 + a_Name.size());
+	AppendUInt32LE(Header, 0x04034b50);
+	AppendUInt16LE(Header, ZIP_VERSION_DEFAULT);
+	AppendUInt16LE(Header, ZIP_FLAG_UTF8);
+	AppendUInt16LE(Header, 0);  // Method: stored
+	AppendUInt16LE(Header, m_DosTime);
+	AppendUInt16LE(Header, m_DosDate);
+	AppendUInt32LE(Header, Entry.m_CRC);
+	AppendUInt32LE(Header, Entry.m_Size);  // Compressed size
+	AppendUInt32LE(Header, Entry.m_Size);  // Uncompressed size
+	AppendUInt16LE(Header, static_cast<UInt16>(a_Name.size()));
+	AppendUInt16LE(Header, 0);  // Extra field length
+	Header.append(a_Name);
+	if (!Write(Header) || !Write(a_Data))
+	{
+		return false;
+	}
+	m_ZipEntries.push_back(std::move(Entry));
+	return true;
+}
+
+
+
+
+
+bool cArchiveWriter::WriteTarHeader(const AString & a_Name, const AString & a_Prefix, char a_Type, UInt64 a_Size)
+{
+	char Header[TAR_BLOCK_SIZE];
+	memset(Header, 0, sizeof(Header));
+	memcpy(Header, a_Name.data(), std::min<size_t>(a_Name.size(), 100));
+	SetTarOctal(Header + 100, 8, 0644);       // Mode
+	SetTarOctal(Header + 108, 8, 0);          // UID
+	SetTarOctal(Header + 116, 8, 0);          // GID
+	SetTarOctal(Header + 124, 12, a_Size);
+	SetTarOctal(Header + 136, 12, static_cast<UInt64>(m_Time));
+	Header[156] = a_Type;
+	memcpy(Header + 257, "ustar", 6);         // Magic, including the terminating NUL
+	memcpy(Header + 263, "00", 2);            // Version
+	memcpy(Header + 345, a_Prefix.data(), std::min<size_t>(a_Prefix.size(), 155));
+
+	// The checksum is calculated with the checksum field filled with spaces:
+	memset(Header + 148, ' ', 8);
+	UInt32 Checksum = 0;
+	for (size_t i = 0; i < sizeof(Header); i++)
+	{
+		Checksum += static_cast<unsigned char>(Header[i]);
+	}
+	SetTarOctal(Header + 148, 7, Checksum);
+	return Write(Header, sizeof(Header));
+}
+
+
+
+
+
+bool cArchiveWriter::WriteZipCentralDirectory(void)
+{
+	UInt64 DirOffset = m_Offset;
+	AString Dir;
+	for (const auto & Entry: m_ZipEntries)
+	{
+		bool IsZip64 = (Entry.m_Offset >= ZIP_OVERFLOW_32);
+		AppendUInt32LE(Dir, 0x02014b50);
+		AppendUInt16LE(Dir, (3 << 8) | ZIP_VERSION_ZIP64);  // Made by: UNIX
+		AppendUInt16LE(Dir, IsZip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT);
+		AppendUInt16LE(Dir, ZIP_FLAG_UTF8);
+		AppendUInt16LE(Dir, 0);  // Method: stored
+		AppendUInt16LE(Dir, m_DosTime);
+		AppendUInt16LE(Dir, m_DosDate);
+		AppendUInt32LE(Dir, Entry.m_CRC);
+		AppendUInt32LE(Dir, Entry.m_Size);
+		AppendUInt32LE(Dir, Entry.m_Size);
+		AppendUInt16LE(Dir, static_cast<UInt16>(Entry.m_Name.size()));
+		AppendUInt16LE(Dir, IsZip64 ? 12 : 0);  // Extra field length
+		AppendUInt16LE(Dir, 0);  // Comment length
+		AppendUInt16LE(Dir, 0);  // Disk number
+		AppendUInt16LE(Dir, 0);  // Internal attributes
+		AppendUInt32LE(Dir, 0100644u << 16);  // External attributes: UNIX regular file, rw-r--r--
+		AppendUInt32LE(Dir, IsZip64 ? ZIP_OVERFLOW_32 : static_cast<UInt32>(Entry.m_Offset));
+		Dir.append(Entry.m_Name);
+		if (IsZip64)
+		{
+			AppendUInt16LE(Dir, 0x0001);  // Zip64 extended information
+			AppendUInt16LE(Dir, 8);
+			AppendUInt64LE(Dir, Entry.m_Offset);
+		}
+
+		// Write in chunks, so that huge directories don't need to be kept in memory whole:
+		if (Dir.size() >= 64 * 1024)
+		{
+			if (!Write(Dir))
+			{
+				return false;
+			}
+			Dir.clear();
+		}
+	}
+	if (!Write(Dir))
+	{
+		return false;
+	}
+	UInt64 DirSize = m_Offset - DirOffset;
+	UInt64 NumEntries = m_ZipEntries.size();
+
+	// The Zip64 end of central directory record and its locator, if any of the values overflow the plain record:
+	AString End;
+	bool IsZip64 = ((NumEntries >= ZIP_OVERFLOW_16) || (DirSize >= ZIP_OVERFLOW_32) || (DirOffset >= ZIP_OVERFLOW_32));
+	if (IsZip64)
+	{
+		UInt64 EndOffset = m_Offset;
+		AppendUInt32LE(End, 0x06064b50);
+		AppendUInt64LE(End, 44);  // Size of the rest of the record
+		AppendUInt16LE(End, (3 << 8) | ZIP_VERSION_ZIP64);
+		AppendUInt16LE(End, ZIP_VERSION_ZIP64);
+		AppendUInt32LE(End, 0);  // This disk
+		AppendUInt32LE(End, 0);  // Disk with the central directory
+		AppendUInt64LE(End, NumEntries);
+		AppendUInt64LE(End, NumEntries);
+		AppendUInt64LE(End, DirSize);
+		AppendUInt64LE(End, DirOffset);
+
+		AppendUInt32LE(End, 0x07064b50);
+		AppendUInt32LE(End, 0);  // Disk with the Zip64 end record
+		AppendUInt64LE(End, EndOffset);
+		AppendUInt32LE(End, 1);  // Total number of disks
+	}
+	AppendUInt32LE(End, 0x06054b50);
+	AppendUInt16LE(End, 0);  // This disk
+	AppendUInt16LE(End, 0);  // Disk with the central directory
+	AppendUInt16LE(End, IsZip64 ? ZIP_OVERFLOW_16 : static_cast<UInt16>(NumEntries));
+	AppendUInt16LE(End, IsZip64 ? ZIP_OVERFLOW_16 : static_cast<UInt16>(NumEntries));
+	AppendUInt32LE(End, IsZip64 ? ZIP_OVERFLOW_32 : static_cast<UInt32>(DirSize));
+	AppendUInt32LE(End, IsZip64 ? ZIP_OVERFLOW_32 : static_cast<UInt32>(DirOffset));
+	AppendUInt16LE(End, 0);  // Comment length
+	return Write(End);
+}
+
+
+
+
+
+bool cArchiveWriter::Write(const void * a_Data, size_t a_Size)
+{
+	if (m_HasFailed)
+	{
+		return false;
+	}
+	if ((a_Size > 0) && (m_File.Write(a_Data, a_Size) != static_cast<int>(a_Size)))
+	{
+		m_HasFailed = true;
+		return false;
+	}
+	m_Offset += a_Size;
+	return true;
+}
+
+
+
+
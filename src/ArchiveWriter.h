@@ -0,0 +1,102 @@
+
+// ArchiveWriter.h
+
+// Declares the cArchiveWriter class that stores files into a single tar or zip archive, written sequentially
+
+/*
+The archive is written in a single pass, each entry is appended as soon as it is added, so that the whole output
+of a batch run is one sequential write instead of many small files. The tar archives use the ustar format, with
+the GNU extension for long names; the zip archives store the entries uncompressed (PNG data doesn't compress
+any further) and switch to the Zip64 extensions for archives with more than 65535 entries or over 4 GiB.
+The object is not thread-safe, it is expected to be used by a single serializer thread.
+*/
+
+
+
+
+
+#pragma once
+
+
+
+
+
+class cArchiveWriter
+{
+public:
+	enum eFormat
+	{
+		afTar,
+		afZip,
+	};
+
+
+	cArchiveWriter(void);
+
+	/** Closes the archive, if open. */
+	~cArchiveWriter();
+
+	/** Creates the archive file. The format is chosen by the file name's extension: ".zip" for zip, tar otherwise.
+	Returns false if the file cannot be created. */
+	bool Open(const AString & a_FileName);
+
+	/** Returns true if the archive has been opened. */
+	bool IsOpen(void) const { return m_File.IsOpen(); }
+
+	/** Appends an entry with the specified name and contents. Backslashes in the name are converted to slashes,
+	leading slashes, drive letters and "./" are removed. Returns false on failure. */
+	bool AddEntry(const AString & a_Name, const AString & a_Data);
+
+	/** Writes the archive trailer (the zip central directory) and closes the file. Returns false on failure. */
+	bool Close(void);
+
+	/** Returns the name of the archive file. */
+	const AString & GetFileName(void) const { return m_FileName; }
+
+protected:
+	/** The info about a zip entry, needed for its central directory record. */
+	struct sZipEntry
+	{
+		AString m_Name;
+		UInt32 m_CRC;
+		UInt32 m_Size;
+		UInt64 m_Offset;
+	};
+
+
+	AString m_FileName;
+	cFile m_File;
+	eFormat m_Format;
+
+	/** The number of bytes written into the file so far. */
+	UInt64 m_Offset;
+
+	/** Set once a write fails, so that nothing more is written into the broken archive. */
+	bool m_HasFailed;
+
+	/** The modification time stored for all the entries (the time the archive was opened). */
+	time_t m_Time;
+	UInt16 m_DosTime;
+	UInt16 m_DosDate;
+
+	/** The entries written so far into a zip archive, for its central directory. */
+	std::vector<sZipEntry> m_ZipEntries;
+
+
+	bool AddTarEntry(const AString & a_Name, const AString & a_Data);
+	bool AddZipEntry(const AString & a_Name, const AString & a_Data);
+
+	/** Writes a single tar header block of the specified type. The name must fit the header (checked by the caller). */
+	bool WriteTarHeader(const AString & a_Name, const AString & a_Prefix, char a_Type, UInt64 a_Size);
+
+	/** Writes the zip central directory and the end-of-central-directory records. */
+	bool WriteZipCentralDirectory(void);
+
+	/** Writes the data into the file, updating m_Offset. Marks the archive as failed on error. */
+	bool Write(const void * a_Data, size_t a_Size);
+	bool Write(const AString & a_Data) { return Write(a_Data.data(), a_Data.size()); }
+};
+
+
+
+
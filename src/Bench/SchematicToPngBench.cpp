@@ -0,0 +1,351 @@
+
+// SchematicToPngBench.cpp
+
+// Implements the benchmark app entrypoint, timing the rendering pipeline on synthetic schematics
+
+/*
+The benchmark runs the same stage code as the batch pipeline (cSchematicToPng's DecodeInput() and
+ExtractBlockImage(), cPngExporter's Render() and Encode()), one after another in a single thread, on the schematics
+generated in memory by cSyntheticSchematic. The files aren't read nor written, so the results don't depend on the disk.
+Each scenario is run a few times untimed first, to warm up the caches and the allocator, then the timed iterations
+are collected using cStageStats. The results are written as JSON, to be compared between builds.
+*/
+
+#include "Globals.h"
+#include "SchematicToPng.h"
+#include "SchematicParser.h"
+#include "BlockImage.h"
+#include "PngExporter.h"
+#include "json/json.h"
+#include "SyntheticSchematic.h"
+
+
+
+
+
+class cSchematicToPngBench:
+	public cSchematicToPng
+{
+public:
+	cSchematicToPngBench(void):
+		m_SizeX(64),
+		m_SizeY(64),
+		m_SizeZ(64),
+		m_NumIterations(10),
+		m_NumWarmups(1),
+		m_NumCWRotations(0),
+		m_HorzSize(4),
+		m_VertSize(5),
+		m_Seed(1)
+	{
+	}
+
+
+
+	/** Parses the command line parameters. Returns false if the benchmark shouldn't run. */
+	bool ParseCommandLine(int argc, char ** argv)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			if ((NoCaseCompare(argv[i], "-scenario") == 0) && (i < argc - 1))
+			{
+				auto Kind = cSyntheticSchematic::GetKindForName(argv[i + 1]);
+				if (Kind == cSyntheticSchematic::skCount)
+				{
+					std::cerr << "Unknown scenario: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				m_Kinds.push_back(Kind);
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-size") == 0) && (i < argc - 3))
+			{
+				if (
+					!StringToInteger(argv[i + 1], m_SizeX) ||
+					!StringToInteger(argv[i + 2], m_SizeY) ||
+					!StringToInteger(argv[i + 3], m_SizeZ) ||
+					(m_SizeX < 1) || (m_SizeY < 1) || (m_SizeZ < 1) ||
+					(m_SizeX > 32767) || (m_SizeY > 32767) || (m_SizeZ > 32767)
+				)
+				{
+					std::cerr << "Invalid size: " << argv[i + 1] << " " << argv[i + 2] << " " << argv[i + 3] << std::endl;
+					return false;
+				}
+				i += 3;
+			}
+			else if ((NoCaseCompare(argv[i], "-iterations") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_NumIterations) || (m_NumIterations < 1))
+				{
+					std::cerr << "Invalid number of iterations: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-warmup") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_NumWarmups) || (m_NumWarmups < 0))
+				{
+					std::cerr << "Invalid number of warmup iterations: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-numcwrotations") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_NumCWRotations))
+				{
+					std::cerr << "Invalid number of rotations: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-horzsize") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_HorzSize) || (m_HorzSize < 1))
+				{
+					std::cerr << "Invalid horizontal size: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-vertsize") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_VertSize) || (m_VertSize < 1))
+				{
+					std::cerr << "Invalid vertical size: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-seed") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_Seed))
+				{
+					std::cerr << "Invalid seed: " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-out") == 0) && (i < argc - 1))
+			{
+				m_OutFileName = argv[i + 1];
+				i++;
+			}
+			else
+			{
+				std::cerr << "Unknown parameter: " << argv[i] << std::endl;
+				std::cerr << "Usage: SchematicToPngBench [-scenario <name>]... [-size <x> <y> <z>] [-iterations <n>] [-warmup <n>]" << std::endl;
+				std::cerr << "  [-numcwrotations <n>] [-horzsize <n>] [-vertsize <n>] [-seed <n>] [-out <file>]" << std::endl;
+				std::cerr << "Scenarios:";
+				for (int k = 0; k < cSyntheticSchematic::skCount; k++)
+				{
+					std::cerr << " " << cSyntheticSchematic::GetKindName(static_cast<cSyntheticSchematic::eKind>(k));
+				}
+				std::cerr << std::endl;
+				return false;
+			}
+		}
+
+		// Run all the scenarios, unless specified:
+		if (m_Kinds.empty())
+		{
+			for (int k = 0; k < cSyntheticSchematic::skCount; k++)
+			{
+				m_Kinds.push_back(static_cast<cSyntheticSchematic::eKind>(k));
+			}
+		}
+		return true;
+	}
+
+
+
+	/** Runs all the requested scenarios and outputs the results. Returns true on success. */
+	bool RunBench(void)
+	{
+		Json::Value Results;
+		Json::Value & Config = Results["Config"];
+		Config["SizeX"] = m_SizeX;
+		Config["SizeY"] = m_SizeY;
+		Config["SizeZ"] = m_SizeZ;
+		Config["NumIterations"] = m_NumIterations;
+		Config["NumWarmups"] = m_NumWarmups;
+		Config["NumCWRotations"] = m_NumCWRotations;
+		Config["HorzSize"] = m_HorzSize;
+		Config["VertSize"] = m_VertSize;
+		Config["Seed"] = m_Seed;
+		Config["OutputVersion"] = cPngExporter::OUTPUT_VERSION;
+
+		Results["Scenarios"] = Json::Value(Json::arrayValue);
+		for (auto Kind: m_Kinds)
+		{
+			Json::Value Scenario;
+			if (!RunScenario(Kind, Scenario))
+			{
+				return false;
+			}
+			Results["Scenarios"].append(Scenario);
+		}
+
+		auto Contents = Results.toStyledString();
+		if (m_OutFileName.empty())
+		{
+			std::cout << Contents;
+			return true;
+		}
+		cFile f(m_OutFileName, cFile::fmWrite);
+		if (!f.IsOpen() || (f.Write(Contents.data(), Contents.size()) != static_cast<int>(Contents.size())))
+		{
+			std::cerr << "Cannot write the results into file " << m_OutFileName << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+protected:
+	/** The scenarios to run, in order. */
+	std::vector<cSyntheticSchematic::eKind> m_Kinds;
+
+	/** The size of the generated schematics. */
+	int m_SizeX;
+	int m_SizeY;
+	int m_SizeZ;
+
+	/** The number of the timed iterations of each scenario, and of the untimed ones run before them. */
+	int m_NumIterations;
+	int m_NumWarmups;
+
+	/** The render properties, same as the listfile properties. */
+	int m_NumCWRotations;
+	int m_HorzSize;
+	int m_VertSize;
+
+	/** The seed of the random variation of the generated schematics. */
+	UInt32 m_Seed;
+
+	/** The file into which the results are written. If empty, they are written to stdout. */
+	AString m_OutFileName;
+
+
+
+	/** Generates the schematic of the specified kind and runs all the iterations on it.
+	Fills a_Result with the scenario's results. Returns false on error. */
+	bool RunScenario(cSyntheticSchematic::eKind a_Kind, Json::Value & a_Result)
+	{
+		const char * Name = cSyntheticSchematic::GetKindName(a_Kind);
+		cSyntheticSchematic Schematic(a_Kind, m_SizeX, m_SizeY, m_SizeZ, m_Seed);
+		auto Item = std::make_shared<cQueueItem>(Name, std::make_shared<cIosInputStream>(std::cin));
+		Item->m_HorzSize = m_HorzSize;
+		Item->m_VertSize = m_VertSize;
+		Item->m_NumCCWRotations = (4 - (m_NumCWRotations % 4)) % 4;
+		Item->m_Markers = Schematic.GetMarkers();
+
+		// The warmup iterations are run with the stats disabled, so that they aren't counted:
+		cStageStats Stats;
+		std::vector<Int64> TotalNsec;
+		AString NBTBuffer;
+		size_t PngSize = 0;
+		int ImgWidth = 0, ImgHeight = 0;
+		for (int i = -m_NumWarmups; i < m_NumIterations; i++)
+		{
+			if (i == 0)
+			{
+				Stats.Enable();
+			}
+
+			// Copying the data stands in for reading the file, it isn't timed:
+			cBatchInput Input;
+			Input.m_Items.push_back(Item);
+			Input.m_FileData = Schematic.GetFileData();
+
+			auto Start = cStageStats::Now();
+			if (!DecodeInput(Input, NBTBuffer))
+			{
+				return false;
+			}
+			auto Times = Input.m_Times;
+			auto Img = ExtractBlockImage(*Item, Input.m_Parser.get(), Input.m_Decoded.get(), &Times);
+			if (Img == nullptr)
+			{
+				return false;
+			}
+			cPngExporter Exporter(*Img, Item->m_HorzSize, Item->m_VertSize, Item->m_Markers);
+			auto RenderStart = cStageStats::Now();
+			Exporter.Render();
+			auto EncodeStart = cStageStats::Now();
+			auto PngData = Exporter.Encode();
+			auto End = cStageStats::Now();
+			Times.m_StageNsec[cStageStats::stRender] = EncodeStart - RenderStart;
+			Times.m_StageNsec[cStageStats::stEncode] = End - EncodeStart;
+			Times.m_NumVoxels = static_cast<UInt64>(Img->GetSizeX()) * static_cast<UInt64>(Img->GetSizeY()) * static_cast<UInt64>(Img->GetSizeZ());
+			Times.m_NumPixels = static_cast<UInt64>(Exporter.GetImgWidth()) * static_cast<UInt64>(Exporter.GetImgHeight());
+
+			if (i >= 0)
+			{
+				TotalNsec.push_back(End - Start);
+				Stats.AddInput(Input.m_Times);
+				Stats.AddItem(Name, Times);
+			}
+			PngSize = PngData.size();
+			ImgWidth = Exporter.GetImgWidth();
+			ImgHeight = Exporter.GetImgHeight();
+		}
+
+		a_Result["Scenario"] = Name;
+		a_Result["NumBlocks"] = static_cast<Json::UInt64>(Schematic.GetNumBlocks());
+		a_Result["NumMarkers"] = static_cast<Json::UInt64>(Schematic.GetMarkers().size());
+		a_Result["InputBytes"] = static_cast<Json::UInt64>(Schematic.GetFileData().size());
+		a_Result["PngBytes"] = static_cast<Json::UInt64>(PngSize);
+		a_Result["ImageWidth"] = ImgWidth;
+		a_Result["ImageHeight"] = ImgHeight;
+
+		// The whole pipeline, from the file data to the PNG data:
+		std::sort(TotalNsec.begin(), TotalNsec.end());
+		Int64 SumNsec = 0;
+		for (auto Nsec: TotalNsec)
+		{
+			SumNsec += Nsec;
+		}
+		Json::Value & Total = a_Result["FullPipeline"];
+		Total["MinMsec"] = static_cast<double>(TotalNsec.front()) / 1e6;
+		Total["MedianMsec"] = static_cast<double>(TotalNsec[TotalNsec.size() / 2]) / 1e6;
+		Total["MeanMsec"] = static_cast<double>(SumNsec) / 1e6 / static_cast<double>(TotalNsec.size());
+		Total["MaxMsec"] = static_cast<double>(TotalNsec.back()) / 1e6;
+
+		// The stages, without the file I/O, which isn't run:
+		auto Report = Stats.GetReport();
+		a_Result["Stages"] = Json::Value(Json::arrayValue);
+		for (const auto & Stage: Report["Stages"])
+		{
+			auto StageName = Stage["Stage"].asString();
+			if ((StageName != "read") && (StageName != "write"))
+			{
+				a_Result["Stages"].append(Stage);
+			}
+		}
+		a_Result["Throughput"] = Report["Throughput"];
+
+		std::cerr << Printf("%-12s %9.3f ms median, %9.3f ms min (%d x %d px, %llu bytes of PNG)",
+			Name, Total["MedianMsec"].asDouble(), Total["MinMsec"].asDouble(), ImgWidth, ImgHeight, static_cast<unsigned long long>(PngSize)
+		) << std::endl;
+		return true;
+	}
+};
+
+
+
+
+
+int main(int argc, char ** argv)
+{
+	cSchematicToPngBench Bench;
+	if (!Bench.ParseCommandLine(argc, argv))
+	{
+		return 1;
+	}
+	return Bench.RunBench() ? 0 : 1;
+}
+
+
+
+
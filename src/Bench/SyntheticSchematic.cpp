@@ -0,0 +1,274 @@
+
+// SyntheticSchematic.cpp
+
+// Implements the cSyntheticSchematic class that generates MCEdit schematics of a controlled size and character for benchmarking
+
+#include "Globals.h"
+#include "SyntheticSchematic.h"
+#include <random>
+#include "StringCompression.h"
+#include "WorldStorage/FastNBT.h"
+
+
+
+
+
+// The block types used by the generator:
+static const Byte BLOCK_AIR = 0;
+static const Byte BLOCK_STONE = 1;
+static const Byte BLOCK_GRASS = 2;
+static const Byte BLOCK_DIRT = 3;
+static const Byte BLOCK_PLANKS = 5;
+static const Byte BLOCK_WATER = 9;
+static const Byte BLOCK_GLASS = 20;
+static const Byte BLOCK_TALL_GRASS = 31;
+static const Byte BLOCK_WOOL = 35;
+static const Byte BLOCK_BRICKS = 45;
+static const Byte BLOCK_ICE = 79;
+static const Byte BLOCK_STAINED_GLASS = 95;
+
+/** The distance between the markers of skMarkers, in blocks along each horizontal axis. */
+static const int MARKER_SPACING = 4;
+
+
+
+
+
+cSyntheticSchematic::cSyntheticSchematic(eKind a_Kind, int a_SizeX, int a_SizeY, int a_SizeZ, UInt32 a_Seed):
+	m_SizeX(a_SizeX),
+	m_SizeY(a_SizeY),
+	m_SizeZ(a_SizeZ),
+	m_BlockTypes(static_cast<size_t>(a_SizeX) * static_cast<size_t>(a_SizeY) * static_cast<size_t>(a_SizeZ), static_cast<char>(BLOCK_AIR)),
+	m_BlockMetas(m_BlockTypes.size(), 0),
+	m_NumBlocks(0)
+{
+	switch (a_Kind)
+	{
+		case skSolid:       GenerateSolid();             break;
+		case skSparse:      GenerateSparse(a_Seed);      break;
+		case skTerrain:     GenerateTerrain();           break;
+		case skTransparent: GenerateTransparent(a_Seed); break;
+		case skMarkers:
+		{
+			GenerateTerrain();
+			GenerateMarkers(a_Seed);
+			break;
+		}
+		case skCount:
+		{
+			ASSERT(!"Invalid schematic kind");
+			break;
+		}
+	}
+	Finish();
+}
+
+
+
+
+
+const char * cSyntheticSchematic::GetKindName(eKind a_Kind)
+{
+	switch (a_Kind)
+	{
+		case skSolid:       return "solid";
+		case skSparse:      return "sparse";
+		case skTerrain:     return "terrain";
+		case skTransparent: return "transparent";
+		case skMarkers:     return "markers";
+		case skCount:       break;
+	}
+	return "unknown";
+}
+
+
+
+
+
+cSyntheticSchematic::eKind cSyntheticSchematic::GetKindForName(const AString & a_Name)
+{
+	for (int i = 0; i < skCount; i++)
+	{
+		if (NoCaseCompare(a_Name, GetKindName(static_cast<eKind>(i))) == 0)
+		{
+			return static_cast<eKind>(i);
+		}
+	}
+	return skCount;
+}
+
+
+
+
+
+int cSyntheticSchematic::GetTerrainHeight(int a_X, int a_Z) const
+{
+	// A sum of a few waves makes for irregular hills, without the need for any noise generator:
+	double Wave = sin(a_X * 0.13) + sin(a_Z * 0.09) + 0.5 * sin((a_X + a_Z) * 0.05);  // In the range [-2.5, 2.5]
+	int Height = static_cast<int>(m_SizeY * (0.45 + 0.1 * Wave));
+	return std::min(std::max(Height, 0), m_SizeY - 1);
+}
+
+
+
+
+
+void cSyntheticSchematic::GenerateSolid(void)
+{
+	// Each layer uses another variant of stone, so that the image isn't a single color:
+	for (int y = 0; y < m_SizeY; y++)
+	{
+		for (int z = 0; z < m_SizeZ; z++)
+		{
+			for (int x = 0; x < m_SizeX; x++)
+			{
+				SetBlock(x, y, z, BLOCK_STONE, static_cast<Byte>(y % 7));
+			}
+		}
+	}
+}
+
+
+
+
+
+void cSyntheticSchematic::GenerateSparse(UInt32 a_Seed)
+{
+	static const Byte BlockTypes[] = {BLOCK_STONE, BLOCK_PLANKS, BLOCK_BRICKS, BLOCK_WOOL};
+	std::mt19937 Random(a_Seed);
+	for (int y = 0; y < m_SizeY; y++)
+	{
+		for (int z = 0; z < m_SizeZ; z++)
+		{
+			for (int x = 0; x < m_SizeX; x++)
+			{
+				// The raw generator output is used instead of the distributions, those differ between the standard libraries:
+				UInt32 Rnd = Random();
+				if (Rnd % 20 == 0)
+				{
+					Byte BlockType = BlockTypes[(Rnd / 20) % ARRAYCOUNT(BlockTypes)];
+					SetBlock(x, y, z, BlockType, (BlockType == BLOCK_WOOL) ? static_cast<Byte>((Rnd >> 16) % 16) : 0);
+				}
+			}
+		}
+	}
+}
+
+
+
+
+
+void cSyntheticSchematic::GenerateTerrain(void)
+{
+	int SeaLevel = static_cast<int>(m_SizeY * 0.4);
+	for (int z = 0; z < m_SizeZ; z++)
+	{
+		for (int x = 0; x < m_SizeX; x++)
+		{
+			int Height = GetTerrainHeight(x, z);
+			for (int y = 0; y <= Height; y++)
+			{
+				if (y == Height)
+				{
+					SetBlock(x, y, z, (y < SeaLevel) ? BLOCK_DIRT : BLOCK_GRASS);
+				}
+				else
+				{
+					SetBlock(x, y, z, (y + 3 >= Height) ? BLOCK_DIRT : BLOCK_STONE);
+				}
+			}
+			for (int y = Height + 1; y < SeaLevel; y++)
+			{
+				SetBlock(x, y, z, BLOCK_WATER);
+			}
+		}
+	}
+}
+
+
+
+
+
+void cSyntheticSchematic::GenerateTransparent(UInt32 a_Seed)
+{
+	std::mt19937 Random(a_Seed);
+	for (int y = 0; y < m_SizeY; y++)
+	{
+		for (int z = 0; z < m_SizeZ; z++)
+		{
+			for (int x = 0; x < m_SizeX; x++)
+			{
+				UInt32 Rnd = Random();
+				switch (Rnd % 10)
+				{
+					case 0: case 1: SetBlock(x, y, z, BLOCK_GLASS); break;
+					case 2: case 3: SetBlock(x, y, z, BLOCK_STAINED_GLASS, static_cast<Byte>((Rnd >> 8) % 16)); break;
+					case 4:         SetBlock(x, y, z, BLOCK_WATER); break;
+					case 5:         SetBlock(x, y, z, BLOCK_ICE); break;
+					case 6:         SetBlock(x, y, z, BLOCK_TALL_GRASS, 1); break;
+					case 7:         SetBlock(x, y, z, BLOCK_STONE); break;
+					default:        break;  // Air
+				}
+			}
+		}
+	}
+}
+
+
+
+
+
+void cSyntheticSchematic::GenerateMarkers(UInt32 a_Seed)
+{
+	// Use all the shapes in turn:
+	std::vector<cMarkerShapePtr> Shapes;
+	for (const auto & Shape: cMarkerShape::GetNameMap())
+	{
+		Shapes.push_back(Shape.second);
+	}
+
+	std::mt19937 Random(a_Seed);
+	for (int z = 0; z < m_SizeZ; z += MARKER_SPACING)
+	{
+		for (int x = 0; x < m_SizeX; x += MARKER_SPACING)
+		{
+			int y = std::min(GetTerrainHeight(x, z) + 1, m_SizeY - 1);
+			int Color = static_cast<int>(Random() & 0xffffff);
+			m_Markers.push_back(std::make_shared<cMarker>(x, y, z, Shapes[m_Markers.size() % Shapes.size()], Color));
+		}
+	}
+}
+
+
+
+
+
+void cSyntheticSchematic::Finish(void)
+{
+	for (auto BlockType: m_BlockTypes)
+	{
+		if (BlockType != static_cast<char>(BLOCK_AIR))
+		{
+			m_NumBlocks += 1;
+		}
+	}
+
+	cFastNBTWriter Writer("Schematic");
+	Writer.AddShort("Width",  static_cast<Int16>(m_SizeX));
+	Writer.AddShort("Height", static_cast<Int16>(m_SizeY));
+	Writer.AddShort("Length", static_cast<Int16>(m_SizeZ));
+	Writer.AddString("Materials", "Alpha");
+	Writer.AddByteArray("Blocks", m_BlockTypes);
+	Writer.AddByteArray("Data", m_BlockMetas);
+	Writer.BeginList("Entities", TAG_Compound);
+	Writer.EndList();
+	Writer.BeginList("TileEntities", TAG_Compound);
+	Writer.EndList();
+	Writer.Finish();
+	const auto & NBT = Writer.GetResult();
+	CompressStringGZIP(NBT.data(), NBT.size(), m_FileData);
+}
+
+
+
+
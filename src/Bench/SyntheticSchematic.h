@@ -0,0 +1,95 @@
+
+// SyntheticSchematic.h
+
+// Declares the cSyntheticSchematic class that generates MCEdit schematics of a controlled size and character for benchmarking
+
+/*
+The schematics are generated in memory as gzipped MCEdit .schematic NBT, the same data as read from the files,
+so that the benchmark runs all the stages from uncompressing the data on. The generation is deterministic for the
+same kind, size and seed, so that the results of different builds are comparable.
+*/
+
+
+
+
+
+#pragma once
+
+#include "Marker.h"
+
+
+
+
+
+class cSyntheticSchematic
+{
+public:
+	/** The character of the generated schematic. */
+	enum eKind
+	{
+		skSolid,        ///< The whole volume filled with opaque blocks
+		skSparse,       ///< Single opaque blocks scattered in the air, about 5 % of the volume
+		skTerrain,      ///< A hilly landscape of stone, dirt and grass, with water in the valleys
+		skTransparent,  ///< Mostly glass, stained glass, water, ice and tall grass, so that many blocks are visible through each other
+		skMarkers,      ///< The terrain with a marker above every fourth block of the surface in each direction
+
+		skCount,
+	};
+
+
+	/** Generates the schematic of the specified kind and size. a_Seed selects the random variation. */
+	cSyntheticSchematic(eKind a_Kind, int a_SizeX, int a_SizeY, int a_SizeZ, UInt32 a_Seed);
+
+	/** Returns the gzipped NBT data of the schematic, as if read from a .schematic file. */
+	const AString & GetFileData(void) const { return m_FileData; }
+
+	/** Returns the markers to render with the schematic. Empty except for skMarkers. */
+	const cMarkerPtrs & GetMarkers(void) const { return m_Markers; }
+
+	/** Returns the number of non-air blocks in the schematic. */
+	UInt64 GetNumBlocks(void) const { return m_NumBlocks; }
+
+	/** Returns the name of the kind, as used on the command line and in the reports. */
+	static const char * GetKindName(eKind a_Kind);
+
+	/** Returns the kind of the specified name (case-insensitive), or skCount if there's no such kind. */
+	static eKind GetKindForName(const AString & a_Name);
+
+protected:
+	int m_SizeX;
+	int m_SizeY;
+	int m_SizeZ;
+
+	/** The block types and metas, indexed by [x + z * SizeX + y * SizeX * SizeZ], as stored in the schematic. */
+	AString m_BlockTypes;
+	AString m_BlockMetas;
+
+	AString m_FileData;
+	cMarkerPtrs m_Markers;
+	UInt64 m_NumBlocks;
+
+
+	/** Sets the block at the specified coords. */
+	void SetBlock(int a_X, int a_Y, int a_Z, Byte a_BlockType, Byte a_BlockMeta = 0)
+	{
+		size_t Idx = static_cast<size_t>(a_X + a_Z * m_SizeX + a_Y * m_SizeX * m_SizeZ);
+		m_BlockTypes[Idx] = static_cast<char>(a_BlockType);
+		m_BlockMetas[Idx] = static_cast<char>(a_BlockMeta);
+	}
+
+	/** Returns the height of the terrain's surface at the specified column. */
+	int GetTerrainHeight(int a_X, int a_Z) const;
+
+	void GenerateSolid(void);
+	void GenerateSparse(UInt32 a_Seed);
+	void GenerateTerrain(void);
+	void GenerateTransparent(UInt32 a_Seed);
+	void GenerateMarkers(UInt32 a_Seed);
+
+	/** Writes the blocks into m_FileData as gzipped NBT and counts the non-air blocks. */
+	void Finish(void);
+};
+
+
+
+
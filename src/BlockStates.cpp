@@ -0,0 +1,827 @@
+
+// BlockStates.cpp
+
+// Implements the functions mapping the modern (1.13+) block states onto the legacy block types and metas used by the renderer
+
+#include "Globals.h"
+#include "BlockStates.h"
+
+
+
+
+
+/** Specifies how the block state properties modify the legacy block. */
+enum eStateHandling
+{
+	shNone,  ///< Properties are ignored
+	shSlab,  ///< "type=double" uses m_AltType (the double slab), "type=top" sets the top-half bit in the meta
+	shLog,   ///< "axis=x" and "axis=z" set the log direction bits in the meta
+	shLit,   ///< "lit=true" uses m_AltType (the lit variant of the block)
+};
+
+
+
+
+
+struct cBlockStateMapping
+{
+	const char * m_Name;
+	Byte m_BlockType;
+	Byte m_BlockMeta;
+	eStateHandling m_Handling;
+	Byte m_AltType;
+};
+
+
+
+
+
+/** The mapping of the block names (without the namespace) to the legacy blocks, sorted by name. */
+static const cBlockStateMapping g_BlockStateMappings[] =
+{
+	{"acacia_button", 143, 0, shNone, 0},
+	{"acacia_door", 196, 0, shNone, 0},
+	{"acacia_fence", 192, 0, shNone, 0},
+	{"acacia_fence_gate", 187, 0, shNone, 0},
+	{"acacia_leaves", 161, 0, shNone, 0},
+	{"acacia_log", 162, 0, shLog, 0},
+	{"acacia_planks", 5, 4, shNone, 0},
+	{"acacia_pressure_plate", 72, 0, shNone, 0},
+	{"acacia_sapling", 6, 4, shNone, 0},
+	{"acacia_sign", 63, 0, shNone, 0},
+	{"acacia_slab", 126, 4, shSlab, 125},
+	{"acacia_stairs", 163, 0, shNone, 0},
+	{"acacia_trapdoor", 96, 0, shNone, 0},
+	{"acacia_wall_sign", 68, 0, shNone, 0},
+	{"acacia_wood", 162, 12, shNone, 0},
+	{"activator_rail", 157, 0, shNone, 0},
+	{"air", 0, 0, shNone, 0},
+	{"allium", 38, 2, shNone, 0},
+	{"andesite", 1, 5, shNone, 0},
+	{"anvil", 145, 0, shNone, 0},
+	{"attached_melon_stem", 105, 0, shNone, 0},
+	{"attached_pumpkin_stem", 104, 0, shNone, 0},
+	{"azure_bluet", 38, 3, shNone, 0},
+	{"barrier", 166, 0, shNone, 0},
+	{"basalt", 1, 6, shNone, 0},
+	{"beacon", 138, 0, shNone, 0},
+	{"bedrock", 7, 0, shNone, 0},
+	{"beetroots", 207, 0, shNone, 0},
+	{"birch_button", 143, 0, shNone, 0},
+	{"birch_door", 194, 0, shNone, 0},
+	{"birch_fence", 189, 0, shNone, 0},
+	{"birch_fence_gate", 184, 0, shNone, 0},
+	{"birch_leaves", 18, 2, shNone, 0},
+	{"birch_log", 17, 2, shLog, 0},
+	{"birch_planks", 5, 2, shNone, 0},
+	{"birch_pressure_plate", 72, 0, shNone, 0},
+	{"birch_sapling", 6, 2, shNone, 0},
+	{"birch_sign", 63, 0, shNone, 0},
+	{"birch_slab", 126, 2, shSlab, 125},
+	{"birch_stairs", 135, 0, shNone, 0},
+	{"birch_trapdoor", 96, 0, shNone, 0},
+	{"birch_wall_sign", 68, 0, shNone, 0},
+	{"birch_wood", 17, 14, shNone, 0},
+	{"black_banner", 176, 0, shNone, 0},
+	{"black_bed", 26, 0, shNone, 0},
+	{"black_carpet", 171, 15, shNone, 0},
+	{"black_concrete", 251, 15, shNone, 0},
+	{"black_concrete_powder", 252, 15, shNone, 0},
+	{"black_glazed_terracotta", 250, 0, shNone, 0},
+	{"black_shulker_box", 234, 0, shNone, 0},
+	{"black_stained_glass", 95, 15, shNone, 0},
+	{"black_stained_glass_pane", 160, 15, shNone, 0},
+	{"black_terracotta", 159, 15, shNone, 0},
+	{"black_wall_banner", 177, 0, shNone, 0},
+	{"black_wool", 35, 15, shNone, 0},
+	{"blackstone", 173, 0, shNone, 0},
+	{"blue_banner", 176, 0, shNone, 0},
+	{"blue_bed", 26, 0, shNone, 0},
+	{"blue_carpet", 171, 11, shNone, 0},
+	{"blue_concrete", 251, 11, shNone, 0},
+	{"blue_concrete_powder", 252, 11, shNone, 0},
+	{"blue_glazed_terracotta", 246, 0, shNone, 0},
+	{"blue_ice", 174, 0, shNone, 0},
+	{"blue_orchid", 38, 1, shNone, 0},
+	{"blue_shulker_box", 230, 0, shNone, 0},
+	{"blue_stained_glass", 95, 11, shNone, 0},
+	{"blue_stained_glass_pane", 160, 11, shNone, 0},
+	{"blue_terracotta", 159, 11, shNone, 0},
+	{"blue_wall_banner", 177, 0, shNone, 0},
+	{"blue_wool", 35, 11, shNone, 0},
+	{"bone_block", 216, 0, shNone, 0},
+	{"bookshelf", 47, 0, shNone, 0},
+	{"brain_coral", 35, 6, shNone, 0},
+	{"brain_coral_block", 35, 6, shNone, 0},
+	{"brain_coral_fan", 35, 6, shNone, 0},
+	{"brain_coral_wall_fan", 35, 6, shNone, 0},
+	{"brewing_stand", 117, 0, shNone, 0},
+	{"brick_slab", 44, 4, shSlab, 43},
+	{"brick_stairs", 108, 0, shNone, 0},
+	{"bricks", 45, 0, shNone, 0},
+	{"brown_banner", 176, 0, shNone, 0},
+	{"brown_bed", 26, 0, shNone, 0},
+	{"brown_carpet", 171, 12, shNone, 0},
+	{"brown_concrete", 251, 12, shNone, 0},
+	{"brown_concrete_powder", 252, 12, shNone, 0},
+	{"brown_glazed_terracotta", 247, 0, shNone, 0},
+	{"brown_mushroom", 39, 0, shNone, 0},
+	{"brown_mushroom_block", 99, 14, shNone, 0},
+	{"brown_shulker_box", 231, 0, shNone, 0},
+	{"brown_stained_glass", 95, 12, shNone, 0},
+	{"brown_stained_glass_pane", 160, 12, shNone, 0},
+	{"brown_terracotta", 159, 12, shNone, 0},
+	{"brown_wall_banner", 177, 0, shNone, 0},
+	{"brown_wool", 35, 12, shNone, 0},
+	{"bubble_column", 9, 0, shNone, 0},
+	{"bubble_coral", 35, 2, shNone, 0},
+	{"bubble_coral_block", 35, 2, shNone, 0},
+	{"bubble_coral_fan", 35, 2, shNone, 0},
+	{"bubble_coral_wall_fan", 35, 2, shNone, 0},
+	{"cactus", 81, 0, shNone, 0},
+	{"cake", 92, 0, shNone, 0},
+	{"calcite", 1, 3, shNone, 0},
+	{"carrots", 141, 0, shNone, 0},
+	{"carved_pumpkin", 86, 0, shNone, 0},
+	{"cauldron", 118, 0, shNone, 0},
+	{"cave_air", 0, 0, shNone, 0},
+	{"chain_command_block", 211, 0, shNone, 0},
+	{"chest", 54, 0, shNone, 0},
+	{"chipped_anvil", 145, 4, shNone, 0},
+	{"chiseled_quartz_block", 155, 1, shNone, 0},
+	{"chiseled_red_sandstone", 179, 1, shNone, 0},
+	{"chiseled_sandstone", 24, 1, shNone, 0},
+	{"chiseled_stone_bricks", 98, 3, shNone, 0},
+	{"chorus_flower", 200, 0, shNone, 0},
+	{"chorus_plant", 199, 0, shNone, 0},
+	{"clay", 82, 0, shNone, 0},
+	{"coal_block", 173, 0, shNone, 0},
+	{"coal_ore", 16, 0, shNone, 0},
+	{"coarse_dirt", 3, 1, shNone, 0},
+	{"cobbled_deepslate", 4, 0, shNone, 0},
+	{"cobblestone", 4, 0, shNone, 0},
+	{"cobblestone_slab", 44, 3, shSlab, 43},
+	{"cobblestone_stairs", 67, 0, shNone, 0},
+	{"cobblestone_wall", 139, 0, shNone, 0},
+	{"cobweb", 30, 0, shNone, 0},
+	{"cocoa", 127, 0, shNone, 0},
+	{"command_block", 137, 0, shNone, 0},
+	{"comparator", 149, 0, shNone, 0},
+	{"conduit", 138, 0, shNone, 0},
+	{"copper_block", 159, 1, shNone, 0},
+	{"copper_ore", 15, 0, shNone, 0},
+	{"cornflower", 38, 3, shNone, 0},
+	{"cracked_stone_bricks", 98, 2, shNone, 0},
+	{"crafting_table", 58, 0, shNone, 0},
+	{"creeper_head", 144, 0, shNone, 0},
+	{"creeper_wall_head", 144, 0, shNone, 0},
+	{"cut_red_sandstone", 179, 2, shNone, 0},
+	{"cut_sandstone", 24, 2, shNone, 0},
+	{"cyan_banner", 176, 0, shNone, 0},
+	{"cyan_bed", 26, 0, shNone, 0},
+	{"cyan_carpet", 171, 9, shNone, 0},
+	{"cyan_concrete", 251, 9, shNone, 0},
+	{"cyan_concrete_powder", 252, 9, shNone, 0},
+	{"cyan_glazed_terracotta", 244, 0, shNone, 0},
+	{"cyan_shulker_box", 228, 0, shNone, 0},
+	{"cyan_stained_glass", 95, 9, shNone, 0},
+	{"cyan_stained_glass_pane", 160, 9, shNone, 0},
+	{"cyan_terracotta", 159, 9, shNone, 0},
+	{"cyan_wall_banner", 177, 0, shNone, 0},
+	{"cyan_wool", 35, 9, shNone, 0},
+	{"damaged_anvil", 145, 8, shNone, 0},
+	{"dandelion", 37, 0, shNone, 0},
+	{"dark_oak_button", 143, 0, shNone, 0},
+	{"dark_oak_door", 197, 0, shNone, 0},
+	{"dark_oak_fence", 191, 0, shNone, 0},
+	{"dark_oak_fence_gate", 186, 0, shNone, 0},
+	{"dark_oak_leaves", 161, 1, shNone, 0},
+	{"dark_oak_log", 162, 1, shLog, 0},
+	{"dark_oak_planks", 5, 5, shNone, 0},
+	{"dark_oak_pressure_plate", 72, 0, shNone, 0},
+	{"dark_oak_sapling", 6, 5, shNone, 0},
+	{"dark_oak_sign", 63, 0, shNone, 0},
+	{"dark_oak_slab", 126, 5, shSlab, 125},
+	{"dark_oak_stairs", 164, 0, shNone, 0},
+	{"dark_oak_trapdoor", 96, 0, shNone, 0},
+	{"dark_oak_wall_sign", 68, 0, shNone, 0},
+	{"dark_oak_wood", 162, 13, shNone, 0},
+	{"dark_prismarine", 168, 2, shNone, 0},
+	{"daylight_detector", 151, 0, shNone, 0},
+	{"dead_brain_coral", 35, 8, shNone, 0},
+	{"dead_brain_coral_block", 35, 8, shNone, 0},
+	{"dead_brain_coral_fan", 35, 8, shNone, 0},
+	{"dead_brain_coral_wall_fan", 35, 8, shNone, 0},
+	{"dead_bubble_coral", 35, 8, shNone, 0},
+	{"dead_bubble_coral_block", 35, 8, shNone, 0},
+	{"dead_bubble_coral_fan", 35, 8, shNone, 0},
+	{"dead_bubble_coral_wall_fan", 35, 8, shNone, 0},
+	{"dead_bush", 32, 0, shNone, 0},
+	{"dead_fire_coral", 35, 8, shNone, 0},
+	{"dead_fire_coral_block", 35, 8, shNone, 0},
+	{"dead_fire_coral_fan", 35, 8, shNone, 0},
+	{"dead_fire_coral_wall_fan", 35, 8, shNone, 0},
+	{"dead_horn_coral", 35, 8, shNone, 0},
+	{"dead_horn_coral_block", 35, 8, shNone, 0},
+	{"dead_horn_coral_fan", 35, 8, shNone, 0},
+	{"dead_horn_coral_wall_fan", 35, 8, shNone, 0},
+	{"dead_tube_coral", 35, 8, shNone, 0},
+	{"dead_tube_coral_block", 35, 8, shNone, 0},
+	{"dead_tube_coral_fan", 35, 8, shNone, 0},
+	{"dead_tube_coral_wall_fan", 35, 8, shNone, 0},
+	{"deepslate", 1, 5, shNone, 0},
+	{"deepslate_copper_ore", 15, 0, shNone, 0},
+	{"detector_rail", 28, 0, shNone, 0},
+	{"diamond_block", 57, 0, shNone, 0},
+	{"diamond_ore", 56, 0, shNone, 0},
+	{"diorite", 1, 3, shNone, 0},
+	{"dirt", 3, 0, shNone, 0},
+	{"dirt_path", 208, 0, shNone, 0},
+	{"dispenser", 23, 0, shNone, 0},
+	{"dragon_egg", 122, 0, shNone, 0},
+	{"dragon_head", 144, 0, shNone, 0},
+	{"dragon_wall_head", 144, 0, shNone, 0},
+	{"dried_kelp_block", 173, 0, shNone, 0},
+	{"dropper", 158, 0, shNone, 0},
+	{"emerald_block", 133, 0, shNone, 0},
+	{"emerald_ore", 129, 0, shNone, 0},
+	{"enchanting_table", 116, 0, shNone, 0},
+	{"end_gateway", 209, 0, shNone, 0},
+	{"end_portal", 119, 0, shNone, 0},
+	{"end_portal_frame", 120, 0, shNone, 0},
+	{"end_rod", 198, 0, shNone, 0},
+	{"end_stone", 121, 0, shNone, 0},
+	{"end_stone_bricks", 206, 0, shNone, 0},
+	{"ender_chest", 130, 0, shNone, 0},
+	{"farmland", 60, 0, shNone, 0},
+	{"fern", 31, 2, shNone, 0},
+	{"fire", 51, 0, shNone, 0},
+	{"fire_coral", 35, 14, shNone, 0},
+	{"fire_coral_block", 35, 14, shNone, 0},
+	{"fire_coral_fan", 35, 14, shNone, 0},
+	{"fire_coral_wall_fan", 35, 14, shNone, 0},
+	{"flower_pot", 140, 0, shNone, 0},
+	{"frosted_ice", 212, 0, shNone, 0},
+	{"furnace", 61, 0, shLit, 62},
+	{"glass", 20, 0, shNone, 0},
+	{"glass_pane", 102, 0, shNone, 0},
+	{"glowstone", 89, 0, shNone, 0},
+	{"gold_block", 41, 0, shNone, 0},
+	{"gold_ore", 14, 0, shNone, 0},
+	{"granite", 1, 1, shNone, 0},
+	{"grass", 31, 1, shNone, 0},
+	{"grass_block", 2, 0, shNone, 0},
+	{"grass_path", 208, 0, shNone, 0},
+	{"gravel", 13, 0, shNone, 0},
+	{"gray_banner", 176, 0, shNone, 0},
+	{"gray_bed", 26, 0, shNone, 0},
+	{"gray_carpet", 171, 7, shNone, 0},
+	{"gray_concrete", 251, 7, shNone, 0},
+	{"gray_concrete_powder", 252, 7, shNone, 0},
+	{"gray_glazed_terracotta", 242, 0, shNone, 0},
+	{"gray_shulker_box", 226, 0, shNone, 0},
+	{"gray_stained_glass", 95, 7, shNone, 0},
+	{"gray_stained_glass_pane", 160, 7, shNone, 0},
+	{"gray_terracotta", 159, 7, shNone, 0},
+	{"gray_wall_banner", 177, 0, shNone, 0},
+	{"gray_wool", 35, 7, shNone, 0},
+	{"green_banner", 176, 0, shNone, 0},
+	{"green_bed", 26, 0, shNone, 0},
+	{"green_carpet", 171, 13, shNone, 0},
+	{"green_concrete", 251, 13, shNone, 0},
+	{"green_concrete_powder", 252, 13, shNone, 0},
+	{"green_glazed_terracotta", 248, 0, shNone, 0},
+	{"green_shulker_box", 232, 0, shNone, 0},
+	{"green_stained_glass", 95, 13, shNone, 0},
+	{"green_stained_glass_pane", 160, 13, shNone, 0},
+	{"green_terracotta", 159, 13, shNone, 0},
+	{"green_wall_banner", 177, 0, shNone, 0},
+	{"green_wool", 35, 13, shNone, 0},
+	{"hay_block", 170, 0, shNone, 0},
+	{"heavy_weighted_pressure_plate", 148, 0, shNone, 0},
+	{"hopper", 154, 0, shNone, 0},
+	{"horn_coral", 35, 4, shNone, 0},
+	{"horn_coral_block", 35, 4, shNone, 0},
+	{"horn_coral_fan", 35, 4, shNone, 0},
+	{"horn_coral_wall_fan", 35, 4, shNone, 0},
+	{"ice", 79, 0, shNone, 0},
+	{"infested_chiseled_stone_bricks", 97, 5, shNone, 0},
+	{"infested_cobblestone", 97, 1, shNone, 0},
+	{"infested_cracked_stone_bricks", 97, 4, shNone, 0},
+	{"infested_mossy_stone_bricks", 97, 3, shNone, 0},
+	{"infested_stone", 97, 0, shNone, 0},
+	{"infested_stone_bricks", 97, 2, shNone, 0},
+	{"iron_bars", 101, 0, shNone, 0},
+	{"iron_block", 42, 0, shNone, 0},
+	{"iron_door", 71, 0, shNone, 0},
+	{"iron_ore", 15, 0, shNone, 0},
+	{"iron_trapdoor", 167, 0, shNone, 0},
+	{"jack_o_lantern", 91, 0, shNone, 0},
+	{"jukebox", 84, 0, shNone, 0},
+	{"jungle_button", 143, 0, shNone, 0},
+	{"jungle_door", 195, 0, shNone, 0},
+	{"jungle_fence", 190, 0, shNone, 0},
+	{"jungle_fence_gate", 185, 0, shNone, 0},
+	{"jungle_leaves", 18, 3, shNone, 0},
+	{"jungle_log", 17, 3, shLog, 0},
+	{"jungle_planks", 5, 3, shNone, 0},
+	{"jungle_pressure_plate", 72, 0, shNone, 0},
+	{"jungle_sapling", 6, 3, shNone, 0},
+	{"jungle_sign", 63, 0, shNone, 0},
+	{"jungle_slab", 126, 3, shSlab, 125},
+	{"jungle_stairs", 136, 0, shNone, 0},
+	{"jungle_trapdoor", 96, 0, shNone, 0},
+	{"jungle_wall_sign", 68, 0, shNone, 0},
+	{"jungle_wood", 17, 15, shNone, 0},
+	{"kelp", 9, 0, shNone, 0},
+	{"kelp_plant", 9, 0, shNone, 0},
+	{"ladder", 65, 0, shNone, 0},
+	{"lantern", 89, 0, shNone, 0},
+	{"lapis_block", 22, 0, shNone, 0},
+	{"lapis_ore", 21, 0, shNone, 0},
+	{"large_fern", 175, 3, shNone, 0},
+	{"lava", 11, 0, shNone, 0},
+	{"lever", 69, 0, shNone, 0},
+	{"light_blue_banner", 176, 0, shNone, 0},
+	{"light_blue_bed", 26, 0, shNone, 0},
+	{"light_blue_carpet", 171, 3, shNone, 0},
+	{"light_blue_concrete", 251, 3, shNone, 0},
+	{"light_blue_concrete_powder", 252, 3, shNone, 0},
+	{"light_blue_glazed_terracotta", 238, 0, shNone, 0},
+	{"light_blue_shulker_box", 222, 0, shNone, 0},
+	{"light_blue_stained_glass", 95, 3, shNone, 0},
+	{"light_blue_stained_glass_pane", 160, 3, shNone, 0},
+	{"light_blue_terracotta", 159, 3, shNone, 0},
+	{"light_blue_wall_banner", 177, 0, shNone, 0},
+	{"light_blue_wool", 35, 3, shNone, 0},
+	{"light_gray_banner", 176, 0, shNone, 0},
+	{"light_gray_bed", 26, 0, shNone, 0},
+	{"light_gray_carpet", 171, 8, shNone, 0},
+	{"light_gray_concrete", 251, 8, shNone, 0},
+	{"light_gray_concrete_powder", 252, 8, shNone, 0},
+	{"light_gray_glazed_terracotta", 243, 0, shNone, 0},
+	{"light_gray_shulker_box", 227, 0, shNone, 0},
+	{"light_gray_stained_glass", 95, 8, shNone, 0},
+	{"light_gray_stained_glass_pane", 160, 8, shNone, 0},
+	{"light_gray_terracotta", 159, 8, shNone, 0},
+	{"light_gray_wall_banner", 177, 0, shNone, 0},
+	{"light_gray_wool", 35, 8, shNone, 0},
+	{"light_weighted_pressure_plate", 147, 0, shNone, 0},
+	{"lilac", 175, 1, shNone, 0},
+	{"lily_of_the_valley", 38, 6, shNone, 0},
+	{"lily_pad", 111, 0, shNone, 0},
+	{"lime_banner", 176, 0, shNone, 0},
+	{"lime_bed", 26, 0, shNone, 0},
+	{"lime_carpet", 171, 5, shNone, 0},
+	{"lime_concrete", 251, 5, shNone, 0},
+	{"lime_concrete_powder", 252, 5, shNone, 0},
+	{"lime_glazed_terracotta", 240, 0, shNone, 0},
+	{"lime_shulker_box", 224, 0, shNone, 0},
+	{"lime_stained_glass", 95, 5, shNone, 0},
+	{"lime_stained_glass_pane", 160, 5, shNone, 0},
+	{"lime_terracotta", 159, 5, shNone, 0},
+	{"lime_wall_banner", 177, 0, shNone, 0},
+	{"lime_wool", 35, 5, shNone, 0},
+	{"magenta_banner", 176, 0, shNone, 0},
+	{"magenta_bed", 26, 0, shNone, 0},
+	{"magenta_carpet", 171, 2, shNone, 0},
+	{"magenta_concrete", 251, 2, shNone, 0},
+	{"magenta_concrete_powder", 252, 2, shNone, 0},
+	{"magenta_glazed_terracotta", 237, 0, shNone, 0},
+	{"magenta_shulker_box", 221, 0, shNone, 0},
+	{"magenta_stained_glass", 95, 2, shNone, 0},
+	{"magenta_stained_glass_pane", 160, 2, shNone, 0},
+	{"magenta_terracotta", 159, 2, shNone, 0},
+	{"magenta_wall_banner", 177, 0, shNone, 0},
+	{"magenta_wool", 35, 2, shNone, 0},
+	{"magma_block", 213, 0, shNone, 0},
+	{"melon", 103, 0, shNone, 0},
+	{"melon_stem", 105, 0, shNone, 0},
+	{"mossy_cobblestone", 48, 0, shNone, 0},
+	{"mossy_cobblestone_wall", 139, 1, shNone, 0},
+	{"mossy_stone_bricks", 98, 1, shNone, 0},
+	{"moving_piston", 36, 0, shNone, 0},
+	{"mushroom_stem", 99, 10, shNone, 0},
+	{"mycelium", 110, 0, shNone, 0},
+	{"nether_brick_fence", 113, 0, shNone, 0},
+	{"nether_brick_slab", 44, 6, shSlab, 43},
+	{"nether_brick_stairs", 114, 0, shNone, 0},
+	{"nether_bricks", 112, 0, shNone, 0},
+	{"nether_portal", 90, 0, shNone, 0},
+	{"nether_quartz_ore", 153, 0, shNone, 0},
+	{"nether_wart", 115, 0, shNone, 0},
+	{"nether_wart_block", 214, 0, shNone, 0},
+	{"netherrack", 87, 0, shNone, 0},
+	{"note_block", 25, 0, shNone, 0},
+	{"oak_button", 143, 0, shNone, 0},
+	{"oak_door", 64, 0, shNone, 0},
+	{"oak_fence", 85, 0, shNone, 0},
+	{"oak_fence_gate", 107, 0, shNone, 0},
+	{"oak_leaves", 18, 0, shNone, 0},
+	{"oak_log", 17, 0, shLog, 0},
+	{"oak_planks", 5, 0, shNone, 0},
+	{"oak_pressure_plate", 72, 0, shNone, 0},
+	{"oak_sapling", 6, 0, shNone, 0},
+	{"oak_sign", 63, 0, shNone, 0},
+	{"oak_slab", 126, 0, shSlab, 125},
+	{"oak_stairs", 53, 0, shNone, 0},
+	{"oak_trapdoor", 96, 0, shNone, 0},
+	{"oak_wall_sign", 68, 0, shNone, 0},
+	{"oak_wood", 17, 12, shNone, 0},
+	{"observer", 218, 0, shNone, 0},
+	{"obsidian", 49, 0, shNone, 0},
+	{"orange_banner", 176, 0, shNone, 0},
+	{"orange_bed", 26, 0, shNone, 0},
+	{"orange_carpet", 171, 1, shNone, 0},
+	{"orange_concrete", 251, 1, shNone, 0},
+	{"orange_concrete_powder", 252, 1, shNone, 0},
+	{"orange_glazed_terracotta", 236, 0, shNone, 0},
+	{"orange_shulker_box", 220, 0, shNone, 0},
+	{"orange_stained_glass", 95, 1, shNone, 0},
+	{"orange_stained_glass_pane", 160, 1, shNone, 0},
+	{"orange_terracotta", 159, 1, shNone, 0},
+	{"orange_tulip", 38, 5, shNone, 0},
+	{"orange_wall_banner", 177, 0, shNone, 0},
+	{"orange_wool", 35, 1, shNone, 0},
+	{"oxeye_daisy", 38, 8, shNone, 0},
+	{"packed_ice", 174, 0, shNone, 0},
+	{"peony", 175, 5, shNone, 0},
+	{"petrified_oak_slab", 44, 2, shSlab, 43},
+	{"pink_banner", 176, 0, shNone, 0},
+	{"pink_bed", 26, 0, shNone, 0},
+	{"pink_carpet", 171, 6, shNone, 0},
+	{"pink_concrete", 251, 6, shNone, 0},
+	{"pink_concrete_powder", 252, 6, shNone, 0},
+	{"pink_glazed_terracotta", 241, 0, shNone, 0},
+	{"pink_shulker_box", 225, 0, shNone, 0},
+	{"pink_stained_glass", 95, 6, shNone, 0},
+	{"pink_stained_glass_pane", 160, 6, shNone, 0},
+	{"pink_terracotta", 159, 6, shNone, 0},
+	{"pink_tulip", 38, 7, shNone, 0},
+	{"pink_wall_banner", 177, 0, shNone, 0},
+	{"pink_wool", 35, 6, shNone, 0},
+	{"piston", 33, 0, shNone, 0},
+	{"piston_head", 34, 0, shNone, 0},
+	{"player_head", 144, 0, shNone, 0},
+	{"player_wall_head", 144, 0, shNone, 0},
+	{"podzol", 3, 2, shNone, 0},
+	{"polished_andesite", 1, 6, shNone, 0},
+	{"polished_basalt", 1, 6, shNone, 0},
+	{"polished_diorite", 1, 4, shNone, 0},
+	{"polished_granite", 1, 2, shNone, 0},
+	{"poppy", 38, 0, shNone, 0},
+	{"potatoes", 142, 0, shNone, 0},
+	{"powered_rail", 27, 0, shNone, 0},
+	{"prismarine", 168, 0, shNone, 0},
+	{"prismarine_bricks", 168, 1, shNone, 0},
+	{"pumpkin", 86, 0, shNone, 0},
+	{"pumpkin_stem", 104, 0, shNone, 0},
+	{"purple_banner", 176, 0, shNone, 0},
+	{"purple_bed", 26, 0, shNone, 0},
+	{"purple_carpet", 171, 10, shNone, 0},
+	{"purple_concrete", 251, 10, shNone, 0},
+	{"purple_concrete_powder", 252, 10, shNone, 0},
+	{"purple_glazed_terracotta", 245, 0, shNone, 0},
+	{"purple_shulker_box", 229, 0, shNone, 0},
+	{"purple_stained_glass", 95, 10, shNone, 0},
+	{"purple_stained_glass_pane", 160, 10, shNone, 0},
+	{"purple_terracotta", 159, 10, shNone, 0},
+	{"purple_wall_banner", 177, 0, shNone, 0},
+	{"purple_wool", 35, 10, shNone, 0},
+	{"purpur_block", 201, 0, shNone, 0},
+	{"purpur_pillar", 202, 0, shNone, 0},
+	{"purpur_slab", 205, 0, shSlab, 204},
+	{"purpur_stairs", 203, 0, shNone, 0},
+	{"quartz_block", 155, 0, shNone, 0},
+	{"quartz_pillar", 155, 2, shNone, 0},
+	{"quartz_slab", 44, 7, shSlab, 43},
+	{"quartz_stairs", 156, 0, shNone, 0},
+	{"rail", 66, 0, shNone, 0},
+	{"red_banner", 176, 0, shNone, 0},
+	{"red_bed", 26, 0, shNone, 0},
+	{"red_carpet", 171, 14, shNone, 0},
+	{"red_concrete", 251, 14, shNone, 0},
+	{"red_concrete_powder", 252, 14, shNone, 0},
+	{"red_glazed_terracotta", 249, 0, shNone, 0},
+	{"red_mushroom", 40, 0, shNone, 0},
+	{"red_mushroom_block", 100, 14, shNone, 0},
+	{"red_nether_bricks", 215, 0, shNone, 0},
+	{"red_sand", 12, 1, shNone, 0},
+	{"red_sandstone", 179, 0, shNone, 0},
+	{"red_sandstone_slab", 182, 0, shSlab, 181},
+	{"red_sandstone_stairs", 180, 0, shNone, 0},
+	{"red_shulker_box", 233, 0, shNone, 0},
+	{"red_stained_glass", 95, 14, shNone, 0},
+	{"red_stained_glass_pane", 160, 14, shNone, 0},
+	{"red_terracotta", 159, 14, shNone, 0},
+	{"red_tulip", 38, 4, shNone, 0},
+	{"red_wall_banner", 177, 0, shNone, 0},
+	{"red_wool", 35, 14, shNone, 0},
+	{"redstone_block", 152, 0, shNone, 0},
+	{"redstone_lamp", 123, 0, shLit, 124},
+	{"redstone_ore", 73, 0, shLit, 74},
+	{"redstone_torch", 76, 0, shNone, 0},
+	{"redstone_wall_torch", 76, 0, shNone, 0},
+	{"redstone_wire", 55, 0, shNone, 0},
+	{"repeater", 93, 0, shNone, 0},
+	{"repeating_command_block", 210, 0, shNone, 0},
+	{"rose_bush", 175, 4, shNone, 0},
+	{"sand", 12, 0, shNone, 0},
+	{"sandstone", 24, 0, shNone, 0},
+	{"sandstone_slab", 44, 1, shSlab, 43},
+	{"sandstone_stairs", 128, 0, shNone, 0},
+	{"sea_lantern", 169, 0, shNone, 0},
+	{"sea_pickle", 169, 0, shNone, 0},
+	{"seagrass", 9, 0, shNone, 0},
+	{"short_grass", 31, 1, shNone, 0},
+	{"shulker_box", 229, 0, shNone, 0},
+	{"sign", 63, 0, shNone, 0},
+	{"skeleton_skull", 144, 0, shNone, 0},
+	{"skeleton_wall_skull", 144, 0, shNone, 0},
+	{"slime_block", 165, 0, shNone, 0},
+	{"smooth_quartz", 155, 0, shNone, 0},
+	{"smooth_red_sandstone", 179, 2, shNone, 0},
+	{"smooth_sandstone", 24, 2, shNone, 0},
+	{"smooth_stone", 43, 8, shNone, 0},
+	{"smooth_stone_slab", 44, 0, shSlab, 43},
+	{"snow", 78, 0, shNone, 0},
+	{"snow_block", 80, 0, shNone, 0},
+	{"soul_sand", 88, 0, shNone, 0},
+	{"spawner", 52, 0, shNone, 0},
+	{"sponge", 19, 0, shNone, 0},
+	{"spruce_button", 143, 0, shNone, 0},
+	{"spruce_door", 193, 0, shNone, 0},
+	{"spruce_fence", 188, 0, shNone, 0},
+	{"spruce_fence_gate", 183, 0, shNone, 0},
+	{"spruce_leaves", 18, 1, shNone, 0},
+	{"spruce_log", 17, 1, shLog, 0},
+	{"spruce_planks", 5, 1, shNone, 0},
+	{"spruce_pressure_plate", 72, 0, shNone, 0},
+	{"spruce_sapling", 6, 1, shNone, 0},
+	{"spruce_sign", 63, 0, shNone, 0},
+	{"spruce_slab", 126, 1, shSlab, 125},
+	{"spruce_stairs", 134, 0, shNone, 0},
+	{"spruce_trapdoor", 96, 0, shNone, 0},
+	{"spruce_wall_sign", 68, 0, shNone, 0},
+	{"spruce_wood", 17, 13, shNone, 0},
+	{"sticky_piston", 29, 0, shNone, 0},
+	{"stone", 1, 0, shNone, 0},
+	{"stone_brick_slab", 44, 5, shSlab, 43},
+	{"stone_brick_stairs", 109, 0, shNone, 0},
+	{"stone_bricks", 98, 0, shNone, 0},
+	{"stone_button", 77, 0, shNone, 0},
+	{"stone_pressure_plate", 70, 0, shNone, 0},
+	{"stone_slab", 44, 0, shSlab, 43},
+	{"stripped_acacia_log", 162, 0, shLog, 0},
+	{"stripped_acacia_wood", 162, 12, shNone, 0},
+	{"stripped_birch_log", 17, 2, shLog, 0},
+	{"stripped_birch_wood", 17, 14, shNone, 0},
+	{"stripped_dark_oak_log", 162, 1, shLog, 0},
+	{"stripped_dark_oak_wood", 162, 13, shNone, 0},
+	{"stripped_jungle_log", 17, 3, shLog, 0},
+	{"stripped_jungle_wood", 17, 15, shNone, 0},
+	{"stripped_oak_log", 17, 0, shLog, 0},
+	{"stripped_oak_wood", 17, 12, shNone, 0},
+	{"stripped_spruce_log", 17, 1, shLog, 0},
+	{"stripped_spruce_wood", 17, 13, shNone, 0},
+	{"structure_block", 255, 0, shNone, 0},
+	{"structure_void", 217, 0, shNone, 0},
+	{"sugar_cane", 83, 0, shNone, 0},
+	{"sunflower", 175, 0, shNone, 0},
+	{"sweet_berry_bush", 18, 0, shNone, 0},
+	{"tall_grass", 175, 2, shNone, 0},
+	{"tall_seagrass", 9, 0, shNone, 0},
+	{"terracotta", 172, 0, shNone, 0},
+	{"tnt", 46, 0, shNone, 0},
+	{"torch", 50, 0, shNone, 0},
+	{"trapped_chest", 146, 0, shNone, 0},
+	{"tripwire", 132, 0, shNone, 0},
+	{"tripwire_hook", 131, 0, shNone, 0},
+	{"tube_coral", 35, 11, shNone, 0},
+	{"tube_coral_block", 35, 11, shNone, 0},
+	{"tube_coral_fan", 35, 11, shNone, 0},
+	{"tube_coral_wall_fan", 35, 11, shNone, 0},
+	{"tuff", 1, 5, shNone, 0},
+	{"turtle_egg", 122, 0, shNone, 0},
+	{"vine", 106, 0, shNone, 0},
+	{"void_air", 0, 0, shNone, 0},
+	{"wall_sign", 68, 0, shNone, 0},
+	{"wall_torch", 50, 0, shNone, 0},
+	{"water", 9, 0, shNone, 0},
+	{"water_cauldron", 118, 0, shNone, 0},
+	{"wet_sponge", 19, 1, shNone, 0},
+	{"wheat", 59, 0, shNone, 0},
+	{"white_banner", 176, 0, shNone, 0},
+	{"white_bed", 26, 0, shNone, 0},
+	{"white_carpet", 171, 0, shNone, 0},
+	{"white_concrete", 251, 0, shNone, 0},
+	{"white_concrete_powder", 252, 0, shNone, 0},
+	{"white_glazed_terracotta", 235, 0, shNone, 0},
+	{"white_shulker_box", 219, 0, shNone, 0},
+	{"white_stained_glass", 95, 0, shNone, 0},
+	{"white_stained_glass_pane", 160, 0, shNone, 0},
+	{"white_terracotta", 159, 0, shNone, 0},
+	{"white_tulip", 38, 6, shNone, 0},
+	{"white_wall_banner", 177, 0, shNone, 0},
+	{"white_wool", 35, 0, shNone, 0},
+	{"wither_rose", 38, 0, shNone, 0},
+	{"wither_skeleton_skull", 144, 0, shNone, 0},
+	{"wither_skeleton_wall_skull", 144, 0, shNone, 0},
+	{"yellow_banner", 176, 0, shNone, 0},
+	{"yellow_bed", 26, 0, shNone, 0},
+	{"yellow_carpet", 171, 4, shNone, 0},
+	{"yellow_concrete", 251, 4, shNone, 0},
+	{"yellow_concrete_powder", 252, 4, shNone, 0},
+	{"yellow_glazed_terracotta", 239, 0, shNone, 0},
+	{"yellow_shulker_box", 223, 0, shNone, 0},
+	{"yellow_stained_glass", 95, 4, shNone, 0},
+	{"yellow_stained_glass_pane", 160, 4, shNone, 0},
+	{"yellow_terracotta", 159, 4, shNone, 0},
+	{"yellow_wall_banner", 177, 0, shNone, 0},
+	{"yellow_wool", 35, 4, shNone, 0},
+	{"zombie_head", 144, 0, shNone, 0},
+	{"zombie_wall_head", 144, 0, shNone, 0},
+};
+
+
+
+
+
+/** The block families used for blocks not found in g_BlockStateMappings, matched by the name suffix.
+Longer suffixes come before their shorter endings ("_fence_gate" before "_fence"). */
+static const cBlockStateMapping g_FamilyMappings[] =
+{
+	{"_fence_gate",     107,  0, shNone, 0},
+	{"_glass_pane",     102,  0, shNone, 0},
+	{"_pressure_plate",  70,  0, shNone, 0},
+	{"_wall_sign",       68,  0, shNone, 0},
+	{"_wall_banner",    177,  0, shNone, 0},
+	{"_trapdoor",        96,  0, shNone, 0},
+	{"_stairs",          67,  0, shNone, 0},
+	{"_slab",            44,  0, shSlab, 43},
+	{"_planks",           5,  0, shNone, 0},
+	{"_log",             17,  0, shLog,  0},
+	{"_stem",            17,  0, shLog,  0},
+	{"_wood",            17, 12, shNone, 0},
+	{"_hyphae",          17, 12, shNone, 0},
+	{"_leaves",          18,  0, shNone, 0},
+	{"_sapling",          6,  0, shNone, 0},
+	{"_fence",           85,  0, shNone, 0},
+	{"_wall",           139,  0, shNone, 0},
+	{"_door",            64,  0, shNone, 0},
+	{"_button",          77,  0, shNone, 0},
+	{"_sign",            63,  0, shNone, 0},
+	{"_banner",         176,  0, shNone, 0},
+	{"_glass",           20,  0, shNone, 0},
+	{"_carpet",         171,  0, shNone, 0},
+	{"_wool",            35,  0, shNone, 0},
+	{"_bricks",          98,  0, shNone, 0},
+	{"_tiles",           98,  0, shNone, 0},
+	{"_ore",             15,  0, shNone, 0},
+	{"_torch",           50,  0, shNone, 0},
+	{"_candle",          50,  0, shNone, 0},
+};
+
+/** The legacy block used for blocks that match neither a name nor a family. */
+static const cBlockStateMapping g_UnknownMapping = {"", 1, 0, shNone, 0};
+
+
+
+
+
+/** Returns true if a_Properties (in the "name1=value1,name2=value2" syntax) contains the specified "name=value" pair. */
+static bool HasProperty(const AString & a_Properties, const char * a_NameValue)
+{
+	size_t Len = strlen(a_NameValue);
+	size_t Pos = 0;
+	while ((Pos = a_Properties.find(a_NameValue, Pos)) != AString::npos)
+	{
+		bool IsStart = (Pos == 0) || (a_Properties[Pos - 1] == ',');
+		bool IsEnd = (Pos + Len == a_Properties.size()) || (a_Properties[Pos + Len] == ',');
+		if (IsStart && IsEnd)
+		{
+			return true;
+		}
+		Pos += Len;
+	}
+	return false;
+}
+
+
+
+
+
+/** Returns the mapping for the specified block name (without the namespace). */
+static const cBlockStateMapping & FindMapping(const char * a_Name, size_t a_NameLength)
+{
+	AString Name(a_Name, a_NameLength);
+	auto End = g_BlockStateMappings + ARRAYCOUNT(g_BlockStateMappings);
+	auto itr = std::lower_bound(g_BlockStateMappings, End, Name,
+		[](const cBlockStateMapping & a_Mapping, const AString & a_Name)
+		{
+			return (a_Name.compare(a_Mapping.m_Name) > 0);
+		}
+	);
+	if ((itr != End) && (Name.compare(itr->m_Name) == 0))
+	{
+		return *itr;
+	}
+
+	// Potted plants are all flower pots:
+	if (Name.compare(0, 7, "potted_") == 0)
+	{
+		return FindMapping("flower_pot", 10);
+	}
+
+	// Not a known block, try the block families:
+	for (const auto & Family: g_FamilyMappings)
+	{
+		size_t SuffixLength = strlen(Family.m_Name);
+		if ((a_NameLength > SuffixLength) && (Name.compare(a_NameLength - SuffixLength, SuffixLength, Family.m_Name) == 0))
+		{
+			return Family;
+		}
+	}
+	return g_UnknownMapping;
+}
+
+
+
+
+
+cLegacyBlock BlockStateToLegacy(const AString & a_BlockName, const AString & a_Properties)
+{
+	// Strip the namespace:
+	size_t NameStart = a_BlockName.find(':');
+	NameStart = (NameStart == AString::npos) ? 0 : NameStart + 1;
+	const auto & Mapping = FindMapping(a_BlockName.c_str() + NameStart, a_BlockName.size() - NameStart);
+
+	cLegacyBlock res = {Mapping.m_BlockType, Mapping.m_BlockMeta};
+	if (a_Properties.empty())
+	{
+		return res;
+	}
+	switch (Mapping.m_Handling)
+	{
+		case shNone:
+		{
+			break;
+		}
+		case shSlab:
+		{
+			if (HasProperty(a_Properties, "type=double"))
+			{
+				res.m_BlockType = Mapping.m_AltType;
+			}
+			else if (HasProperty(a_Properties, "type=top"))
+			{
+				res.m_BlockMeta |= 0x08;
+			}
+			break;
+		}
+		case shLog:
+		{
+			if (HasProperty(a_Properties, "axis=x"))
+			{
+				res.m_BlockMeta |= 0x04;
+			}
+			else if (HasProperty(a_Properties, "axis=z"))
+			{
+				res.m_BlockMeta |= 0x08;
+			}
+			break;
+		}
+		case shLit:
+		{
+			if (HasProperty(a_Properties, "lit=true"))
+			{
+				res.m_BlockType = Mapping.m_AltType;
+			}
+			break;
+		}
+	}
+	return res;
+}
+
+
+
+
+
+cLegacyBlock BlockStateStringToLegacy(const AString & a_BlockState)
+{
+	auto PropsStart = a_BlockState.find('[');
+	if (PropsStart == AString::npos)
+	{
+		return BlockStateToLegacy(a_BlockState, AString());
+	}
+	auto PropsEnd = a_BlockState.find(']', PropsStart);
+	if (PropsEnd == AString::npos)
+	{
+		PropsEnd = a_BlockState.size();
+	}
+	return BlockStateToLegacy(a_BlockState.substr(0, PropsStart), a_BlockState.substr(PropsStart + 1, PropsEnd - PropsStart - 1));
+}
+
+
+
+
@@ -0,0 +1,40 @@
+
+// BlockStates.h
+
+// Declares the functions mapping the modern (1.13+) block states onto the legacy block types and metas used by the renderer
+
+
+
+
+
+#pragma once
+
+
+
+
+
+/** A legacy (pre-1.13) block, as stored in MCEdit .schematic files and as understood by the renderer. */
+struct cLegacyBlock
+{
+	Byte m_BlockType;
+	Byte m_BlockMeta;
+};
+
+
+
+
+
+/** Returns the legacy block corresponding to the specified modern block state.
+a_BlockName is the block's name, optionally namespaced ("minecraft:oak_slab" or "oak_slab").
+a_Properties is the list of the state's properties in the blockstate syntax ("type=double,waterlogged=false"), may be empty.
+Blocks without a legacy counterpart are approximated by their family (stairs, slabs, planks, ...), or by stone if unknown,
+so that the shape of the build is still visible. */
+extern cLegacyBlock BlockStateToLegacy(const AString & a_BlockName, const AString & a_Properties);
+
+/** Returns the legacy block corresponding to the specified modern block state in the full blockstate syntax,
+such as "minecraft:oak_log[axis=y]", as used by the Sponge schematic palettes. */
+extern cLegacyBlock BlockStateStringToLegacy(const AString & a_BlockState);
+
+
+
+
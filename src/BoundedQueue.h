@@ -0,0 +1,128 @@
+
+// BoundedQueue.h
+
+// Declares the cBoundedQueue class template implementing a thread-safe FIFO queue with a limited capacity
+
+/*
+The queue connects the stages of a pipeline. A producer pushing into a full queue is blocked until a consumer
+makes room for the item (backpressure), so a fast stage cannot pile up unlimited work in front of a slow one.
+Once the producers are done, the queue is closed; the consumers drain the remaining items and then see the end.
+*/
+
+
+
+
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+
+
+
+
+
+template <typename T>
+class cBoundedQueue
+{
+public:
+	cBoundedQueue(size_t a_MaxSize):
+		m_MaxSize(std::max<size_t>(a_MaxSize, 1)),
+		m_IsClosed(false)
+	{
+	}
+
+	/** Sets the maximum number of items in the queue. Should be called before the queue is used by the threads. */
+	void SetMaxSize(size_t a_MaxSize)
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_MaxSize = std::max<size_t>(a_MaxSize, 1);
+		m_CondNotFull.notify_all();
+	}
+
+	/** Adds the item at the end of the queue; if the queue is full, blocks until there's room for it.
+	Returns false (and drops the item) if the queue has been closed. */
+	bool Push(T && a_Item)
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_CondNotFull.wait(Lock, [this]() { return (m_IsClosed || (m_Items.size() < m_MaxSize)); });
+		if (m_IsClosed)
+		{
+			return false;
+		}
+		m_Items.push_back(std::move(a_Item));
+		m_CondNotEmpty.notify_one();
+		return true;
+	}
+
+	/** Removes the item at the front of the queue into a_Item; if the queue is empty, blocks until an item arrives.
+	Returns false once the queue has been closed and all its items have been removed. */
+	bool Pop(T & a_Item)
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_CondNotEmpty.wait(Lock, [this]() { return (m_IsClosed || !m_Items.empty()); });
+		if (m_Items.empty())
+		{
+			return false;
+		}
+		a_Item = std::move(m_Items.front());
+		m_Items.pop_front();
+		m_CondNotFull.notify_one();
+		return true;
+	}
+
+	/** Removes the items matching the predicate from among the first a_MaxScan items in the queue, up to a_MaxTaken of them,
+	and appends them to a_Taken, in the queue order. Doesn't block. Returns the number of items taken. */
+	template <typename Pred>
+	size_t TakeIf(Pred a_Pred, size_t a_MaxScan, size_t a_MaxTaken, std::vector<T> & a_Taken)
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		size_t NumTaken = 0;
+		size_t NumScanned = 0;
+		for (auto itr = m_Items.begin(); (itr != m_Items.end()) && (NumScanned < a_MaxScan) && (NumTaken < a_MaxTaken); NumScanned++)
+		{
+			if (a_Pred(*itr))
+			{
+				a_Taken.push_back(std::move(*itr));
+				itr = m_Items.erase(itr);
+				NumTaken++;
+			}
+			else
+			{
+				++itr;
+			}
+		}
+		if (NumTaken > 0)
+		{
+			m_CondNotFull.notify_all();
+		}
+		return NumTaken;
+	}
+
+	/** Closes the queue: further pushes fail, and the consumers are released once the remaining items are popped. */
+	void Close(void)
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_IsClosed = true;
+		m_CondNotEmpty.notify_all();
+		m_CondNotFull.notify_all();
+	}
+
+protected:
+	/** Protects all the member variables against multithreaded access. */
+	std::mutex m_Mutex;
+
+	/** Signalled when an item is added, or the queue is closed. */
+	std::condition_variable m_CondNotEmpty;
+
+	/** Signalled when an item is removed, or the queue is closed. */
+	std::condition_variable m_CondNotFull;
+
+	std::deque<T> m_Items;
+	size_t m_MaxSize;
+	bool m_IsClosed;
+};
+
+
+
+
@@ -0,0 +1,155 @@
+
+// BuildManifest.cpp
+
+// Implements the cBuildManifest class that remembers how each output image was built, for incremental batch builds
+
+#include "Globals.h"
+#include "BuildManifest.h"
+
+
+
+
+
+cBuildManifest::cBuildManifest(void):
+	m_IsModified(false)
+{
+}
+
+
+
+
+
+bool cBuildManifest::Load(const AString & a_FileName)
+{
+	cCSLock Lock(m_CS);
+	m_FileName = a_FileName;
+	m_Entries.clear();
+	m_IsModified = false;
+	if (!cFile::Exists(a_FileName))
+	{
+		return true;
+	}
+	cFile f;
+	AString Contents;
+	if (!f.Open(a_FileName, cFile::fmRead) || (f.ReadRestOfFile(Contents) < 0))
+	{
+		return false;
+	}
+
+	// Parse the "<key>\t<output file name>" lines; the output file name is last, so that it may contain anything but a newline:
+	size_t LineStart = 0;
+	while (LineStart < Contents.size())
+	{
+		size_t LineEnd = Contents.find('\n', LineStart);
+		if (LineEnd == AString::npos)
+		{
+			LineEnd = Contents.size();
+		}
+		size_t Tab = Contents.find('\t', LineStart);
+		if ((Tab != AString::npos) && (Tab < LineEnd))
+		{
+			m_Entries[Contents.substr(Tab + 1, LineEnd - Tab - 1)] = Contents.substr(LineStart, Tab - LineStart);
+		}
+		LineStart = LineEnd + 1;
+	}
+	return true;
+}
+
+
+
+
+
+bool cBuildManifest::Save(void)
+{
+	cCSLock SaveLock(m_CSSave);
+	AString Contents;
+	{
+		cCSLock Lock(m_CS);
+		if (m_FileName.empty() || !m_IsModified)
+		{
+			return true;
+		}
+		for (const auto & Entry: m_Entries)
+		{
+			Contents.append(Entry.second);
+			Contents.push_back('\t');
+			Contents.append(Entry.first);
+			Contents.push_back('\n');
+		}
+		m_IsModified = false;
+	}
+
+	// Write into a temporary file and rename, so that an interrupted save keeps the previous manifest:
+	AString TempFileName = m_FileName + ".tmp";
+	{
+		cFile f(TempFileName, cFile::fmWrite);
+		if (!f.IsOpen() || (f.Write(Contents.data(), Contents.size()) != static_cast<int>(Contents.size())))
+		{
+			LOGWARNING("Cannot write manifest file \"%s\".", TempFileName.c_str());
+			f.Close();
+			cFile::Delete(TempFileName);
+			SetModified();
+			return false;
+		}
+	}
+
+	// Rename() replaces the file atomically on POSIX; elsewhere it fails if the file exists, delete it and retry then:
+	if (!cFile::Rename(TempFileName, m_FileName))
+	{
+		cFile::Delete(m_FileName);
+		if (!cFile::Rename(TempFileName, m_FileName))
+		{
+			LOGWARNING("Cannot rename manifest file \"%s\" to \"%s\".", TempFileName.c_str(), m_FileName.c_str());
+			cFile::Delete(TempFileName);
+			SetModified();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+void cBuildManifest::SetModified(void)
+{
+	cCSLock Lock(m_CS);
+	m_IsModified = true;
+}
+
+
+
+
+
+bool cBuildManifest::IsUpToDate(const AString & a_OutputFileName, const AString & a_Key)
+{
+	{
+		cCSLock Lock(m_CS);
+		auto itr = m_Entries.find(a_OutputFileName);
+		if ((itr == m_Entries.end()) || (itr->second != a_Key))
+		{
+			return false;
+		}
+	}
+	return cFile::IsFile(a_OutputFileName);
+}
+
+
+
+
+
+void cBuildManifest::Set(const AString & a_OutputFileName, const AString & a_Key)
+{
+	cCSLock Lock(m_CS);
+	auto & Key = m_Entries[a_OutputFileName];
+	if (Key != a_Key)
+	{
+		Key = a_Key;
+		m_IsModified = true;
+	}
+}
+
+
+
+
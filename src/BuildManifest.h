@@ -0,0 +1,72 @@
+
+// BuildManifest.h
+
+// Declares the cBuildManifest class that remembers how each output image was built, for incremental batch builds
+
+/*
+The manifest maps each output file name to the key of the build that produced it. The key identifies everything
+that affects the image: the renderer version, the block colors, the input file's contents and the render params;
+building the key is the caller's responsibility.
+An item whose key is the same as in the manifest, and whose output file still exists, doesn't need to be rendered again.
+The manifest is stored as a text file, one "<key>\t<output file name>" line per output. Entries for outputs
+not built in the current run are kept, so that several listfiles may share a single manifest.
+*/
+
+
+
+
+
+#pragma once
+
+
+
+
+
+class cBuildManifest
+{
+public:
+	cBuildManifest(void);
+
+	/** Loads the manifest from the specified file. A nonexistent file is an empty manifest.
+	Returns false if the file exists but cannot be read. */
+	bool Load(const AString & a_FileName);
+
+	/** Saves the manifest into the file it was loaded from, if it has been modified since.
+	Writes into a temporary file first and then renames it over the original, so that an interrupted save doesn't
+	lose the previous manifest. A failed save is retried by the next call. May be called from multiple threads, the saves are
+	serialized. Returns false on failure. */
+	bool Save(void);
+
+	/** Returns true if the manifest has been loaded (incremental builds are enabled). */
+	bool IsEnabled(void) const { return !m_FileName.empty(); }
+
+	/** Returns true if the output file was built with the specified key and still exists. */
+	bool IsUpToDate(const AString & a_OutputFileName, const AString & a_Key);
+
+	/** Records that the output file has been built with the specified key. */
+	void Set(const AString & a_OutputFileName, const AString & a_Key);
+
+protected:
+	/** Protects m_Entries and m_IsModified against multithreaded access. */
+	cCriticalSection m_CS;
+
+	/** Serializes the saves, so that an older snapshot of the entries is never written over a newer one. */
+	cCriticalSection m_CSSave;
+
+	/** The file from which the manifest was loaded and into which it is saved. Empty if not loaded. */
+	AString m_FileName;
+
+	/** Map of output file name -> key of its build. */
+	std::map<AString, AString> m_Entries;
+
+	/** Set when an entry changes, so that unchanged manifests are not rewritten. */
+	bool m_IsModified;
+
+
+	/** Marks the manifest as modified, so that a failed save is retried by the next Save(). */
+	void SetModified(void);
+};
+
+
+
+
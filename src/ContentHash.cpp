@@ -0,0 +1,138 @@
+
+// ContentHash.cpp
+
+// Implements the GetContentHash() function used for identifying data by its contents (caches, manifests)
+
+#include "Globals.h"
+#include "ContentHash.h"
+
+
+
+
+
+static const UInt64 PRIME1 = 0x9E3779B185EBCA87ULL;
+static const UInt64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static const UInt64 PRIME3 = 0x165667B19E3779F9ULL;
+static const UInt64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static const UInt64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+
+
+
+
+static inline UInt64 RotL(UInt64 a_Value, int a_NumBits)
+{
+	return (a_Value << a_NumBits) | (a_Value >> (64 - a_NumBits));
+}
+
+
+
+
+
+static inline UInt64 Read64(const Byte * a_Data)
+{
+	UInt64 res;
+	memcpy(&res, a_Data, sizeof(res));
+	return res;
+}
+
+
+
+
+
+static inline UInt32 Read32(const Byte * a_Data)
+{
+	UInt32 res;
+	memcpy(&res, a_Data, sizeof(res));
+	return res;
+}
+
+
+
+
+
+static inline UInt64 Round(UInt64 a_Acc, UInt64 a_Input)
+{
+	a_Acc += a_Input * PRIME2;
+	a_Acc = RotL(a_Acc, 31);
+	return a_Acc * PRIME1;
+}
+
+
+
+
+
+static inline UInt64 MergeRound(UInt64 a_Acc, UInt64 a_Value)
+{
+	a_Acc ^= Round(0, a_Value);
+	return a_Acc * PRIME1 + PRIME4;
+}
+
+
+
+
+
+UInt64 GetContentHash(const void * a_Data, size_t a_Length, UInt64 a_Seed)
+{
+	const Byte * Data = reinterpret_cast<const Byte *>(a_Data);
+	const Byte * End = Data + a_Length;
+	UInt64 res;
+
+	// Process the data in 32-byte stripes, using 4 independent accumulators:
+	if (a_Length >= 32)
+	{
+		UInt64 v1 = a_Seed + PRIME1 + PRIME2;
+		UInt64 v2 = a_Seed + PRIME2;
+		UInt64 v3 = a_Seed;
+		UInt64 v4 = a_Seed - PRIME1;
+		const Byte * Limit = End - 32;
+		do
+		{
+			v1 = Round(v1, Read64(Data));
+			v2 = Round(v2, Read64(Data + 8));
+			v3 = Round(v3, Read64(Data + 16));
+			v4 = Round(v4, Read64(Data + 24));
+			Data += 32;
+		} while (Data <= Limit);
+		res = RotL(v1, 1) + RotL(v2, 7) + RotL(v3, 12) + RotL(v4, 18);
+		res = MergeRound(res, v1);
+		res = MergeRound(res, v2);
+		res = MergeRound(res, v3);
+		res = MergeRound(res, v4);
+	}
+	else
+	{
+		res = a_Seed + PRIME5;
+	}
+	res += static_cast<UInt64>(a_Length);
+
+	// Process the remaining bytes:
+	for (; Data + 8 <= End; Data += 8)
+	{
+		res ^= Round(0, Read64(Data));
+		res = RotL(res, 27) * PRIME1 + PRIME4;
+	}
+	if (Data + 4 <= End)
+	{
+		res ^= static_cast<UInt64>(Read32(Data)) * PRIME1;
+		res = RotL(res, 23) * PRIME2 + PRIME3;
+		Data += 4;
+	}
+	for (; Data < End; Data++)
+	{
+		res ^= (*Data) * PRIME5;
+		res = RotL(res, 11) * PRIME1;
+	}
+
+	// Final avalanche:
+	res ^= res >> 33;
+	res *= PRIME2;
+	res ^= res >> 29;
+	res *= PRIME3;
+	res ^= res >> 32;
+	return res;
+}
+
+
+
+
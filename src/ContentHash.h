@@ -0,0 +1,29 @@
+
+// ContentHash.h
+
+// Declares the GetContentHash() function used for identifying data by its contents (caches, manifests)
+
+
+
+
+
+#pragma once
+
+
+
+
+
+/** Returns a 64-bit hash of the specified data (XXH64 algorithm).
+The hash is fast (several GiB/s) and well distributed, but not cryptographic.
+The value is the same across runs and platforms with the same endianness, so it may be persisted. */
+extern UInt64 GetContentHash(const void * a_Data, size_t a_Length, UInt64 a_Seed = 0);
+
+/** Returns a 64-bit hash of the specified string, see GetContentHash(). */
+inline UInt64 GetContentHash(const AString & a_Data, UInt64 a_Seed = 0)
+{
+	return GetContentHash(a_Data.data(), a_Data.size(), a_Seed);
+}
+
+
+
+
@@ -0,0 +1,170 @@
+
+// FolderScanner.cpp
+
+// Implements the cFolderScanner class that finds the files matching wildcard patterns in a folder tree, in parallel
+
+#include "Globals.h"
+#include "FolderScanner.h"
+#include <thread>
+
+
+
+
+
+cFolderScanner::cFolderScanner(const AString & a_RootFolder, const AStringVector & a_Patterns, bool a_Recursive, cCallback a_Callback):
+	m_RootFolder(a_RootFolder),
+	m_Patterns(a_Patterns),
+	m_Recursive(a_Recursive),
+	m_Callback(a_Callback),
+	m_NumBusy(0),
+	m_HasRootFailed(false)
+{
+	if (!m_RootFolder.empty() && (m_RootFolder.back() != '/') && (m_RootFolder.back() != cFile::PathSeparator))
+	{
+		m_RootFolder.push_back('/');
+	}
+}
+
+
+
+
+
+bool cFolderScanner::Scan(int a_NumThreads)
+{
+	m_PendingFolders.clear();
+	m_PendingFolders.push_back(AString());
+	m_NumBusy = 0;
+	m_HasRootFailed = false;
+	std::vector<std::thread> Threads;
+	for (int i = 1; i < a_NumThreads; i++)
+	{
+		Threads.emplace_back(&cFolderScanner::ScanThread, this);
+	}
+	ScanThread();
+	for (auto & Thread: Threads)
+	{
+		Thread.join();
+	}
+	return !m_HasRootFailed;
+}
+
+
+
+
+
+bool cFolderScanner::MatchesWildcard(const char * a_Pattern, const char * a_Name)
+{
+	// Greedy matching with backtracking to the last '*':
+	const char * StarPattern = nullptr;
+	const char * StarName = nullptr;
+	while (*a_Name != 0)
+	{
+		if (*a_Pattern == '*')
+		{
+			StarPattern = ++a_Pattern;
+			StarName = a_Name;
+		}
+		else if ((*a_Pattern == '?') || (tolower(static_cast<unsigned char>(*a_Pattern)) == tolower(static_cast<unsigned char>(*a_Name))))
+		{
+			a_Pattern++;
+			a_Name++;
+		}
+		else if (StarPattern != nullptr)
+		{
+			a_Pattern = StarPattern;
+			a_Name = ++StarName;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	while (*a_Pattern == '*')
+	{
+		a_Pattern++;
+	}
+	return (*a_Pattern == 0);
+}
+
+
+
+
+
+void cFolderScanner::ScanThread(void)
+{
+	for (;;)
+	{
+		AString RelFolder;
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			m_Cond.wait(Lock, [this]() { return (!m_PendingFolders.empty() || (m_NumBusy == 0)); });
+			if (m_PendingFolders.empty())
+			{
+				// Nothing pending and nobody can add anything, the scan is done:
+				return;
+			}
+			RelFolder = std::move(m_PendingFolders.back());
+			m_PendingFolders.pop_back();
+			m_NumBusy += 1;
+		}
+
+		ScanFolder(RelFolder);
+
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			m_NumBusy -= 1;
+		}
+		m_Cond.notify_all();
+	}
+}
+
+
+
+
+
+void cFolderScanner::ScanFolder(const AString & a_RelFolder)
+{
+	AStringVector Files, Folders;
+	if (!cFile::GetFolderContents(m_RootFolder + a_RelFolder, Files, Folders))
+	{
+		if (a_RelFolder.empty())
+		{
+			m_HasRootFailed = true;
+		}
+		else
+		{
+			LOGWARNING("Cannot list folder \"%s%s\"", m_RootFolder.c_str(), a_RelFolder.c_str());
+		}
+		return;
+	}
+
+	// Queue the subfolders first, so that the other threads can start on them while the files are being reported:
+	if (m_Recursive && !Folders.empty())
+	{
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			for (const auto & Folder: Folders)
+			{
+				m_PendingFolders.push_back(a_RelFolder + Folder + "/");
+			}
+		}
+		m_Cond.notify_all();
+	}
+
+	std::sort(Files.begin(), Files.end());
+	for (const auto & File: Files)
+	{
+		for (const auto & Pattern: m_Patterns)
+		{
+			if (MatchesWildcard(Pattern.c_str(), File.c_str()))
+			{
+				m_Callback(a_RelFolder, File);
+				break;
+			}
+		}
+	}
+}
+
+
+
+
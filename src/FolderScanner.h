@@ -0,0 +1,81 @@
+
+// FolderScanner.h
+
+// Declares the cFolderScanner class that finds the files matching wildcard patterns in a folder tree, in parallel
+
+/*
+The folders waiting to be listed are kept on a shared stack; each of the scanning threads takes a folder, lists it,
+pushes its subfolders onto the stack and reports the matching files right away, so that the files can be processed
+while the rest of the tree is still being scanned. Listing many folders at once hides the filesystem latency,
+which dominates on large trees and network filesystems.
+*/
+
+
+
+
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+
+
+
+
+class cFolderScanner
+{
+public:
+	/** Called for each matching file, from the scanning threads (possibly from several threads at once).
+	a_RelFolder is the file's folder relative to the scanned root, either empty or ending with a slash. */
+	typedef std::function<void(const AString & a_RelFolder, const AString & a_FileName)> cCallback;
+
+
+	/** Creates a scanner of the specified root folder. a_Patterns are the wildcard patterns ('*' and '?') of the file names
+	to report, matched case-insensitively; a file is reported if it matches any of them.
+	If a_Recursive is true, the subfolders are scanned as well. */
+	cFolderScanner(const AString & a_RootFolder, const AStringVector & a_Patterns, bool a_Recursive, cCallback a_Callback);
+
+	/** Scans the folder tree using the specified number of threads, calling the callback for each matching file.
+	Returns once the whole tree has been scanned. Returns false if the root folder cannot be listed. */
+	bool Scan(int a_NumThreads);
+
+	/** Returns true if a_Name matches the wildcard pattern ('*' matches any sequence of chars, '?' any single char).
+	The comparison is case-insensitive. */
+	static bool MatchesWildcard(const char * a_Pattern, const char * a_Name);
+
+protected:
+	/** The folder whose tree is scanned, ending with a slash (unless empty). */
+	AString m_RootFolder;
+
+	AStringVector m_Patterns;
+	bool m_Recursive;
+	cCallback m_Callback;
+
+	/** Protects m_PendingFolders and m_NumBusy. */
+	std::mutex m_Mutex;
+
+	/** Signalled when a folder is added to m_PendingFolders, or the last busy thread finishes. */
+	std::condition_variable m_Cond;
+
+	/** The folders waiting to be listed, relative to m_RootFolder, each either empty or ending with a slash. */
+	AStringVector m_PendingFolders;
+
+	/** The number of threads currently listing a folder. The scan is done when this is zero and there are no pending folders. */
+	int m_NumBusy;
+
+	/** Set if the root folder cannot be listed. */
+	bool m_HasRootFailed;
+
+
+	/** The body of a single scanning thread. */
+	void ScanThread(void);
+
+	/** Lists a single folder, reporting its matching files and adding its subfolders to m_PendingFolders (if recursive). */
+	void ScanFolder(const AString & a_RelFolder);
+};
+
+
+
+
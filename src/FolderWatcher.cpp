@@ -0,0 +1,282 @@
+
+// FolderWatcher.cpp
+
+// Implements the cFolderWatcher class that reports the files created or modified in a folder tree, as they are saved
+
+#include "Globals.h"
+#include "FolderWatcher.h"
+
+#ifdef __linux__
+	#include <poll.h>
+	#include <sys/inotify.h>
+#endif
+
+
+
+
+
+/** The time for which a saved file must not change before it is reported. */
+static const int WATCH_DEBOUNCE_MSEC = 500;
+
+/** The longest time the watching thread waits for the events, before checking whether it should terminate. */
+static const int WATCH_POLL_MSEC = 100;
+
+
+
+
+
+cFolderWatcher::cFolderWatcher(const AString & a_RootFolder, const AStringVector & a_Patterns, bool a_Recursive, cCallback a_Callback):
+	m_RootFolder(a_RootFolder),
+	m_Patterns(a_Patterns),
+	m_Recursive(a_Recursive),
+	m_Callback(a_Callback),
+	m_ShouldTerminate(false),
+	m_INotifyFD(-1)
+{
+	if (!m_RootFolder.empty() && (m_RootFolder.back() != '/') && (m_RootFolder.back() != cFile::PathSeparator))
+	{
+		m_RootFolder.push_back('/');
+	}
+}
+
+
+
+
+
+cFolderWatcher::~cFolderWatcher()
+{
+	Stop();
+}
+
+
+
+
+
+bool cFolderWatcher::Start(AString & a_ErrorMsg)
+{
+	#ifdef __linux__
+		m_INotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_INotifyFD < 0)
+		{
+			a_ErrorMsg = Printf("Cannot initialize inotify (%d)", errno);
+			return false;
+		}
+		if (!AddWatch(AString(), false))
+		{
+			a_ErrorMsg = Printf("Cannot watch folder \"%s\" (%d)", m_RootFolder.c_str(), errno);
+			close(m_INotifyFD);
+			m_INotifyFD = -1;
+			return false;
+		}
+		m_ShouldTerminate = false;
+		m_Thread = std::thread(&cFolderWatcher::WatchThread, this);
+		return true;
+	#else
+		a_ErrorMsg = "Watching folders is only supported on Linux";
+		return false;
+	#endif
+}
+
+
+
+
+
+void cFolderWatcher::Stop(void)
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+	m_ShouldTerminate = true;
+	m_Thread.join();
+	#ifdef __linux__
+		close(m_INotifyFD);
+	#endif
+	m_INotifyFD = -1;
+	m_WatchedFolders.clear();
+	m_PendingFiles.clear();
+}
+
+
+
+
+
+void cFolderWatcher::WatchThread(void)
+{
+	#ifdef __linux__
+		// The buffer must be aligned for the inotify_event structs:
+		alignas(struct inotify_event) char Buffer[64 * 1024];
+		while (!m_ShouldTerminate)
+		{
+			// Wait for the events, but wake up in time to report the pending files:
+			int Timeout = WATCH_POLL_MSEC;
+			if (!m_PendingFiles.empty())
+			{
+				Timeout = std::min(Timeout, WATCH_DEBOUNCE_MSEC / 4);
+			}
+			pollfd pfd;
+			pfd.fd = m_INotifyFD;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if (poll(&pfd, 1, Timeout) > 0)
+			{
+				ssize_t NumBytes;
+				while ((NumBytes = read(m_INotifyFD, Buffer, sizeof(Buffer))) > 0)
+				{
+					auto Now = cClock::now();
+					for (ssize_t Pos = 0; Pos < NumBytes;)
+					{
+						const auto * Event = reinterpret_cast<const struct inotify_event *>(Buffer + Pos);
+						Pos += static_cast<ssize_t>(sizeof(struct inotify_event) + Event->len);
+						if ((Event->mask & IN_Q_OVERFLOW) != 0)
+						{
+							// Events have been lost while the callback was blocked (the queue is full), rescan the whole tree
+							// for the files that may have been saved meanwhile:
+							LOGWARNING("Too many changes in folder \"%s\", rescanning all its files.", m_RootFolder.c_str());
+							AddWatch(AString(), true);
+							continue;
+						}
+						auto itr = m_WatchedFolders.find(Event->wd);
+						if (itr == m_WatchedFolders.end())
+						{
+							continue;
+						}
+						if ((Event->mask & IN_IGNORED) != 0)
+						{
+							// The folder has been deleted or moved away
+							m_WatchedFolders.erase(itr);
+							continue;
+						}
+						if (Event->len == 0)
+						{
+							continue;
+						}
+						AString RelPath = itr->second + Event->name;
+						if ((Event->mask & IN_ISDIR) != 0)
+						{
+							if (m_Recursive && ((Event->mask & (IN_CREATE | IN_MOVED_TO)) != 0))
+							{
+								AddWatch(RelPath + "/", true);
+							}
+							continue;
+						}
+						if ((Event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0)
+						{
+							if (MatchesPatterns(Event->name))
+							{
+								m_PendingFiles[RelPath] = Now;
+							}
+						}
+						else if ((Event->mask & IN_MODIFY) != 0)
+						{
+							// Still being written, postpone the report:
+							auto PendingItr = m_PendingFiles.find(RelPath);
+							if (PendingItr != m_PendingFiles.end())
+							{
+								PendingItr->second = Now;
+							}
+						}
+					}
+				}
+			}
+			ReportPendingFiles();
+		}
+	#endif
+}
+
+
+
+
+
+bool cFolderWatcher::AddWatch(const AString & a_RelFolder, bool a_AddExistingFiles)
+{
+	#ifdef __linux__
+		AString Folder = m_RootFolder + a_RelFolder;
+		int wd = inotify_add_watch(m_INotifyFD, Folder.empty() ? "." : Folder.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_ONLYDIR
+		);
+		if (wd < 0)
+		{
+			return false;
+		}
+		m_WatchedFolders[wd] = a_RelFolder;
+
+		// Add the subfolders, and the files that may have been saved before the watch was added:
+		if (!m_Recursive && !a_AddExistingFiles)
+		{
+			return true;
+		}
+		AStringVector Files, Folders;
+		cFile::GetFolderContents(Folder, Files, Folders);
+		if (a_AddExistingFiles)
+		{
+			auto Now = cClock::now();
+			for (const auto & File: Files)
+			{
+				if (MatchesPatterns(File))
+				{
+					m_PendingFiles[a_RelFolder + File] = Now;
+				}
+			}
+		}
+		if (m_Recursive)
+		{
+			for (const auto & Subfolder: Folders)
+			{
+				AddWatch(a_RelFolder + Subfolder + "/", a_AddExistingFiles);
+			}
+		}
+		return true;
+	#else
+		UNUSED(a_RelFolder);
+		UNUSED(a_AddExistingFiles);
+		return false;
+	#endif
+}
+
+
+
+
+
+bool cFolderWatcher::MatchesPatterns(const AString & a_FileName) const
+{
+	for (const auto & Pattern: m_Patterns)
+	{
+		if (cFolderScanner::MatchesWildcard(Pattern.c_str(), a_FileName.c_str()))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+
+
+
+void cFolderWatcher::ReportPendingFiles(void)
+{
+	auto Threshold = cClock::now() - std::chrono::milliseconds(WATCH_DEBOUNCE_MSEC);
+	for (auto itr = m_PendingFiles.begin(); itr != m_PendingFiles.end();)
+	{
+		if (itr->second > Threshold)
+		{
+			++itr;
+			continue;
+		}
+		auto Slash = itr->first.find_last_of('/');
+		if (Slash == AString::npos)
+		{
+			m_Callback(AString(), itr->first);
+		}
+		else
+		{
+			m_Callback(itr->first.substr(0, Slash + 1), itr->first.substr(Slash + 1));
+		}
+		itr = m_PendingFiles.erase(itr);
+	}
+}
+
+
+
+
@@ -0,0 +1,96 @@
+
+// FolderWatcher.h
+
+// Declares the cFolderWatcher class that reports the files created or modified in a folder tree, as they are saved
+
+/*
+Implemented using inotify on Linux; not supported on the other platforms.
+A file is reported once it has been closed after writing, or moved into the folder (editors often save into a temporary
+file and rename it over the original). The reports are debounced: a file is reported only after no more changes
+have been made to it for a while, so that files written in several goes are reported once, and only when complete.
+If the inotify event queue overflows (the callback blocks while many files are saved), the events are lost and all the files
+in the watched tree are reported again instead.
+*/
+
+
+
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "FolderScanner.h"
+
+
+
+
+
+class cFolderWatcher
+{
+public:
+	/** Called for each saved file matching the patterns, from the watching thread.
+	a_RelFolder is the file's folder relative to the watched root, either empty or ending with a slash. */
+	typedef cFolderScanner::cCallback cCallback;
+
+
+	/** Creates a watcher of the specified root folder. a_Patterns are the wildcard patterns of the file names to report,
+	see cFolderScanner::MatchesWildcard(). If a_Recursive is true, the subfolders (including the ones created later)
+	are watched as well. */
+	cFolderWatcher(const AString & a_RootFolder, const AStringVector & a_Patterns, bool a_Recursive, cCallback a_Callback);
+
+	/** Stops watching, if started. */
+	~cFolderWatcher();
+
+	/** Starts watching in a separate thread. Returns false and sets a_ErrorMsg if the folder cannot be watched. */
+	bool Start(AString & a_ErrorMsg);
+
+	/** Stops watching and waits for the watching thread to finish. */
+	void Stop(void);
+
+protected:
+	typedef std::chrono::steady_clock cClock;
+
+	/** The folder whose tree is watched, ending with a slash (unless empty). */
+	AString m_RootFolder;
+
+	AStringVector m_Patterns;
+	bool m_Recursive;
+	cCallback m_Callback;
+
+	std::thread m_Thread;
+
+	/** Set when the watching thread should terminate. */
+	std::atomic<bool> m_ShouldTerminate;
+
+	/** The inotify instance, -1 if not started. */
+	int m_INotifyFD;
+
+	/** Map of inotify watch descriptor -> the watched folder, relative to m_RootFolder. Used only by the watching thread. */
+	std::map<int, AString> m_WatchedFolders;
+
+	/** Map of the saved files (relative to m_RootFolder) -> the time of their last change.
+	A file is reported once it hasn't changed for WATCH_DEBOUNCE_MSEC. Used only by the watching thread. */
+	std::map<AString, cClock::time_point> m_PendingFiles;
+
+
+	/** The body of the watching thread: processes the inotify events and reports the debounced files. */
+	void WatchThread(void);
+
+	/** Adds a watch for the specified folder (relative to m_RootFolder) and, if recursive, for all its subfolders.
+	If a_AddExistingFiles is true, the files already present in the folders are added as pending (used for folders
+	created after the watching started, whose files may have been saved before their watch was added).
+	Returns false if the folder cannot be watched. */
+	bool AddWatch(const AString & a_RelFolder, bool a_AddExistingFiles);
+
+	/** Returns true if the file name matches any of the patterns. */
+	bool MatchesPatterns(const AString & a_FileName) const;
+
+	/** Reports the pending files that haven't changed for WATCH_DEBOUNCE_MSEC and removes them from m_PendingFiles. */
+	void ReportPendingFiles(void);
+};
+
+
+
+
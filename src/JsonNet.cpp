@@ -11,15 +11,18 @@ Upon connection, the server first sends a json message containing its version.
 
 #include "Globals.h"
 #include "JsonNet.h"
-#include <sstream>
 #include <thread>
 #include <functional>
 #include "json/json.h"
-#include "WorldStorage/FastNBT.h"
+#include "SchematicLoader.h"
+#include "ContentHash.h"
+#include "LruCache.h"
+#include "RenderCache.h"
 #include "StringCompression.h"
 #include "BlockImage.h"
 #include "PngExporter.h"
 #include "Marker.h"
+#include "Tracer.h"
 
 
 
@@ -35,6 +38,84 @@ Upon connection, the server first sends a json message containing its version.
 
 
 
+/** Identifies the schematic data in a request by the hash and the length of its BlockData (Base64-ed gzipped NBT). */
+struct cSchematicKey
+{
+	UInt64 m_Hash;
+	size_t m_Length;
+
+	bool operator == (const cSchematicKey & a_Other) const
+	{
+		return (m_Hash == a_Other.m_Hash) && (m_Length == a_Other.m_Length);
+	}
+};
+
+struct cSchematicKeyHasher
+{
+	size_t operator () (const cSchematicKey & a_Key) const
+	{
+		return static_cast<size_t>(a_Key.m_Hash);
+	}
+};
+
+typedef cLruCache<cSchematicKey, cSchematic, cSchematicKeyHasher> cSchematicCache;
+
+/** The decoded schematics, shared among all the connections.
+Clients tend to re-render the same schematic many times (different crops, rotations or markers),
+so the decompressing and parsing is done only once for each distinct BlockData. */
+static cSchematicCache g_SchematicCache(cJsonNet::DEFAULT_SCHEMATIC_CACHE_SIZE);
+
+/** The rendered images, shared among all the connections.
+Web frontends send identical requests repeatedly, these are answered without decoding or rendering anything. */
+static cRenderCache g_RenderCache(cJsonNet::DEFAULT_RENDER_CACHE_MEM_SIZE, cJsonNet::DEFAULT_RENDER_CACHE_DISK_SIZE);
+
+/** The request params that affect the rendered image, besides the BlockData and Markers. */
+static const char * const g_RenderParamNames[] =
+{
+	"StartX", "EndX", "StartY", "EndY", "StartZ", "EndZ", "NumCWRotations", "HorzSize", "VertSize",
+};
+
+
+
+
+
+/** Returns the key for the render cache for the specified RenderSchematic request.
+The key identifies the BlockData by its cache key, and includes all the params affecting the image, as sent by the client,
+and a digest of the markers. */
+static AString GetRenderCacheKey(const cSchematicKey & a_SchematicKey, const Json::Value & a_Request)
+{
+	AString res = Printf("v%d|%016llx-%llu", cPngExporter::OUTPUT_VERSION,
+		static_cast<unsigned long long>(a_SchematicKey.m_Hash), static_cast<unsigned long long>(a_SchematicKey.m_Length)
+	);
+	for (auto paramName: g_RenderParamNames)
+	{
+		if (a_Request.isMember(paramName))
+		{
+			AppendPrintf(res, "|%d", a_Request[paramName].asInt());
+		}
+		else
+		{
+			// Use a distinct value for missing params, their defaults depend on the schematic size:
+			res.append("|-");
+		}
+	}
+	AString markers;
+	for (const auto & marker: a_Request["Markers"])
+	{
+		AppendPrintf(markers, "%d,%d,%d,%s,%s;", marker["X"].asInt(), marker["Y"].asInt(), marker["Z"].asInt(),
+			marker["Shape"].asString().c_str(), marker["Color"].asString().c_str()
+		);
+	}
+	AppendPrintf(res, "|%016llx-%llu",
+		static_cast<unsigned long long>(GetContentHash(markers)), static_cast<unsigned long long>(markers.size())
+	);
+	return res;
+}
+
+
+
+
+
 class cJsonNetConnection
 {
 public:
@@ -83,12 +164,17 @@ protected:
 	so that the client can pair the command with the response. */
 	Json::Value m_CurrentCmdID;
 
+	/** Buffer for the uncompressed NBT data of the request being processed.
+	Kept between the requests, so that its memory is reused instead of reallocated for each request. */
+	AString m_NBTBuffer;
+
 
 
 	/** Handles the connection's lifetime - reads requests and writes responses to the socket.
 	When the connection is closed, deletes self. */
 	void Run(void)
 	{
+		TRACE_THREAD_NAME("json connection");
 		Json::Value welcomeMsg;
 		welcomeMsg["MCSchematicToPng"] = 2;
 		SendResponse(welcomeMsg);
@@ -103,11 +189,12 @@ protected:
 	void ProcessIncomingData()
 	{
 		// Read from the socket until an ETB character (0x17), then process as JSON:
+		// The request buffer is reused for all the requests on this connection, to avoid reallocations for large requests
 		AString req;
+		std::unique_ptr<char[]> buf(new char[64 KiB]);
 		for (;;)
 		{
-			char buf[128];
-			int numReceived = static_cast<int>(recv(m_Socket, buf, sizeof(buf), 0));
+			int numReceived = static_cast<int>(recv(m_Socket, buf.get(), 64 KiB, 0));
 			if (numReceived < 0)
 			{
 				LOGWARNING("Socket %s received an error %d, LastError = %d. Closing connection.", m_Identification.c_str(), numReceived, NET_LAST_ERROR);
@@ -119,36 +206,47 @@ protected:
 				LOG("Socket %s closed.", m_Identification.c_str());
 				return;
 			}
-			int start = 0;
-			for (int i = 0; i < numReceived; i++)
+			const char * start = buf.get();
+			const char * end = start + numReceived;
+			const char * etb;
+			while ((etb = reinterpret_cast<const char *>(memchr(start, 0x17, static_cast<size_t>(end - start)))) != nullptr)
 			{
-				if (buf[i] == 0x17)
+				req.append(start, static_cast<size_t>(etb - start));
+				if (!ProcessReq(req))
 				{
-					auto numBytes = i - start;
-					if (numBytes > 0)
-					{
-						req.append(buf + start, static_cast<size_t>(numBytes));
-					}
-					if (!ProcessReq(req))
-					{
-						LOGWARNING("Failed to process request on socket %s, closing the socket.", m_Identification.c_str());
-						closesocket(m_Socket);
-						return;
-					}
-					req.clear();
-					start = i + 1;
+					LOGWARNING("Failed to process request on socket %s, closing the socket.", m_Identification.c_str());
+					closesocket(m_Socket);
+					return;
 				}
-			}  // for i - buf[]
-			if (start < numReceived)
-			{
-				auto numBytes = numReceived - start;
-				req.append(buf + start, numBytes);
-			}
+				req.clear();
+				start = etb + 1;
+			}  // while (etb) - buf[]
+			req.append(start, static_cast<size_t>(end - start));
 		}  // for (-ever)
 	}
 
 
 
+	#ifdef ENABLE_TRACING
+		/** Returns the ID of the current command's trace events: its CmdID if it is an integer, 0 otherwise. */
+		Int64 GetTraceID(void) const
+		{
+			return m_CurrentCmdID.isInt64() ? static_cast<Int64>(m_CurrentCmdID.asInt64()) : 0;
+		}
+
+
+
+		/** Returns the detail of the current command's trace events, identifying the connection and the command. */
+		AString GetTraceDetail(void) const
+		{
+			return Printf("%s CmdID %s", m_Identification.c_str(),
+				m_CurrentCmdID.isConvertibleTo(Json::stringValue) ? m_CurrentCmdID.asString().c_str() : "?"
+			);
+		}
+	#endif
+
+
+
 	/** Processes a single Json request incoming on the socket.
 	Returns true if successful, false on error. */
 	bool ProcessReq(const AString & a_Request)
@@ -157,8 +255,8 @@ protected:
 		builder["collectComments"] = false;
 		Json::Value req;
 		JSONCPP_STRING err;
-		std::istringstream is(a_Request);
-		bool ok = parseFromStream(builder, is, &req, &err);
+		std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+		bool ok = reader->parse(a_Request.data(), a_Request.data() + a_Request.size(), &req, &err);
 		if (!ok)
 		{
 			LOGWARNING("Error while parsing json on socket %s: %s", m_Identification.c_str(), err.c_str());
@@ -176,10 +274,15 @@ protected:
 	{
 		auto cmd = a_Request["Cmd"].asString();
 		m_CurrentCmdID = a_Request["CmdID"];
+		TRACE_SCOPE_DETAIL("json request", GetTraceID(), Printf("%s: %s", GetTraceDetail().c_str(), cmd.c_str()));
 		if (cmd == "RenderSchematic")
 		{
 			return ProcessRenderSchematic(a_Request);
 		}
+		else if (cmd == "GetStats")
+		{
+			return ProcessGetStats();
+		}
 		else if (cmd == "SetName")
 		{
 			auto name = a_Request["Name"].asString();
@@ -205,37 +308,44 @@ protected:
 	{
 		try
 		{
-			auto blockData = a_Request.get("BlockData", "").asString();
+			// Get the schematic for the BlockData, referencing the string directly in the json value:
+			const auto & blockData = a_Request["BlockData"];
+			const char * blockDataBegin = nullptr;
+			const char * blockDataEnd = nullptr;
+			if (!blockData.isString() || !blockData.getString(&blockDataBegin, &blockDataEnd))
+			{
+				blockDataBegin = blockDataEnd = "";
+			}
+			cSchematicKey schematicKey;
+			schematicKey.m_Length = static_cast<size_t>(blockDataEnd - blockDataBegin);
+			schematicKey.m_Hash = GetContentHash(blockDataBegin, schematicKey.m_Length);
 
-			auto unBase64ed = Base64Decode(blockData);
-			AString contents;
-			if (UncompressStringGZIP(unBase64ed.data(), unBase64ed.size(), contents) != Z_OK)
+			// If the same image has been rendered already, send it right away:
+			AString renderCacheKey;
+			if (g_RenderCache.IsEnabled())
 			{
-				SendSimpleError("Failed to decompress block data.");
-				return true;
+				renderCacheKey = GetRenderCacheKey(schematicKey, a_Request);
+				auto pngData = g_RenderCache.Find(renderCacheKey);
+				if (pngData != nullptr)
+				{
+					SendPngResponse(*pngData);
+					return true;
+				}
 			}
-			cParsedNBT nbt(contents.data(), contents.size());
-			if (!nbt.IsValid())
+
+			cSchematicConstPtr schematic;
 			{
-				SendSimpleError("Cannot NBT-parse input file.");
-				return true;
+				TRACE_SCOPE_DETAIL("json: get schematic", GetTraceID(), GetTraceDetail());
+				schematic = GetSchematic(schematicKey, blockDataBegin);
 			}
-			int tHeight = nbt.FindChildByName(0, "Height");
-			int tLength = nbt.FindChildByName(0, "Length");
-			int tWidth  = nbt.FindChildByName(0, "Width");
-			if (
-				(tHeight <= 0) || (tLength <= 0) || (tWidth <= 0) ||
-				(nbt.GetType(tHeight) != TAG_Short) ||
-				(nbt.GetType(tLength) != TAG_Short) ||
-				(nbt.GetType(tWidth) != TAG_Short)
-			)
+			if (schematic == nullptr)
 			{
-				SendSimpleError("NBT data doesn't contain dimensions!");
+				// Error has already been sent
 				return true;
 			}
-			int height = nbt.GetShort(tHeight);
-			int length = nbt.GetShort(tLength);
-			int width  = nbt.GetShort(tWidth);
+			int height = schematic->GetSizeY();
+			int length = schematic->GetSizeZ();
+			int width  = schematic->GetSizeX();
 
 			// Get the dimensions from the request, combine with actual dimensions:
 			auto startX = Clamp(a_Request.get("StartX", 0).asInt(), 0, length);
@@ -252,21 +362,6 @@ protected:
 				return true;
 			}
 
-			// Get the pointers to block data in the NBT:
-			int tBlocks = nbt.FindChildByName(0, "Blocks");
-			int tMetas = nbt.FindChildByName(0, "Data");
-			if (
-				(tBlocks <= 0) || (tMetas <= 0) ||
-				(nbt.GetType(tBlocks) != TAG_ByteArray) ||
-				(nbt.GetType(tMetas)  != TAG_ByteArray)
-			)
-			{
-				SendSimpleError("NBT data doesn't contain block data or meta data!");
-				return true;
-			}
-			auto blocks = reinterpret_cast<const Byte *>(nbt.GetData(tBlocks));
-			auto metas  = reinterpret_cast<const Byte *>(nbt.GetData(tMetas));
-
 			// Parse the markers:
 			auto markers = a_Request["Markers"];
 			cMarkerPtrs imgMarkers;
@@ -288,44 +383,36 @@ protected:
 				imgMarkers.push_back(std::make_shared<cMarker>(marker["X"].asInt(), marker["Y"].asInt(), marker["Z"].asInt(), shape, color));
 			}
 
-			// Copy the block data out of the NBT:
-			auto sizeX = endX - startX + 1;
-			auto sizeY = endY - startY + 1;
-			auto sizeZ = endZ - startZ + 1;
-			cBlockImage Img(sizeX, sizeY, sizeZ);
-			for (int y = 0; y < sizeY; y++)
+			// Render the image in its own block, so that its trace event doesn't include sending the response:
+			std::shared_ptr<AString> pngData;
 			{
-				for (int z = 0; z < sizeZ; z++)
+				// Copy the requested area out of the schematic:
+				TRACE_SCOPE_DETAIL("json: render", GetTraceID(), GetTraceDetail());
+				auto sizeX = endX - startX + 1;
+				auto sizeY = endY - startY + 1;
+				auto sizeZ = endZ - startZ + 1;
+				cBlockImage Img(sizeX, sizeY, sizeZ);
+				schematic->CopyToImage(Img, startX, startY, startZ);
+
+				// Apply the rotations:
+				auto numCWRotations = a_Request.get("NumCWRotations", 0).asInt();
+				auto numCCWRotations = (4 - (numCWRotations % 4)) % 4;
+				for (int i = 0; i < numCCWRotations; i++)
 				{
-					for (int x = 0; x < sizeX; x++)
-					{
-						int idx = startX + x + (startZ + z) * width + (startY + y) * width * length;
-						Byte BlockType = blocks[idx];
-						Byte BlockMeta = metas[idx] & 0x0f;
-						Img.SetBlock(x, y, z, BlockType, BlockMeta);
-					}
+					Img.RotateCCW();
 				}
-			}
 
-			// Apply the rotations:
-			auto numCWRotations = a_Request.get("NumCWRotations", 0).asInt();
-			auto numCCWRotations = (4 - (numCWRotations % 4)) % 4;
-			for (int i = 0; i < numCCWRotations; i++)
-			{
-				Img.RotateCCW();
+				// Export as PNG image:
+				auto horzSize = a_Request.get("HorzSize", 4).asInt();
+				auto vertSize = a_Request.get("VertSize", 5).asInt();
+				auto dataOut = cPngExporter::Export(Img, horzSize, vertSize, imgMarkers);
+				pngData = std::make_shared<AString>(Base64Encode(dataOut));
+				if (!renderCacheKey.empty())
+				{
+					g_RenderCache.Add(renderCacheKey, dataOut, pngData);
+				}
 			}
-
-			// Export as PNG image:
-			auto horzSize = a_Request.get("HorzSize", 4).asInt();
-			auto vertSize = a_Request.get("VertSize", 5).asInt();
-			auto dataOut = cPngExporter::Export(Img, horzSize, vertSize, imgMarkers);
-
-			// Send the response:
-			Json::Value resp;
-			resp["Status"] = "ok";
-			resp["CmdID"] = m_CurrentCmdID;
-			resp["PngData"] = Base64Encode(dataOut);
-			SendResponse(resp);
+			SendPngResponse(*pngData);
 		}
 		catch (const std::exception & exc)
 		{
@@ -337,6 +424,98 @@ protected:
 
 
 
+	/** Returns the decoded schematic for the specified BlockData (Base64-ed gzipped NBT), identified by a_Key.
+	Uses the shared cache if possible, otherwise decodes the data and stores the result in the cache.
+	On failure, sends an error response and returns nullptr. */
+	cSchematicConstPtr GetSchematic(const cSchematicKey & a_Key, const char * a_BlockData)
+	{
+		bool isCacheEnabled = g_SchematicCache.IsEnabled();
+		if (isCacheEnabled)
+		{
+			auto res = g_SchematicCache.Find(a_Key);
+			if (res != nullptr)
+			{
+				return res;
+			}
+		}
+
+		// Decode the Base64 directly from the json value, streaming it into the inflater:
+		AString & contents = m_NBTBuffer;
+		contents.clear();
+		if (UncompressBase64GZIP(a_BlockData, a_Key.m_Length, contents) != Z_OK)
+		{
+			SendSimpleError("Failed to decompress block data.");
+			return nullptr;
+		}
+		AString errorMsg;
+		cSchematicConstPtr res = cSchematicLoader::Load(contents.data(), contents.size(), errorMsg);
+		if (res == nullptr)
+		{
+			SendSimpleError(errorMsg);
+			return nullptr;
+		}
+		if (isCacheEnabled)
+		{
+			g_SchematicCache.Add(a_Key, res, res->GetMemoryUsage());
+		}
+		return res;
+	}
+
+
+
+	/** Processes a GetStats cmd incoming on the socket, sends back the server statistics.
+	Returns true if successful, false on error. */
+	bool ProcessGetStats(void)
+	{
+		auto stats = g_SchematicCache.GetStats();
+		Json::Value cache;
+		cache["Hits"] = static_cast<Json::UInt64>(stats.m_NumHits);
+		cache["Misses"] = static_cast<Json::UInt64>(stats.m_NumMisses);
+		cache["Evictions"] = static_cast<Json::UInt64>(stats.m_NumEvictions);
+		cache["NumEntries"] = static_cast<Json::UInt64>(stats.m_NumEntries);
+		cache["NumBytes"] = static_cast<Json::UInt64>(stats.m_TotalCost);
+		cache["MaxBytes"] = static_cast<Json::UInt64>(stats.m_MaxCost);
+
+		auto renderStats = g_RenderCache.GetStats();
+		Json::Value renderMem;
+		renderMem["Hits"] = static_cast<Json::UInt64>(renderStats.m_NumMemHits);
+		renderMem["Misses"] = static_cast<Json::UInt64>(renderStats.m_NumMemMisses);
+		renderMem["Evictions"] = static_cast<Json::UInt64>(renderStats.m_NumMemEvictions);
+		renderMem["NumEntries"] = static_cast<Json::UInt64>(renderStats.m_NumMemEntries);
+		renderMem["NumBytes"] = static_cast<Json::UInt64>(renderStats.m_NumMemBytes);
+		renderMem["MaxBytes"] = static_cast<Json::UInt64>(renderStats.m_MaxMemBytes);
+		Json::Value renderDisk;
+		renderDisk["Hits"] = static_cast<Json::UInt64>(renderStats.m_NumDiskHits);
+		renderDisk["Misses"] = static_cast<Json::UInt64>(renderStats.m_NumDiskMisses);
+		renderDisk["Evictions"] = static_cast<Json::UInt64>(renderStats.m_NumDiskEvictions);
+		renderDisk["NumEntries"] = static_cast<Json::UInt64>(renderStats.m_NumDiskEntries);
+		renderDisk["NumBytes"] = static_cast<Json::UInt64>(renderStats.m_NumDiskBytes);
+		renderDisk["MaxBytes"] = static_cast<Json::UInt64>(renderStats.m_MaxDiskBytes);
+
+		Json::Value resp;
+		resp["Status"] = "ok";
+		resp["CmdID"] = m_CurrentCmdID;
+		resp["SchematicCache"] = cache;
+		resp["RenderCache"]["Memory"] = renderMem;
+		resp["RenderCache"]["Disk"] = renderDisk;
+		SendResponse(resp);
+		return true;
+	}
+
+
+
+	/** Sends a successful RenderSchematic response with the specified Base64-ed PNG data. */
+	void SendPngResponse(const AString & a_Base64PngData)
+	{
+		Json::Value resp;
+		resp["Status"] = "ok";
+		resp["CmdID"] = m_CurrentCmdID;
+		resp["PngData"] = a_Base64PngData;
+		SendResponse(resp);
+	}
+
+
+
 	/** Sends an error response. */
 	void SendSimpleError(const AString & a_Error)
 	{
@@ -353,6 +532,7 @@ protected:
 	/** Sends the json as a response. */
 	void SendResponse(const Json::Value & a_Response)
 	{
+		TRACE_SCOPE_DETAIL("json: send", GetTraceID(), GetTraceDetail());
 		auto toSend = a_Response.toStyledString();
 		send(m_Socket, toSend.data(), toSend.size(), 0);
 		char msgEnd = 0x17;
@@ -402,6 +582,43 @@ protected:
 ////////////////////////////////////////////////////////////////////////////////
 // cJsonNet:
 
+void cJsonNet::SetSchematicCacheSize(size_t a_MaxBytes)
+{
+	g_SchematicCache.SetMaxCost(a_MaxBytes);
+}
+
+
+
+
+
+void cJsonNet::SetRenderCacheMemSize(size_t a_MaxBytes)
+{
+	g_RenderCache.SetMaxMemSize(a_MaxBytes);
+}
+
+
+
+
+
+void cJsonNet::SetRenderCacheDiskSize(size_t a_MaxBytes)
+{
+	g_RenderCache.SetMaxDiskSize(a_MaxBytes);
+}
+
+
+
+
+
+bool cJsonNet::SetRenderCacheFolder(const AString & a_Folder)
+{
+	return g_RenderCache.SetDiskFolder(a_Folder);
+}
+
+
+
+
+
+
 bool cJsonNet::Start(UInt16 a_Port)
 {
 	SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
@@ -9,9 +9,32 @@
 class cJsonNet
 {
 public:
+	/** The default memory budget of the decoded schematics cache, in bytes. */
+	static const size_t DEFAULT_SCHEMATIC_CACHE_SIZE = 256 MiB;
+
+	/** The default memory budget of the rendered images cache, in bytes. */
+	static const size_t DEFAULT_RENDER_CACHE_MEM_SIZE = 64 MiB;
+
+	/** The default size limit of the rendered images cache folder, in bytes. The folder itself is not used unless set. */
+	static const size_t DEFAULT_RENDER_CACHE_DISK_SIZE = 1024 MiB;
+
 	/** Starts the TCP server listening for Json API communication on the specified port.
 	Returns true if successful, false otherwise. */
 	static bool Start(UInt16 a_Port);
+
+	/** Sets the memory budget of the decoded schematics cache shared by all the connections, in bytes.
+	0 disables the cache. */
+	static void SetSchematicCacheSize(size_t a_MaxBytes);
+
+	/** Sets the memory budget of the rendered images cache, in bytes. 0 disables the memory tier. */
+	static void SetRenderCacheMemSize(size_t a_MaxBytes);
+
+	/** Sets the size limit of the rendered images cache folder, in bytes. */
+	static void SetRenderCacheDiskSize(size_t a_MaxBytes);
+
+	/** Sets the folder where the rendered images are cached across restarts. Empty folder name disables the disk tier.
+	Returns false if the folder cannot be used. */
+	static bool SetRenderCacheFolder(const AString & a_Folder);
 };
 
 
@@ -0,0 +1,169 @@
+
+// LruCache.h
+
+// Declares the cLruCache class template implementing a thread-safe, size-bounded least-recently-used cache
+
+
+
+
+
+#pragma once
+
+#include <list>
+#include <unordered_map>
+
+
+
+
+
+/** A thread-safe cache that keeps at most the specified total cost of items, evicting the least recently used ones.
+The values are stored as shared pointers to const objects, so that they can be used by multiple threads
+even after being evicted. All operations are O(1) and the lock is held only for the map / list manipulation,
+never while creating or using the values. */
+template <typename Key, typename Value, typename KeyHasher = std::hash<Key>>
+class cLruCache
+{
+public:
+	typedef std::shared_ptr<const Value> cValuePtr;
+
+	/** The statistics of the cache usage. */
+	struct cStats
+	{
+		UInt64 m_NumHits;
+		UInt64 m_NumMisses;
+		UInt64 m_NumEvictions;
+		size_t m_NumEntries;
+		size_t m_TotalCost;
+		size_t m_MaxCost;
+	};
+
+
+	cLruCache(size_t a_MaxCost):
+		m_TotalCost(0),
+		m_MaxCost(a_MaxCost),
+		m_NumHits(0),
+		m_NumMisses(0),
+		m_NumEvictions(0)
+	{
+	}
+
+	/** Sets the maximum total cost of the items kept in the cache. 0 disables the cache.
+	Evicts the least recently used items if over the new limit. */
+	void SetMaxCost(size_t a_MaxCost)
+	{
+		cCSLock Lock(m_CS);
+		m_MaxCost = a_MaxCost;
+		EvictOverLimit();
+	}
+
+	/** Returns true if the cache can store anything. */
+	bool IsEnabled(void)
+	{
+		cCSLock Lock(m_CS);
+		return (m_MaxCost > 0);
+	}
+
+	/** Returns the value stored for the specified key, or nullptr if not in the cache.
+	Marks the item as the most recently used one. Counts as a hit or a miss in the statistics. */
+	cValuePtr Find(const Key & a_Key)
+	{
+		cCSLock Lock(m_CS);
+		auto itr = m_Map.find(a_Key);
+		if (itr == m_Map.end())
+		{
+			m_NumMisses += 1;
+			return nullptr;
+		}
+		m_NumHits += 1;
+		m_Items.splice(m_Items.begin(), m_Items, itr->second);
+		return itr->second->m_Value;
+	}
+
+	/** Stores the value for the specified key, replacing any previous value.
+	a_Cost is the value's share of the limit, usually its memory usage.
+	Evicts the least recently used items if over the limit; values over the limit are not stored at all. */
+	void Add(const Key & a_Key, cValuePtr a_Value, size_t a_Cost)
+	{
+		cCSLock Lock(m_CS);
+		if (a_Cost > m_MaxCost)
+		{
+			return;
+		}
+		auto itr = m_Map.find(a_Key);
+		if (itr != m_Map.end())
+		{
+			m_TotalCost -= itr->second->m_Cost;
+			m_Items.erase(itr->second);
+			m_Map.erase(itr);
+		}
+		m_Items.push_front(cItem(a_Key, std::move(a_Value), a_Cost));
+		m_Map[a_Key] = m_Items.begin();
+		m_TotalCost += a_Cost;
+		EvictOverLimit();
+	}
+
+	/** Returns the current statistics. */
+	cStats GetStats(void)
+	{
+		cCSLock Lock(m_CS);
+		cStats res;
+		res.m_NumHits = m_NumHits;
+		res.m_NumMisses = m_NumMisses;
+		res.m_NumEvictions = m_NumEvictions;
+		res.m_NumEntries = m_Map.size();
+		res.m_TotalCost = m_TotalCost;
+		res.m_MaxCost = m_MaxCost;
+		return res;
+	}
+
+protected:
+	struct cItem
+	{
+		Key m_Key;
+		cValuePtr m_Value;
+		size_t m_Cost;
+
+		cItem(const Key & a_Key, cValuePtr && a_Value, size_t a_Cost):
+			m_Key(a_Key),
+			m_Value(std::move(a_Value)),
+			m_Cost(a_Cost)
+		{
+		}
+	};
+
+	typedef std::list<cItem> cItems;
+
+
+	/** Protects all the member variables against multithreaded access. */
+	cCriticalSection m_CS;
+
+	/** The items, ordered from the most recently used one to the least recently used one. */
+	cItems m_Items;
+
+	/** Maps the keys to their items in m_Items. */
+	std::unordered_map<Key, typename cItems::iterator, KeyHasher> m_Map;
+
+	size_t m_TotalCost;
+	size_t m_MaxCost;
+	UInt64 m_NumHits;
+	UInt64 m_NumMisses;
+	UInt64 m_NumEvictions;
+
+
+	/** Evicts the least recently used items until the total cost is within the limit. Expects m_CS to be locked. */
+	void EvictOverLimit(void)
+	{
+		while ((m_TotalCost > m_MaxCost) && !m_Items.empty())
+		{
+			auto & Item = m_Items.back();
+			m_TotalCost -= Item.m_Cost;
+			m_Map.erase(Item.m_Key);
+			m_Items.pop_back();
+			m_NumEvictions += 1;
+		}
+	}
+};
+
+
+
+
@@ -0,0 +1,56 @@
+
+// Main.cpp
+
+// Implements the main app entrypoint
+
+#include "Globals.h"
+#include "SchematicToPng.h"
+#include "LoggerListeners.h"
+
+
+
+
+
+int main(int argc, char ** argv)
+{
+	// The pipe mode writes the image to stdout, so it doesn't log to the console (errors go to stderr).
+	// It doesn't create the log file either, to start up as fast as possible:
+	for (int i = 1; i < argc; i++)
+	{
+		if (NoCaseCompare(argv[i], "-pipe") == 0)
+		{
+			cSchematicToPng App;
+			if (!App.Init(argc, argv))
+			{
+				return 1;
+			}
+			return App.RunPipe() ? 0 : 1;
+		}
+	}
+
+	cLogger::cListener * consoleLogListener = MakeConsoleListener();
+	cLogger::cListener * fileLogListener = new cFileListener();
+	cLogger::GetInstance().AttachListener(consoleLogListener);
+	cLogger::GetInstance().AttachListener(fileLogListener);
+
+	cLogger::InitiateMultithreading();
+
+	cSchematicToPng App;
+	if (!App.Init(argc, argv))
+	{
+		return 1;
+	}
+
+	App.Run();
+
+	cLogger::GetInstance().DetachListener(consoleLogListener);
+	delete consoleLogListener;
+	cLogger::GetInstance().DetachListener(fileLogListener);
+	delete fileLogListener;
+
+	return 0;
+}
+
+
+
+
@@ -34,7 +34,8 @@ void cPngExporter::Export(cBlockImage & a_Image, const AString & a_OutFileName,
 AString cPngExporter::Export(cBlockImage & a_Image, int a_HorzSize, int a_VertSize, const cMarkerPtrs & a_Markers)
 {
 	cPngExporter Exporter(a_Image, a_HorzSize, a_VertSize, a_Markers);
-	return Exporter.DoExport();
+	Exporter.Render();
+	return Exporter.Encode();
 }
 
 
@@ -56,9 +57,29 @@ cPngExporter::cPngExporter(cBlockImage & a_BlockImage, int a_HorzSize, int a_Ver
 
 
 
-AString cPngExporter::DoExport()
+void cPngExporter::Render(void)
+{
+	DrawCubes(0, m_ImgHeight);
+}
+
+
+
+
+
+void cPngExporter::RenderRows(int a_MinY, int a_MaxY)
+{
+	ASSERT(m_Markers.empty());
+
+	// Each band draws the same cubes in the same order as the whole image would, so the alpha blending gives the same results:
+	DrawCubes(std::max(a_MinY, 0), std::min(a_MaxY, m_ImgHeight));
+}
+
+
+
+
+
+AString cPngExporter::Encode(void)
 {
-	DrawCubes();
 	std::stringstream ss;
 	m_Img.write_stream(ss);
 	return ss.str();
@@ -68,7 +89,7 @@ AString cPngExporter::DoExport()
 
 
 
-void cPngExporter::DrawCubes(void)
+void cPngExporter::DrawCubes(int a_ClipMinY, int a_ClipMaxY)
 {
 	int SizeX = m_BlockImage.GetSizeX();
 	int SizeZ = m_BlockImage.GetSizeZ();
@@ -85,7 +106,7 @@ void cPngExporter::DrawCubes(void)
 				// Column out of range
 				continue;
 			}
-			DrawCubesColumn(ColumnX, ColumnZ);
+			DrawCubesColumn(ColumnX, ColumnZ, a_ClipMinY, a_ClipMaxY);
 		}  // for j
 		// m_Img.write(Printf("test_%03d.png", i).c_str());
 	}  // for i
@@ -95,7 +116,7 @@ void cPngExporter::DrawCubes(void)
 
 
 
-void cPngExporter::DrawCubesColumn(int a_ColumnX, int a_ColumnZ)
+void cPngExporter::DrawCubesColumn(int a_ColumnX, int a_ColumnZ, int a_ClipMinY, int a_ClipMaxY)
 {
 	int SizeX = m_BlockImage.GetSizeX();
 	int SizeY = m_BlockImage.GetSizeY();
@@ -107,6 +128,12 @@ void cPngExporter::DrawCubesColumn(int a_ColumnX, int a_ColumnZ)
 	int BlockZ = a_ColumnZ;
 	for (int y = SizeY; y >= -1; y--)
 	{
+		// A cube's pixels span the rows from its ImgY to ImgY + VertSize + HorzSize, skip the cubes outside the clip:
+		int ImgY = BaseY + y * m_VertSize;
+		if ((ImgY + m_VertSize + m_HorzSize < a_ClipMinY) || (ImgY >= a_ClipMaxY))
+		{
+			continue;
+		}
 		Byte BlockType;
 		Byte BlockMeta;
 		int BlockY = SizeY - y - 1;
@@ -117,13 +144,13 @@ void cPngExporter::DrawCubesColumn(int a_ColumnX, int a_ColumnZ)
 			bool DrawTopFace   = (BlockY >= SizeY - 1) || (m_BlockImage.GetBlockType(BlockX, BlockY + 1, BlockZ) != BlockType);
 			bool DrawLeftFace  = (BlockX >= SizeX - 1) || (m_BlockImage.GetBlockType(BlockX + 1, BlockY, BlockZ) != BlockType);
 			bool DrawRightFace = (BlockZ == 0)         || (m_BlockImage.GetBlockType(BlockX, BlockY, BlockZ - 1) != BlockType);
-			DrawMarkersInCube(BaseX, BaseY + y * m_VertSize, BlockX, BlockY, BlockZ);
-			DrawSingleCube(BaseX, BaseY + y * m_VertSize, BlockType, BlockMeta, DrawTopFace, DrawLeftFace, DrawRightFace);
+			DrawMarkersInCube(BaseX, ImgY, BlockX, BlockY, BlockZ);
+			DrawSingleCube(BaseX, ImgY, BlockType, BlockMeta, DrawTopFace, DrawLeftFace, DrawRightFace, a_ClipMinY, a_ClipMaxY);
 		}
 		else
 		{
 			// Outside block range, draw only markers:
-			DrawMarkersInCube(BaseX, BaseY + y * m_VertSize, BlockX, BlockY, BlockZ);
+			DrawMarkersInCube(BaseX, ImgY, BlockX, BlockY, BlockZ);
 		}
 	}
 }
@@ -151,7 +178,10 @@ void cPngExporter::DrawMarkersInCube(int a_ImgX, int a_ImgY, int a_BlockX, int a
 
 
 
-void cPngExporter::DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte a_BlockMeta, bool a_DrawTopFace, bool a_DrawLeftFace, bool a_DrawRightFace)
+void cPngExporter::DrawSingleCube(
+	int a_ImgX, int a_ImgY, Byte a_BlockType, Byte a_BlockMeta, bool a_DrawTopFace, bool a_DrawLeftFace, bool a_DrawRightFace,
+	int a_ClipMinY, int a_ClipMaxY
+)
 {
 	if (a_BlockType == 0)
 	{
@@ -167,13 +197,13 @@ void cPngExporter::DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte
 		{
 			for (int y = x / 2; y > 0; y--)
 			{
-				DrawPixel(a_ImgX + x, a_ImgY + y + m_HorzSize / 2, colLight);
-				DrawPixel(a_ImgX + x, a_ImgY - y + m_HorzSize / 2, colLight);
-				DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY + y + m_HorzSize / 2, colLight);
-				DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY - y + m_HorzSize / 2, colLight);
+				DrawPixel(a_ImgX + x, a_ImgY + y + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
+				DrawPixel(a_ImgX + x, a_ImgY - y + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
+				DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY + y + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
+				DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY - y + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
 			}
-			DrawPixel(a_ImgX + x, a_ImgY + m_HorzSize / 2, colLight);
-			DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY + m_HorzSize / 2, colLight);
+			DrawPixel(a_ImgX + x, a_ImgY + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
+			DrawPixel(a_ImgX + 2 * m_HorzSize - x + 1, a_ImgY + m_HorzSize / 2, colLight, a_ClipMinY, a_ClipMaxY);
 		}
 	}
 
@@ -184,7 +214,7 @@ void cPngExporter::DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte
 		{
 			for (int y = 1; y <= m_VertSize; y++)
 			{
-				DrawPixel(a_ImgX + x, a_ImgY + y + m_HorzSize / 2 + x / 2, colNormal);
+				DrawPixel(a_ImgX + x, a_ImgY + y + m_HorzSize / 2 + x / 2, colNormal, a_ClipMinY, a_ClipMaxY);
 			}
 		}
 	}
@@ -196,7 +226,7 @@ void cPngExporter::DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte
 		{
 			for (int y = 1; y <= m_VertSize; y++)
 			{
-				DrawPixel(a_ImgX + m_HorzSize + x + 1, a_ImgY + y + m_HorzSize - (x + 1) / 2, colShadow);
+				DrawPixel(a_ImgX + m_HorzSize + x + 1, a_ImgY + y + m_HorzSize - (x + 1) / 2, colShadow, a_ClipMinY, a_ClipMaxY);
 			}
 		}
 	}
@@ -206,8 +236,13 @@ void cPngExporter::DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte
 
 
 
-void cPngExporter::DrawPixel(int a_X, int a_Y, const png::rgba_pixel & a_Color)
+void cPngExporter::DrawPixel(int a_X, int a_Y, const png::rgba_pixel & a_Color, int a_ClipMinY, int a_ClipMaxY)
 {
+	if ((a_Y < a_ClipMinY) || (a_Y >= a_ClipMaxY))
+	{
+		return;
+	}
+
 	// Perform color mixing for transparent blocks:
 	// Src.: http://en.wikipedia.org/wiki/Alpha_compositing#Alpha_blending
 	png::rgba_pixel current = m_Img[a_Y][a_X];
@@ -28,12 +28,38 @@ typedef std::vector<cMarkerPtr> cMarkerPtrs;
 class cPngExporter
 {
 public:
+	/** Version of the rendered output. Increment whenever the renderer or the PNG encoder changes its output,
+	so that the images stored by the render cache and by the incremental builds are rendered again. */
+	static const int OUTPUT_VERSION = 1;
+
 	/** Exports the specified block image, using the sizes and markers, to the specified file. */
 	static void Export(cBlockImage & a_Image, const AString & a_OutFileName, int a_HorzSize, int a_VertSize, const cMarkerPtrs & a_Markers);
 
 	/** Exports the specified block image, using the sizes and markers, and returns the PNG image data as a string. */
 	static AString Export(cBlockImage & a_Image, int a_HorzSize, int a_VertSize, const cMarkerPtrs & a_Markers);
 
+	/** Creates a new instance based on the BlockImage passed in.
+	Both a_Image and a_Markers are referenced, not copied; they must stay valid until the image is encoded. */
+	cPngExporter(cBlockImage & a_Image, int a_HorzSize, int a_VertSize, const cMarkerPtrs & a_Markers);
+
+	/** Draws the block image and the markers into the internal image.
+	Rendering and encoding are separate steps, so that they can be run by different stages of the batch pipeline. */
+	void Render(void);
+
+	/** Draws only the image rows from a_MinY (inclusive) to a_MaxY (exclusive). Drawing all the bands of an image
+	(possibly from multiple threads at once) produces the same image as Render(). The markers are not clipped,
+	so this can only be used for images without markers. */
+	void RenderRows(int a_MinY, int a_MaxY);
+
+	/** Returns the height of the resulting image, in pixels. */
+	int GetImgHeight(void) const { return m_ImgHeight; }
+
+	/** Returns the width of the resulting image, in pixels. */
+	int GetImgWidth(void) const { return m_ImgWidth; }
+
+	/** Encodes the rendered image as PNG and returns the PNG data. */
+	AString Encode(void);
+
 protected:
 	cBlockImage & m_BlockImage;
 	int m_HorzSize;
@@ -45,27 +71,25 @@ protected:
 	/** Vector of all markers to be drawn, sorted by the draw-index. */
 	const cMarkerPtrs & m_Markers;
 
-	/** Creates a new instance based on the BlockImage passed in. */
-	cPngExporter(cBlockImage & a_Image, int a_HorzSize, int a_VertSize, const cMarkerPtrs & a_Markers);
-
-	/** Exports m_BlockImage into m_Img and saves it to a string, which it returns. */
-	AString DoExport();
-
-	/** Draws all the cubes comprising the block image into m_Img, in the correct order. */
-	void DrawCubes(void);
+	/** Draws all the cubes comprising the block image into m_Img, in the correct order.
+	Only the image rows from a_ClipMinY (inclusive) to a_ClipMaxY (exclusive) are drawn. */
+	void DrawCubes(int a_ClipMinY, int a_ClipMaxY);
 
-	/** Draws a single column of the cubes into m_Img, in the correct order. */
-	void DrawCubesColumn(int a_ColumnX, int a_ColumnZ);
+	/** Draws a single column of the cubes into m_Img, in the correct order, clipped to the specified rows. */
+	void DrawCubesColumn(int a_ColumnX, int a_ColumnZ, int a_ClipMinY, int a_ClipMaxY);
 
-	/** Draws a single cube into the specified position in m_Img. */
-	void DrawSingleCube(int a_ImgX, int a_ImgY, Byte a_BlockType, Byte a_BlockMeta, bool a_DrawTopFace, bool a_DrawLeftFace, bool a_DrawRightFace);
+	/** Draws a single cube into the specified position in m_Img, clipped to the specified rows. */
+	void DrawSingleCube(
+		int a_ImgX, int a_ImgY, Byte a_BlockType, Byte a_BlockMeta, bool a_DrawTopFace, bool a_DrawLeftFace, bool a_DrawRightFace,
+		int a_ClipMinY, int a_ClipMaxY
+	);
 
 	/** Draws all markers from m_Markers that are in the specified block coords.
 	Uses and updates m_CurrentMarkerIdx in order to speed up the search for markers to be drawn. */
 	void DrawMarkersInCube(int a_ImgX, int a_ImgY, int a_BlockX, int a_BlockY, int a_BlockZ);
 
-	/** Sets the specified pixel to the specified color. */
-	void DrawPixel(int a_X, int a_Y, const png::rgba_pixel & a_Color);
+	/** Blends the specified color into the specified pixel, unless the pixel is outside the clip rows. */
+	void DrawPixel(int a_X, int a_Y, const png::rgba_pixel & a_Color, int a_ClipMinY, int a_ClipMaxY);
 
 	/** Returns the colors to be used for the specified block type. */
 	void GetBlockColors(
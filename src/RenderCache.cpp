@@ -0,0 +1,432 @@
+
+// RenderCache.cpp
+
+// Implements the cRenderCache class that caches the rendered PNG images in memory and on the disk
+
+#include "Globals.h"
+#include "RenderCache.h"
+#include "ContentHash.h"
+
+
+
+
+
+/** Extension of the disk tier files. */
+static const char DISK_FILE_EXT[] = ".rcache";
+
+/** Signature at the start of each disk tier file, followed by the key and a newline. */
+static const char DISK_FILE_SIGNATURE[] = "MCSchematicToPng render cache 1\n";
+
+/** Approximate per-item overhead of the memory tier (list node, map node, string headers), used for accounting. */
+static const size_t MEM_ITEM_OVERHEAD = 128;
+
+
+
+
+
+/** Returns true if a_Name starts with a disk tier file name, that is 16 hex digits followed by DISK_FILE_EXT. */
+static bool StartsWithDiskFileName(const AString & a_Name)
+{
+	const size_t ExtLen = sizeof(DISK_FILE_EXT) - 1;
+	if ((a_Name.size() < 16 + ExtLen) || (a_Name.compare(16, ExtLen, DISK_FILE_EXT) != 0))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < 16; i++)
+	{
+		if (!isxdigit(static_cast<unsigned char>(a_Name[i])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+/** Returns true if a_Name is a temporary file name as written by cRenderCache::AddToDisk(),
+that is a disk tier file name followed by ".<counter>.tmp". */
+static bool IsDiskTempFileName(const AString & a_Name)
+{
+	const size_t Start = 16 + sizeof(DISK_FILE_EXT) - 1;
+	static const char TempExt[] = ".tmp";
+	const size_t TempExtLen = sizeof(TempExt) - 1;
+	if (
+		!StartsWithDiskFileName(a_Name) ||
+		(a_Name.size() < Start + 2 + TempExtLen) ||  // At least "." and one digit before the ".tmp"
+		(a_Name[Start] != '.') ||
+		(a_Name.compare(a_Name.size() - TempExtLen, TempExtLen, TempExt) != 0)
+	)
+	{
+		return false;
+	}
+	for (size_t i = Start + 1; i < a_Name.size() - TempExtLen; i++)
+	{
+		if (!isdigit(static_cast<unsigned char>(a_Name[i])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+cRenderCache::cRenderCache(size_t a_MaxMemBytes, size_t a_MaxDiskBytes):
+	m_MemCache(a_MaxMemBytes),
+	m_DiskBytes(0),
+	m_MaxDiskBytes(a_MaxDiskBytes),
+	m_NumDiskHits(0),
+	m_NumDiskMisses(0),
+	m_NumDiskEvictions(0),
+	m_TempFileCounter(0)
+{
+}
+
+
+
+
+
+void cRenderCache::SetMaxMemSize(size_t a_MaxBytes)
+{
+	m_MemCache.SetMaxCost(a_MaxBytes);
+}
+
+
+
+
+
+void cRenderCache::SetMaxDiskSize(size_t a_MaxBytes)
+{
+	AStringVector FilesToDelete;
+	{
+		cCSLock Lock(m_CSDisk);
+		m_MaxDiskBytes = a_MaxBytes;
+		FilesToDelete = EvictDiskOverLimit();
+	}
+	for (const auto & FileName: FilesToDelete)
+	{
+		cFile::Delete(FileName);
+	}
+}
+
+
+
+
+
+bool cRenderCache::SetDiskFolder(const AString & a_Folder)
+{
+	if (a_Folder.empty())
+	{
+		cCSLock Lock(m_CSDisk);
+		m_DiskFolder.clear();
+		m_DiskItems.clear();
+		m_DiskMap.clear();
+		m_DiskBytes = 0;
+		return true;
+	}
+
+	AString Folder = a_Folder;
+	if ((Folder.back() != '/') && (Folder.back() != cFile::PathSeparator))
+	{
+		Folder.push_back(cFile::PathSeparator);
+	}
+	if (!cFile::IsFolder(Folder) && !cFile::CreateFolder(Folder))
+	{
+		LOGWARNING("Cannot create the render cache folder \"%s\".", Folder.c_str());
+		return false;
+	}
+
+	// Index the files already present, most recently modified first:
+	struct cFoundFile
+	{
+		UInt64 m_Hash;
+		size_t m_Size;
+		unsigned m_ModificationTime;
+	};
+	std::vector<cFoundFile> Found;
+	const size_t ExtLen = sizeof(DISK_FILE_EXT) - 1;
+	for (const auto & Name: cFile::GetFolderContents(Folder))
+	{
+		if (IsDiskTempFileName(Name))
+		{
+			// A leftover from an interrupted write
+			cFile::Delete(Folder + Name);
+			continue;
+		}
+		if ((Name.size() != 16 + ExtLen) || !StartsWithDiskFileName(Name))
+		{
+			continue;
+		}
+		char * End = nullptr;
+		UInt64 Hash = static_cast<UInt64>(strtoull(Name.c_str(), &End, 16));
+		int Size = cFile::GetSize(Folder + Name);
+		if ((End != Name.c_str() + 16) || (Size < 0))
+		{
+			continue;
+		}
+		Found.push_back({Hash, static_cast<size_t>(Size), cFile::GetLastModificationTime(Folder + Name)});
+	}
+	std::sort(Found.begin(), Found.end(), [](const cFoundFile & a_File1, const cFoundFile & a_File2)
+		{
+			return (a_File1.m_ModificationTime > a_File2.m_ModificationTime);
+		}
+	);
+
+	AStringVector FilesToDelete;
+	{
+		cCSLock Lock(m_CSDisk);
+		m_DiskFolder = Folder;
+		m_DiskItems.clear();
+		m_DiskMap.clear();
+		m_DiskBytes = 0;
+		for (const auto & File: Found)
+		{
+			m_DiskItems.push_back({File.m_Hash, File.m_Size});
+			m_DiskMap[File.m_Hash] = std::prev(m_DiskItems.end());
+			m_DiskBytes += File.m_Size;
+		}
+		FilesToDelete = EvictDiskOverLimit();
+	}
+	for (const auto & FileName: FilesToDelete)
+	{
+		cFile::Delete(FileName);
+	}
+	LOG("Render cache folder \"%s\" contains " SIZE_T_FMT " cached images.", Folder.c_str(), Found.size() - FilesToDelete.size());
+	return true;
+}
+
+
+
+
+
+bool cRenderCache::IsEnabled(void)
+{
+	if (m_MemCache.IsEnabled())
+	{
+		return true;
+	}
+	cCSLock Lock(m_CSDisk);
+	return (!m_DiskFolder.empty() && (m_MaxDiskBytes > 0));
+}
+
+
+
+
+
+cRenderCache::cStringPtr cRenderCache::Find(const AString & a_Key)
+{
+	auto res = m_MemCache.Find(a_Key);
+	if (res != nullptr)
+	{
+		return res;
+	}
+	AString PngData;
+	if (!FindOnDisk(a_Key, PngData))
+	{
+		return nullptr;
+	}
+
+	// Promote into the memory tier:
+	res = std::make_shared<AString>(Base64Encode(PngData));
+	m_MemCache.Add(a_Key, res, a_Key.size() + res->size() + MEM_ITEM_OVERHEAD);
+	return res;
+}
+
+
+
+
+
+void cRenderCache::Add(const AString & a_Key, const AString & a_PngData, const cStringPtr & a_Base64PngData)
+{
+	m_MemCache.Add(a_Key, a_Base64PngData, a_Key.size() + a_Base64PngData->size() + MEM_ITEM_OVERHEAD);
+	AddToDisk(a_Key, a_PngData);
+}
+
+
+
+
+
+cRenderCache::cStats cRenderCache::GetStats(void)
+{
+	auto MemStats = m_MemCache.GetStats();
+	cStats res;
+	res.m_NumMemHits = MemStats.m_NumHits;
+	res.m_NumMemMisses = MemStats.m_NumMisses;
+	res.m_NumMemEvictions = MemStats.m_NumEvictions;
+	res.m_NumMemEntries = MemStats.m_NumEntries;
+	res.m_NumMemBytes = MemStats.m_TotalCost;
+	res.m_MaxMemBytes = MemStats.m_MaxCost;
+
+	cCSLock Lock(m_CSDisk);
+	res.m_NumDiskHits = m_NumDiskHits;
+	res.m_NumDiskMisses = m_NumDiskMisses;
+	res.m_NumDiskEvictions = m_NumDiskEvictions;
+	res.m_NumDiskEntries = m_DiskMap.size();
+	res.m_NumDiskBytes = m_DiskBytes;
+	res.m_MaxDiskBytes = m_DiskFolder.empty() ? 0 : m_MaxDiskBytes;
+	return res;
+}
+
+
+
+
+
+bool cRenderCache::FindOnDisk(const AString & a_Key, AString & a_PngData)
+{
+	auto Hash = GetContentHash(a_Key);
+	AString FileName;
+	{
+		cCSLock Lock(m_CSDisk);
+		if (m_DiskFolder.empty())
+		{
+			return false;
+		}
+		auto itr = m_DiskMap.find(Hash);
+		if (itr == m_DiskMap.end())
+		{
+			m_NumDiskMisses += 1;
+			return false;
+		}
+		m_DiskItems.splice(m_DiskItems.begin(), m_DiskItems, itr->second);
+		FileName = m_DiskFolder + GetDiskFileName(Hash);
+	}
+
+	auto Contents = cFile::ReadWholeFile(FileName);
+	auto Header = GetDiskFileHeader(a_Key);
+	bool IsHit = (Contents.size() > Header.size()) && (Contents.compare(0, Header.size(), Header) == 0);
+	cCSLock Lock(m_CSDisk);
+	if (!IsHit)
+	{
+		m_NumDiskMisses += 1;
+		if (Contents.empty())
+		{
+			// The file has disappeared (deleted externally, or evicted meanwhile), drop it from the index:
+			auto itr = m_DiskMap.find(Hash);
+			if (itr != m_DiskMap.end())
+			{
+				m_DiskBytes -= itr->second->m_Size;
+				m_DiskItems.erase(itr->second);
+				m_DiskMap.erase(itr);
+			}
+		}
+		return false;
+	}
+	m_NumDiskHits += 1;
+	a_PngData.assign(Contents, Header.size(), AString::npos);
+	return true;
+}
+
+
+
+
+
+void cRenderCache::AddToDisk(const AString & a_Key, const AString & a_PngData)
+{
+	auto Hash = GetContentHash(a_Key);
+	auto Header = GetDiskFileHeader(a_Key);
+	size_t Size = Header.size() + a_PngData.size();
+	AString FileName, TempFileName;
+	{
+		cCSLock Lock(m_CSDisk);
+		if (m_DiskFolder.empty() || (Size > m_MaxDiskBytes) || (m_DiskMap.find(Hash) != m_DiskMap.end()))
+		{
+			return;
+		}
+		FileName = m_DiskFolder + GetDiskFileName(Hash);
+		m_TempFileCounter += 1;
+		TempFileName = Printf("%s.%llu.tmp", FileName.c_str(), static_cast<unsigned long long>(m_TempFileCounter));
+	}
+
+	// Write into a temporary file and rename, so that readers never see a partially written file:
+	{
+		cFile f(TempFileName, cFile::fmWrite);
+		if (
+			!f.IsOpen() ||
+			(f.Write(Header.data(), Header.size()) != static_cast<int>(Header.size())) ||
+			(f.Write(a_PngData.data(), a_PngData.size()) != static_cast<int>(a_PngData.size()))
+		)
+		{
+			LOGWARNING("Cannot write render cache file \"%s\".", TempFileName.c_str());
+			f.Close();
+			cFile::Delete(TempFileName);
+			return;
+		}
+	}
+	cFile::Delete(FileName);  // Rename() may fail if the destination exists
+	if (!cFile::Rename(TempFileName, FileName))
+	{
+		LOGWARNING("Cannot rename render cache file \"%s\" to \"%s\".", TempFileName.c_str(), FileName.c_str());
+		cFile::Delete(TempFileName);
+		return;
+	}
+
+	AStringVector FilesToDelete;
+	{
+		cCSLock Lock(m_CSDisk);
+		auto itr = m_DiskMap.find(Hash);
+		if (itr != m_DiskMap.end())
+		{
+			// Another thread has added the same item meanwhile
+			m_DiskBytes -= itr->second->m_Size;
+			m_DiskItems.erase(itr->second);
+			m_DiskMap.erase(itr);
+		}
+		m_DiskItems.push_front({Hash, Size});
+		m_DiskMap[Hash] = m_DiskItems.begin();
+		m_DiskBytes += Size;
+		FilesToDelete = EvictDiskOverLimit();
+	}
+	for (const auto & DelFileName: FilesToDelete)
+	{
+		cFile::Delete(DelFileName);
+	}
+}
+
+
+
+
+
+AStringVector cRenderCache::EvictDiskOverLimit(void)
+{
+	AStringVector res;
+	while ((m_DiskBytes > m_MaxDiskBytes) && !m_DiskItems.empty())
+	{
+		const auto & Item = m_DiskItems.back();
+		res.push_back(m_DiskFolder + GetDiskFileName(Item.m_Hash));
+		m_DiskBytes -= Item.m_Size;
+		m_DiskMap.erase(Item.m_Hash);
+		m_DiskItems.pop_back();
+		m_NumDiskEvictions += 1;
+	}
+	return res;
+}
+
+
+
+
+
+AString cRenderCache::GetDiskFileName(UInt64 a_Hash)
+{
+	return Printf("%016llx%s", static_cast<unsigned long long>(a_Hash), DISK_FILE_EXT);
+}
+
+
+
+
+
+AString cRenderCache::GetDiskFileHeader(const AString & a_Key)
+{
+	AString res(DISK_FILE_SIGNATURE);
+	res.append(a_Key);
+	res.push_back('\n');
+	return res;
+}
+
+
+
+
@@ -0,0 +1,136 @@
+
+// RenderCache.h
+
+// Declares the cRenderCache class that caches the rendered PNG images in memory and on the disk
+
+/*
+The cache is keyed by a string that identifies the schematic data and all the params that affect the rendered
+image; building the key is the caller's responsibility.
+There are two tiers:
+	- Memory: a cost-bounded LRU of the Base64-ed PNG data, ready to be sent to the client
+	- Disk (optional): a size-bounded folder of the raw PNG data, one file per key, surviving restarts.
+	The files are named by the key's hash and start with the whole key, so that hash collisions are detected.
+	The folder's index is kept in memory; it is rebuilt on startup, ordered by the files' modification time.
+A disk hit is promoted into the memory tier; a new render is stored in both tiers.
+*/
+
+
+
+
+
+#pragma once
+
+#include <unordered_map>
+#include "LruCache.h"
+
+
+
+
+
+class cRenderCache
+{
+public:
+	typedef std::shared_ptr<const AString> cStringPtr;
+
+	/** The statistics of the cache usage, per tier. */
+	struct cStats
+	{
+		UInt64 m_NumMemHits;
+		UInt64 m_NumMemMisses;
+		UInt64 m_NumMemEvictions;
+		size_t m_NumMemEntries;
+		size_t m_NumMemBytes;
+		size_t m_MaxMemBytes;
+		UInt64 m_NumDiskHits;
+		UInt64 m_NumDiskMisses;
+		UInt64 m_NumDiskEvictions;
+		size_t m_NumDiskEntries;
+		size_t m_NumDiskBytes;
+		size_t m_MaxDiskBytes;
+	};
+
+
+	cRenderCache(size_t a_MaxMemBytes, size_t a_MaxDiskBytes);
+
+	/** Sets the memory budget of the memory tier, in bytes. 0 disables the memory tier. */
+	void SetMaxMemSize(size_t a_MaxBytes);
+
+	/** Sets the size limit of the disk tier, in bytes. Deletes the least recently used files if over the limit. */
+	void SetMaxDiskSize(size_t a_MaxBytes);
+
+	/** Sets the folder to use for the disk tier, creating it if needed, and indexes the files already present in it.
+	An empty folder name disables the disk tier. Returns false if the folder cannot be used. */
+	bool SetDiskFolder(const AString & a_Folder);
+
+	/** Returns true if at least one of the tiers can store anything. */
+	bool IsEnabled(void);
+
+	/** Returns the Base64-ed PNG data stored for the specified key, or nullptr if not cached. */
+	cStringPtr Find(const AString & a_Key);
+
+	/** Stores the rendered image for the specified key into both tiers.
+	a_PngData is the raw PNG data, a_Base64PngData is the same data Base64-ed. */
+	void Add(const AString & a_Key, const AString & a_PngData, const cStringPtr & a_Base64PngData);
+
+	/** Returns the current statistics. */
+	cStats GetStats(void);
+
+protected:
+	/** A single file in the disk tier. */
+	struct cDiskItem
+	{
+		UInt64 m_Hash;
+		size_t m_Size;
+	};
+
+	typedef std::list<cDiskItem> cDiskItems;
+
+
+	/** The memory tier. */
+	cLruCache<AString, AString> m_MemCache;
+
+	/** Protects all the disk tier's member variables against multithreaded access.
+	The file operations themselves are done outside of the lock. */
+	cCriticalSection m_CSDisk;
+
+	/** The folder for the disk tier, including the trailing path separator. Empty if the disk tier is disabled. */
+	AString m_DiskFolder;
+
+	/** The files in the disk tier, ordered from the most recently used one to the least recently used one. */
+	cDiskItems m_DiskItems;
+
+	/** Maps the key hashes to their items in m_DiskItems. */
+	std::unordered_map<UInt64, cDiskItems::iterator> m_DiskMap;
+
+	size_t m_DiskBytes;
+	size_t m_MaxDiskBytes;
+	UInt64 m_NumDiskHits;
+	UInt64 m_NumDiskMisses;
+	UInt64 m_NumDiskEvictions;
+
+	/** Counter used for naming the temporary files, so that concurrent writers never share one. */
+	UInt64 m_TempFileCounter;
+
+
+	/** Reads the PNG data for the specified key from the disk tier into a_PngData.
+	Returns true on a hit, false on a miss (or if the disk tier is disabled). */
+	bool FindOnDisk(const AString & a_Key, AString & a_PngData);
+
+	/** Writes the PNG data for the specified key into the disk tier, unless already present there. */
+	void AddToDisk(const AString & a_Key, const AString & a_PngData);
+
+	/** Removes the least recently used items from the disk index until the total size is within the limit.
+	Returns the names of the files to delete; the caller deletes them after unlocking m_CSDisk.
+	Expects m_CSDisk to be locked. */
+	AStringVector EvictDiskOverLimit(void);
+
+	/** Returns the name of the disk tier file for the specified key hash, without the folder. */
+	static AString GetDiskFileName(UInt64 a_Hash);
+
+	/** Returns the header written at the start of each disk tier file, identifying the key. */
+	static AString GetDiskFileHeader(const AString & a_Key);
+};
+
+
+
+
@@ -0,0 +1,72 @@
+
+// Schematic.cpp
+
+// Implements the cSchematic class representing the decoded block data of a whole schematic
+
+#include "Globals.h"
+#include "Schematic.h"
+#include "BlockImage.h"
+#include "SchematicParser.h"
+
+
+
+
+
+cSchematic::cSchematic(int a_SizeX, int a_SizeY, int a_SizeZ):
+	m_SizeX(a_SizeX),
+	m_SizeY(a_SizeY),
+	m_SizeZ(a_SizeZ),
+	m_BlockTypes(static_cast<size_t>(a_SizeX) * static_cast<size_t>(a_SizeY) * static_cast<size_t>(a_SizeZ)),
+	m_BlockMetas(m_BlockTypes.size())
+{
+}
+
+
+
+
+
+cSchematic::cSchematic(const cSchematicParser & a_Parser):
+	m_SizeX(a_Parser.GetSizeX()),
+	m_SizeY(a_Parser.GetSizeY()),
+	m_SizeZ(a_Parser.GetSizeZ())
+{
+	ASSERT(a_Parser.IsValid());
+	size_t NumBlocks = static_cast<size_t>(m_SizeX) * static_cast<size_t>(m_SizeY) * static_cast<size_t>(m_SizeZ);
+	auto Types = a_Parser.GetBlockTypes();
+	auto Metas = a_Parser.GetBlockMetas();
+	m_BlockTypes.assign(Types, Types + NumBlocks);
+	m_BlockMetas.resize(NumBlocks);
+	for (size_t i = 0; i < NumBlocks; i++)
+	{
+		m_BlockMetas[i] = Metas[i] & 0x0f;
+	}
+}
+
+
+
+
+
+void cSchematic::CopyToImage(cBlockImage & a_Image, int a_StartX, int a_StartY, int a_StartZ) const
+{
+	int SizeX = a_Image.GetSizeX();
+	int SizeY = a_Image.GetSizeY();
+	int SizeZ = a_Image.GetSizeZ();
+	ASSERT(a_StartX + SizeX <= m_SizeX);
+	ASSERT(a_StartY + SizeY <= m_SizeY);
+	ASSERT(a_StartZ + SizeZ <= m_SizeZ);
+	for (int y = 0; y < SizeY; y++)
+	{
+		for (int z = 0; z < SizeZ; z++)
+		{
+			for (int x = 0; x < SizeX; x++)
+			{
+				size_t idx = static_cast<size_t>(a_StartX + x) + static_cast<size_t>(a_StartZ + z) * static_cast<size_t>(m_SizeX) + static_cast<size_t>(a_StartY + y) * static_cast<size_t>(m_SizeX) * static_cast<size_t>(m_SizeZ);
+				a_Image.SetBlock(x, y, z, m_BlockTypes[idx], m_BlockMetas[idx]);
+			}
+		}
+	}
+}
+
+
+
+
@@ -0,0 +1,74 @@
+
+// Schematic.h
+
+// Declares the cSchematic class representing the decoded block data of a whole schematic
+
+
+
+
+
+#pragma once
+
+
+
+
+
+// fwd:
+class cBlockImage;
+class cSchematicParser;
+
+
+
+
+
+/** The block data of a whole schematic, decoded from its file format.
+The blocks are stored as block type and block meta arrays, indexed by [x + z * SizeX + y * SizeX * SizeZ].
+Once filled, the object is not modified anymore, so it can be shared among multiple renders (and threads). */
+class cSchematic
+{
+public:
+	/** The maximum size along any axis accepted by the loaders of the formats that store the sizes as ints. */
+	static const int MAX_DIMENSION = 65535;
+
+	/** The maximum number of blocks accepted by the loaders that combine several parts (regions, chunks) into one schematic.
+	Protects against far-apart parts (or malicious sizes) requiring an enormous allocation. */
+	static const size_t MAX_VOLUME = static_cast<size_t>(1) << 31;
+
+	/** Creates a new schematic of the specified size, filled with air. */
+	cSchematic(int a_SizeX, int a_SizeY, int a_SizeZ);
+
+	/** Creates a new schematic with the data extracted by the specified (valid) parser. */
+	cSchematic(const cSchematicParser & a_Parser);
+
+	int GetSizeX(void) const { return m_SizeX; }
+	int GetSizeY(void) const { return m_SizeY; }
+	int GetSizeZ(void) const { return m_SizeZ; }
+
+	size_t GetNumBlocks(void) const { return m_BlockTypes.size(); }
+
+	const Byte * GetBlockTypes(void) const { return m_BlockTypes.data(); }
+	const Byte * GetBlockMetas(void) const { return m_BlockMetas.data(); }
+	Byte * GetBlockTypes(void) { return m_BlockTypes.data(); }
+	Byte * GetBlockMetas(void) { return m_BlockMetas.data(); }
+
+	/** Returns the approximate amount of memory used by this object, in bytes. */
+	size_t GetMemoryUsage(void) const { return sizeof(*this) + m_BlockTypes.capacity() + m_BlockMetas.capacity(); }
+
+	/** Copies the blocks starting at the specified coords into a_Image, filling the whole image.
+	The caller is responsible for the image fitting inside the schematic. */
+	void CopyToImage(cBlockImage & a_Image, int a_StartX, int a_StartY, int a_StartZ) const;
+
+protected:
+	int m_SizeX;
+	int m_SizeY;
+	int m_SizeZ;
+	std::vector<Byte> m_BlockTypes;
+	std::vector<Byte> m_BlockMetas;
+};
+
+typedef std::shared_ptr<cSchematic> cSchematicPtr;
+typedef std::shared_ptr<const cSchematic> cSchematicConstPtr;
+
+
+
+
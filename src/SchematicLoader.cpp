@@ -0,0 +1,663 @@
+
+// SchematicLoader.cpp
+
+// Implements the cSchematicLoader class that decodes the schematic data in any of the supported formats into a cSchematic
+
+#include "Globals.h"
+#include "SchematicLoader.h"
+#include "SchematicParser.h"
+#include "BlockStates.h"
+#include "WorldStorage/FastNBT.h"
+
+
+
+
+
+/** The maximum palette index accepted in the Sponge palettes. Real-world palettes have at most a few thousand entries. */
+static const Int32 MAX_SPONGE_PALETTE_INDEX = 1 << 20;
+
+/** The maximum palette size accepted in the Litematica and structure palettes. */
+static const size_t MAX_PALETTE_SIZE = 1 << 20;
+
+
+
+
+
+
+/** Decodes the varint-encoded palette indices in a_Data into the blocks of a_Schematic, mapping them through a_Palette.
+Returns false if the data is malformed, too short, or references an index outside of the palette. */
+static bool DecodeVarIntBlocks(const Byte * a_Data, size_t a_Length, const std::vector<cLegacyBlock> & a_Palette, cSchematic & a_Schematic)
+{
+	auto Types = a_Schematic.GetBlockTypes();
+	auto Metas = a_Schematic.GetBlockMetas();
+	size_t NumBlocks = a_Schematic.GetNumBlocks();
+	size_t PaletteSize = a_Palette.size();
+	size_t Pos = 0;
+	size_t Idx = 0;
+	while (Idx < NumBlocks)
+	{
+		// Fast path: with palettes smaller than 128 entries (the usual case), each index is a single byte.
+		// Check 8 bytes at a time for the continuation bits and map all eight indices without any varint decoding:
+		if ((Idx + 8 <= NumBlocks) && (Pos + 8 <= a_Length))
+		{
+			UInt64 Word;
+			memcpy(&Word, a_Data + Pos, sizeof(Word));
+			if ((Word & 0x8080808080808080ULL) == 0)
+			{
+				for (size_t i = 0; i < 8; i++)
+				{
+					size_t Index = a_Data[Pos + i];
+					if (Index >= PaletteSize)
+					{
+						return false;
+					}
+					Types[Idx + i] = a_Palette[Index].m_BlockType;
+					Metas[Idx + i] = a_Palette[Index].m_BlockMeta;
+				}
+				Pos += 8;
+				Idx += 8;
+				continue;
+			}
+		}
+
+		// Generic varint, 7 bits per byte, least significant group first:
+		UInt32 Index = 0;
+		for (int Shift = 0;; Shift += 7)
+		{
+			if ((Pos >= a_Length) || (Shift > 28))
+			{
+				return false;
+			}
+			Byte b = a_Data[Pos++];
+			Index |= static_cast<UInt32>(b & 0x7f) << Shift;
+			if ((b & 0x80) == 0)
+			{
+				break;
+			}
+		}
+		if (Index >= PaletteSize)
+		{
+			return false;
+		}
+		Types[Idx] = a_Palette[Index].m_BlockType;
+		Metas[Idx] = a_Palette[Index].m_BlockMeta;
+		Idx++;
+	}
+	return true;
+}
+
+
+
+
+
+/** Reads the x, y and z Int children of the specified compound, such as Litematica's Position or Size.
+Returns false if the tag is not a compound or any of the coords is missing. */
+static bool ReadCoords(const cParsedNBT & a_NBT, int a_Tag, int (&a_Coords)[3])
+{
+	if ((a_Tag < 0) || (a_NBT.GetType(a_Tag) != TAG_Compound))
+	{
+		return false;
+	}
+	static const char * const CoordNames[3] = {"x", "y", "z"};
+	for (int i = 0; i < 3; i++)
+	{
+		int Tag = a_NBT.FindChildByName(a_Tag, CoordNames[i]);
+		if ((Tag < 0) || (a_NBT.GetType(Tag) != TAG_Int))
+		{
+			return false;
+		}
+		a_Coords[i] = a_NBT.GetInt(Tag);
+	}
+	return true;
+}
+
+
+
+
+
+/** Reads the three Int items of the specified List tag, such as the vanilla structure's size or block pos.
+Returns false if the tag is not a list of three ints. */
+static bool ReadCoordsList(const cParsedNBT & a_NBT, int a_Tag, int (&a_Coords)[3])
+{
+	if ((a_Tag < 0) || (a_NBT.GetType(a_Tag) != TAG_List))
+	{
+		return false;
+	}
+	int Item = a_NBT.GetFirstChild(a_Tag);
+	for (int i = 0; i < 3; i++)
+	{
+		if ((Item < 0) || (a_NBT.GetType(Item) != TAG_Int))
+		{
+			return false;
+		}
+		a_Coords[i] = a_NBT.GetInt(Item);
+		Item = a_NBT.GetNextSibling(Item);
+	}
+	return true;
+}
+
+
+
+
+
+/** Finds the named tag of the specified type in the raw NBT data, starting at a_Start.
+Returns the position of the tag's payload, or AString::npos if not found. The tag's name is matched as raw bytes,
+so this may find false positives in binary data; it is only meant for cheap estimates. */
+static size_t FindRawTag(const AString & a_Data, eTagType a_Type, const char * a_Name, size_t a_Start = 0)
+{
+	size_t NameLength = strlen(a_Name);
+	AString Header;
+	Header.push_back(static_cast<char>(a_Type));
+	Header.push_back(static_cast<char>(NameLength >> 8));
+	Header.push_back(static_cast<char>(NameLength & 0xff));
+	Header.append(a_Name);
+	size_t Pos = a_Data.find(Header, a_Start);
+	return (Pos == AString::npos) ? Pos : Pos + Header.size();
+}
+
+
+
+
+
+/** Returns true if a payload of a_Size bytes fits into the data at a_Pos, as returned by FindRawTag(). */
+static bool HasRawPayload(const AString & a_Data, size_t a_Pos, size_t a_Size)
+{
+	return ((a_Pos != AString::npos) && (a_Pos + a_Size <= a_Data.size()));
+}
+
+
+
+
+
+bool cSchematicLoader::PeekSize(const char * a_Data, size_t a_Length, int & a_SizeX, int & a_SizeY, int & a_SizeZ)
+{
+	AString Data(a_Data, a_Length);
+
+	// MCEdit and Sponge: Width, Height, Length shorts, unsigned in Sponge:
+	size_t PosX = FindRawTag(Data, TAG_Short, "Width");
+	size_t PosY = FindRawTag(Data, TAG_Short, "Height");
+	size_t PosZ = FindRawTag(Data, TAG_Short, "Length");
+	if (HasRawPayload(Data, PosX, 2) && HasRawPayload(Data, PosY, 2) && HasRawPayload(Data, PosZ, 2))
+	{
+		a_SizeX = static_cast<UInt16>(GetBEShort(a_Data + PosX));
+		a_SizeY = static_cast<UInt16>(GetBEShort(a_Data + PosY));
+		a_SizeZ = static_cast<UInt16>(GetBEShort(a_Data + PosZ));
+		return true;
+	}
+
+	// Litematica: the EnclosingSize compound of x, y, z ints in the metadata:
+	size_t EnclosingSize = FindRawTag(Data, TAG_Compound, "EnclosingSize");
+	if (EnclosingSize != AString::npos)
+	{
+		PosX = FindRawTag(Data, TAG_Int, "x", EnclosingSize);
+		PosY = FindRawTag(Data, TAG_Int, "y", EnclosingSize);
+		PosZ = FindRawTag(Data, TAG_Int, "z", EnclosingSize);
+		if (HasRawPayload(Data, PosX, 4) && HasRawPayload(Data, PosY, 4) && HasRawPayload(Data, PosZ, 4))
+		{
+			a_SizeX = std::abs(GetBEInt(a_Data + PosX));
+			a_SizeY = std::abs(GetBEInt(a_Data + PosY));
+			a_SizeZ = std::abs(GetBEInt(a_Data + PosZ));
+			return true;
+		}
+	}
+
+	// Vanilla structure: the size list of 3 ints; may be stored after the (large) blocks list, out of the peeked data:
+	size_t SizeList = FindRawTag(Data, TAG_List, "size");
+	if (
+		HasRawPayload(Data, SizeList, 5 + 3 * 4) &&
+		(Data[SizeList] == TAG_Int) &&
+		(GetBEInt(a_Data + SizeList + 1) == 3)
+	)
+	{
+		a_SizeX = std::abs(GetBEInt(a_Data + SizeList + 5));
+		a_SizeY = std::abs(GetBEInt(a_Data + SizeList + 9));
+		a_SizeZ = std::abs(GetBEInt(a_Data + SizeList + 13));
+		return true;
+	}
+	return false;
+}
+
+
+
+
+
+cSchematicPtr cSchematicLoader::Load(const char * a_Data, size_t a_Length, AString & a_ErrorMsg)
+{
+	// MCEdit .schematic is the most common format and has a dedicated fast parser:
+	cSchematicParser Parser(a_Data, a_Length);
+	if (Parser.IsValid())
+	{
+		return std::make_shared<cSchematic>(Parser);
+	}
+	return LoadOtherFormats(a_Data, a_Length, Parser.GetErrorMsg(), a_ErrorMsg);
+}
+
+
+
+
+
+cSchematicPtr cSchematicLoader::LoadOtherFormats(const char * a_Data, size_t a_Length, const AString & a_MCEditErrorMsg, AString & a_ErrorMsg)
+{
+	cParsedNBT NBT(a_Data, a_Length);
+	if (!NBT.IsValid())
+	{
+		if (NBT.GetErrorPos() == 0)
+		{
+			a_ErrorMsg = "Cannot NBT-parse the data, it doesn't start with a Compound tag.";
+		}
+		else
+		{
+			a_ErrorMsg = Printf("Cannot NBT-parse the data, it is malformed or truncated at offset " SIZE_T_FMT " of " SIZE_T_FMT ".",
+				NBT.GetErrorPos(), a_Length
+			);
+		}
+		return nullptr;
+	}
+	int Root = NBT.GetRoot();
+
+	// Sponge v3 has all the data in a "Schematic" compound inside the root:
+	int SpongeV3 = NBT.FindChildByName(Root, "Schematic");
+	if ((SpongeV3 >= 0) && (NBT.GetType(SpongeV3) == TAG_Compound) && (NBT.FindChildByName(SpongeV3, "Version") >= 0))
+	{
+		return LoadSponge(NBT, SpongeV3, a_ErrorMsg);
+	}
+
+	// Litematica has one or more regions:
+	int Regions = NBT.FindChildByName(Root, "Regions");
+	if ((Regions >= 0) && (NBT.GetType(Regions) == TAG_Compound))
+	{
+		return LoadLitematica(NBT, Regions, a_ErrorMsg);
+	}
+
+	// Vanilla structures have a sparse list of blocks:
+	int Blocks = NBT.FindChildByName(Root, "blocks");
+	if ((Blocks >= 0) && (NBT.GetType(Blocks) == TAG_List) && (NBT.FindChildByName(Root, "size") >= 0))
+	{
+		return LoadStructure(NBT, Root, a_ErrorMsg);
+	}
+
+	// Sponge v1 and v2 have the data directly in the root:
+	if ((NBT.FindChildByName(Root, "Version") >= 0) && (NBT.FindChildByName(Root, "Palette") >= 0))
+	{
+		return LoadSponge(NBT, Root, a_ErrorMsg);
+	}
+
+	a_ErrorMsg = a_MCEditErrorMsg;
+	return nullptr;
+}
+
+
+
+
+
+bool cSchematicLoader::ReadBlockStatePalette(const cParsedNBT & a_NBT, int a_PaletteTag, std::vector<cLegacyBlock> & a_Palette)
+{
+	a_Palette.clear();
+	if ((a_PaletteTag < 0) || (a_NBT.GetType(a_PaletteTag) != TAG_List))
+	{
+		return false;
+	}
+	AString Properties;
+	for (int Entry = a_NBT.GetFirstChild(a_PaletteTag); Entry >= 0; Entry = a_NBT.GetNextSibling(Entry))
+	{
+		if ((a_NBT.GetType(Entry) != TAG_Compound) || (a_Palette.size() >= MAX_PALETTE_SIZE))
+		{
+			return false;
+		}
+		int NameTag = a_NBT.FindChildByName(Entry, "Name");
+		if ((NameTag < 0) || (a_NBT.GetType(NameTag) != TAG_String))
+		{
+			return false;
+		}
+
+		// Join the properties into the blockstate syntax, "name1=value1,name2=value2":
+		Properties.clear();
+		int PropsTag = a_NBT.FindChildByName(Entry, "Properties");
+		if ((PropsTag >= 0) && (a_NBT.GetType(PropsTag) == TAG_Compound))
+		{
+			for (int Prop = a_NBT.GetFirstChild(PropsTag); Prop >= 0; Prop = a_NBT.GetNextSibling(Prop))
+			{
+				if (a_NBT.GetType(Prop) != TAG_String)
+				{
+					continue;
+				}
+				if (!Properties.empty())
+				{
+					Properties.push_back(',');
+				}
+				Properties.append(a_NBT.GetName(Prop));
+				Properties.push_back('=');
+				Properties.append(a_NBT.GetString(Prop));
+			}
+		}
+		a_Palette.push_back(BlockStateToLegacy(a_NBT.GetString(NameTag), Properties));
+	}
+	return true;
+}
+
+
+
+
+
+cSchematicPtr cSchematicLoader::LoadSponge(const cParsedNBT & a_NBT, int a_SchematicTag, AString & a_ErrorMsg)
+{
+	int VersionTag = a_NBT.FindChildByName(a_SchematicTag, "Version");
+	int Version = ((VersionTag >= 0) && (a_NBT.GetType(VersionTag) == TAG_Int)) ? a_NBT.GetInt(VersionTag) : 1;
+
+	// The dimensions are unsigned shorts:
+	int Sizes[3];
+	static const char * const SizeNames[3] = {"Width", "Height", "Length"};
+	for (int i = 0; i < 3; i++)
+	{
+		int Tag = a_NBT.FindChildByName(a_SchematicTag, SizeNames[i]);
+		if ((Tag < 0) || (a_NBT.GetType(Tag) != TAG_Short))
+		{
+			a_ErrorMsg = "Sponge schematic doesn't contain dimensions!";
+			return nullptr;
+		}
+		Sizes[i] = static_cast<UInt16>(a_NBT.GetShort(Tag));
+	}
+
+	// v3 has the palette and the block data in a "Blocks" compound, v1 and v2 directly in the schematic:
+	int PaletteTag, DataTag;
+	if (Version >= 3)
+	{
+		int BlocksTag = a_NBT.FindChildByName(a_SchematicTag, "Blocks");
+		if ((BlocksTag < 0) || (a_NBT.GetType(BlocksTag) != TAG_Compound))
+		{
+			a_ErrorMsg = "Sponge schematic doesn't contain block data!";
+			return nullptr;
+		}
+		PaletteTag = a_NBT.FindChildByName(BlocksTag, "Palette");
+		DataTag = a_NBT.FindChildByName(BlocksTag, "Data");
+	}
+	else
+	{
+		PaletteTag = a_NBT.FindChildByName(a_SchematicTag, "Palette");
+		DataTag = a_NBT.FindChildByName(a_SchematicTag, "BlockData");
+	}
+	if (
+		(PaletteTag < 0) || (a_NBT.GetType(PaletteTag) != TAG_Compound) ||
+		(DataTag < 0) || (a_NBT.GetType(DataTag) != TAG_ByteArray)
+	)
+	{
+		a_ErrorMsg = "Sponge schematic doesn't contain block data or palette!";
+		return nullptr;
+	}
+
+	// Map the palette onto legacy blocks, once per entry:
+	std::vector<cLegacyBlock> Palette;
+	for (int Entry = a_NBT.GetFirstChild(PaletteTag); Entry >= 0; Entry = a_NBT.GetNextSibling(Entry))
+	{
+		if (a_NBT.GetType(Entry) != TAG_Int)
+		{
+			continue;
+		}
+		Int32 Index = a_NBT.GetInt(Entry);
+		if ((Index < 0) || (Index > MAX_SPONGE_PALETTE_INDEX))
+		{
+			a_ErrorMsg = Printf("Sponge schematic contains an invalid palette index: %d", Index);
+			return nullptr;
+		}
+		if (static_cast<size_t>(Index) >= Palette.size())
+		{
+			// Indices missing from the palette are rendered as air:
+			cLegacyBlock Air = {0, 0};
+			Palette.resize(static_cast<size_t>(Index) + 1, Air);
+		}
+		Palette[static_cast<size_t>(Index)] = BlockStateStringToLegacy(a_NBT.GetName(Entry));
+	}
+
+	// Each block takes at least one byte of data, check before allocating the schematic:
+	size_t NumBlocks = static_cast<size_t>(Sizes[0]) * static_cast<size_t>(Sizes[1]) * static_cast<size_t>(Sizes[2]);
+	size_t DataLength = a_NBT.GetDataLength(DataTag);
+	if (DataLength < NumBlocks)
+	{
+		a_ErrorMsg = Printf("Sponge schematic block data is too short for the dimensions {%d, %d, %d} (" SIZE_T_FMT " bytes)!",
+			Sizes[0], Sizes[1], Sizes[2], DataLength
+		);
+		return nullptr;
+	}
+	auto res = std::make_shared<cSchematic>(Sizes[0], Sizes[1], Sizes[2]);
+	if (!DecodeVarIntBlocks(reinterpret_cast<const Byte *>(a_NBT.GetData(DataTag)), DataLength, Palette, *res))
+	{
+		a_ErrorMsg = "Sponge schematic block data is malformed or references blocks outside of the palette!";
+		return nullptr;
+	}
+	return res;
+}
+
+
+
+
+
+cSchematicPtr cSchematicLoader::LoadLitematica(const cParsedNBT & a_NBT, int a_RegionsTag, AString & a_ErrorMsg)
+{
+	// Find all the regions, normalize their negative sizes and compute the bounding box of them all:
+	struct cRegion
+	{
+		int m_Min[3];
+		int m_Size[3];
+		int m_PaletteTag;
+		int m_BlockStatesTag;
+	};
+	std::vector<cRegion> Regions;
+	int BoundsMin[3] = {0, 0, 0};
+	int BoundsMax[3] = {0, 0, 0};  // Exclusive
+	for (int RegionTag = a_NBT.GetFirstChild(a_RegionsTag); RegionTag >= 0; RegionTag = a_NBT.GetNextSibling(RegionTag))
+	{
+		if (a_NBT.GetType(RegionTag) != TAG_Compound)
+		{
+			continue;
+		}
+		int Pos[3], Size[3];
+		if (
+			!ReadCoords(a_NBT, a_NBT.FindChildByName(RegionTag, "Position"), Pos) ||
+			!ReadCoords(a_NBT, a_NBT.FindChildByName(RegionTag, "Size"), Size)
+		)
+		{
+			a_ErrorMsg = Printf("Litematica region \"%s\" doesn't contain its position or size!", a_NBT.GetName(RegionTag).c_str());
+			return nullptr;
+		}
+		cRegion Region;
+		bool IsEmpty = false;
+		for (int i = 0; i < 3; i++)
+		{
+			// A negative size means that the region extends from the position towards the minus side:
+			if ((Size[i] < -cSchematic::MAX_DIMENSION) || (Size[i] > cSchematic::MAX_DIMENSION) || (std::abs(Pos[i]) > (1 << 30)))
+			{
+				a_ErrorMsg = Printf("Litematica region \"%s\" has an invalid position or size!", a_NBT.GetName(RegionTag).c_str());
+				return nullptr;
+			}
+			Region.m_Min[i] = (Size[i] < 0) ? Pos[i] + Size[i] + 1 : Pos[i];
+			Region.m_Size[i] = std::abs(Size[i]);
+			IsEmpty = IsEmpty || (Size[i] == 0);
+		}
+		if (IsEmpty)
+		{
+			continue;
+		}
+		Region.m_PaletteTag = a_NBT.FindChildByName(RegionTag, "BlockStatePalette");
+		Region.m_BlockStatesTag = a_NBT.FindChildByName(RegionTag, "BlockStates");
+		if ((Region.m_BlockStatesTag < 0) || (a_NBT.GetType(Region.m_BlockStatesTag) != TAG_LongArray))
+		{
+			a_ErrorMsg = Printf("Litematica region \"%s\" doesn't contain block data!", a_NBT.GetName(RegionTag).c_str());
+			return nullptr;
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			BoundsMin[i] = Regions.empty() ? Region.m_Min[i] : std::min(BoundsMin[i], Region.m_Min[i]);
+			BoundsMax[i] = Regions.empty() ? Region.m_Min[i] + Region.m_Size[i] : std::max(BoundsMax[i], Region.m_Min[i] + Region.m_Size[i]);
+		}
+		Regions.push_back(Region);
+	}
+	if (Regions.empty())
+	{
+		a_ErrorMsg = "Litematica schematic doesn't contain any regions!";
+		return nullptr;
+	}
+	int Sizes[3];
+	for (int i = 0; i < 3; i++)
+	{
+		Sizes[i] = BoundsMax[i] - BoundsMin[i];
+	}
+	if (
+		(Sizes[0] > cSchematic::MAX_DIMENSION) || (Sizes[1] > cSchematic::MAX_DIMENSION) || (Sizes[2] > cSchematic::MAX_DIMENSION) ||
+		(static_cast<size_t>(Sizes[0]) * static_cast<size_t>(Sizes[1]) * static_cast<size_t>(Sizes[2]) > cSchematic::MAX_VOLUME)
+	)
+	{
+		a_ErrorMsg = Printf("Litematica regions span too large an area ({%d, %d, %d})!", Sizes[0], Sizes[1], Sizes[2]);
+		return nullptr;
+	}
+
+	// Decode each region directly into its place in the combined schematic:
+	auto res = std::make_shared<cSchematic>(Sizes[0], Sizes[1], Sizes[2]);
+	auto Types = res->GetBlockTypes();
+	auto Metas = res->GetBlockMetas();
+	size_t StrideZ = static_cast<size_t>(Sizes[0]);
+	size_t StrideY = StrideZ * static_cast<size_t>(Sizes[2]);
+	std::vector<cLegacyBlock> Palette;
+	for (const auto & Region: Regions)
+	{
+		if (!ReadBlockStatePalette(a_NBT, Region.m_PaletteTag, Palette) || Palette.empty())
+		{
+			a_ErrorMsg = "Litematica region doesn't contain a valid palette!";
+			return nullptr;
+		}
+		int BitsPerEntry = 2;
+		while ((static_cast<size_t>(1) << BitsPerEntry) < Palette.size())
+		{
+			BitsPerEntry++;
+		}
+		size_t NumBlocks = static_cast<size_t>(Region.m_Size[0]) * static_cast<size_t>(Region.m_Size[1]) * static_cast<size_t>(Region.m_Size[2]);
+		cPackedLongArrayReader Reader(
+			a_NBT.GetData(Region.m_BlockStatesTag), a_NBT.GetDataLength(Region.m_BlockStatesTag) / 8, BitsPerEntry, true
+		);
+		if (Reader.GetNumValues() < NumBlocks)
+		{
+			a_ErrorMsg = Printf("Litematica region block data is too short for the size {%d, %d, %d}!",
+				Region.m_Size[0], Region.m_Size[1], Region.m_Size[2]
+			);
+			return nullptr;
+		}
+
+		// The region's blocks are ordered the same way as ours (X, then Z, then Y), so each X row is contiguous:
+		size_t PaletteSize = Palette.size();
+		size_t RowStartX = static_cast<size_t>(Region.m_Min[0] - BoundsMin[0]);
+		for (int y = 0; y < Region.m_Size[1]; y++)
+		{
+			size_t LayerStart = static_cast<size_t>(Region.m_Min[1] - BoundsMin[1] + y) * StrideY;
+			for (int z = 0; z < Region.m_Size[2]; z++)
+			{
+				size_t Idx = LayerStart + static_cast<size_t>(Region.m_Min[2] - BoundsMin[2] + z) * StrideZ + RowStartX;
+				for (int x = 0; x < Region.m_Size[0]; x++, Idx++)
+				{
+					UInt32 Index = Reader.Next();
+					if (Index >= PaletteSize)
+					{
+						a_ErrorMsg = "Litematica region block data references blocks outside of the palette!";
+						return nullptr;
+					}
+					// Air doesn't overwrite the blocks of the previous overlapping regions:
+					const auto & Block = Palette[Index];
+					if (Block.m_BlockType != 0)
+					{
+						Types[Idx] = Block.m_BlockType;
+						Metas[Idx] = Block.m_BlockMeta;
+					}
+				}
+			}
+		}
+	}
+	return res;
+}
+
+
+
+
+
+cSchematicPtr cSchematicLoader::LoadStructure(const cParsedNBT & a_NBT, int a_RootTag, AString & a_ErrorMsg)
+{
+	int Sizes[3];
+	if (!ReadCoordsList(a_NBT, a_NBT.FindChildByName(a_RootTag, "size"), Sizes))
+	{
+		a_ErrorMsg = "Structure doesn't contain its size!";
+		return nullptr;
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		if ((Sizes[i] <= 0) || (Sizes[i] > cSchematic::MAX_DIMENSION))
+		{
+			a_ErrorMsg = Printf("Structure has an invalid size ({%d, %d, %d})!", Sizes[0], Sizes[1], Sizes[2]);
+			return nullptr;
+		}
+	}
+	if (static_cast<size_t>(Sizes[0]) * static_cast<size_t>(Sizes[1]) * static_cast<size_t>(Sizes[2]) > cSchematic::MAX_VOLUME)
+	{
+		a_ErrorMsg = Printf("Structure is too large ({%d, %d, %d})!", Sizes[0], Sizes[1], Sizes[2]);
+		return nullptr;
+	}
+
+	// Structures with random variants ("palettes") are rendered using the first variant:
+	int PaletteTag = a_NBT.FindChildByName(a_RootTag, "palette");
+	if (PaletteTag < 0)
+	{
+		int PalettesTag = a_NBT.FindChildByName(a_RootTag, "palettes");
+		if ((PalettesTag >= 0) && (a_NBT.GetType(PalettesTag) == TAG_List))
+		{
+			PaletteTag = a_NBT.GetFirstChild(PalettesTag);
+		}
+	}
+	std::vector<cLegacyBlock> Palette;
+	if (!ReadBlockStatePalette(a_NBT, PaletteTag, Palette))
+	{
+		a_ErrorMsg = "Structure doesn't contain a valid palette!";
+		return nullptr;
+	}
+
+	// Scatter the sparse block list into the block store; positions not listed stay air (structure void):
+	auto res = std::make_shared<cSchematic>(Sizes[0], Sizes[1], Sizes[2]);
+	auto Types = res->GetBlockTypes();
+	auto Metas = res->GetBlockMetas();
+	size_t StrideZ = static_cast<size_t>(Sizes[0]);
+	size_t StrideY = StrideZ * static_cast<size_t>(Sizes[2]);
+	size_t PaletteSize = Palette.size();
+	int BlocksTag = a_NBT.FindChildByName(a_RootTag, "blocks");
+	for (int Block = a_NBT.GetFirstChild(BlocksTag); Block >= 0; Block = a_NBT.GetNextSibling(Block))
+	{
+		if (a_NBT.GetType(Block) != TAG_Compound)
+		{
+			a_ErrorMsg = "Structure block list contains an invalid item!";
+			return nullptr;
+		}
+		int Pos[3];
+		int StateTag = a_NBT.FindChildByName(Block, "state");
+		if (
+			!ReadCoordsList(a_NBT, a_NBT.FindChildByName(Block, "pos"), Pos) ||
+			(StateTag < 0) || (a_NBT.GetType(StateTag) != TAG_Int)
+		)
+		{
+			a_ErrorMsg = "Structure block list contains an item without its pos or state!";
+			return nullptr;
+		}
+		Int32 State = a_NBT.GetInt(StateTag);
+		if (
+			(Pos[0] < 0) || (Pos[0] >= Sizes[0]) ||
+			(Pos[1] < 0) || (Pos[1] >= Sizes[1]) ||
+			(Pos[2] < 0) || (Pos[2] >= Sizes[2]) ||
+			(State < 0) || (static_cast<size_t>(State) >= PaletteSize)
+		)
+		{
+			a_ErrorMsg = Printf("Structure block list contains an invalid block {%d, %d, %d} (state %d)!", Pos[0], Pos[1], Pos[2], State);
+			return nullptr;
+		}
+		size_t Idx = static_cast<size_t>(Pos[0]) + static_cast<size_t>(Pos[2]) * StrideZ + static_cast<size_t>(Pos[1]) * StrideY;
+		Types[Idx] = Palette[static_cast<size_t>(State)].m_BlockType;
+		Metas[Idx] = Palette[static_cast<size_t>(State)].m_BlockMeta;
+	}
+	return res;
+}
+
+
+
+
@@ -0,0 +1,75 @@
+
+// SchematicLoader.h
+
+// Declares the cSchematicLoader class that decodes the schematic data in any of the supported formats into a cSchematic
+
+/*
+Supported formats:
+	- MCEdit .schematic (legacy block types and metas), via cSchematicParser
+	- Sponge .schem v1, v2 and v3 (block state palette, varint-encoded block data)
+	- Litematica .litematic (one or more regions, each with its own palette and bit-packed block data)
+	- Vanilla structure-block .nbt (palette and a sparse list of blocks)
+The modern block states are mapped onto the legacy blocks used by the renderer, once per palette entry.
+*/
+
+
+
+
+
+#pragma once
+
+#include "Schematic.h"
+
+
+
+
+
+// fwd:
+class cParsedNBT;
+struct cLegacyBlock;
+
+
+
+
+
+class cSchematicLoader
+{
+public:
+	/** Decodes the specified (uncompressed) NBT data in any of the supported formats.
+	Returns nullptr and sets a_ErrorMsg on failure. */
+	static cSchematicPtr Load(const char * a_Data, size_t a_Length, AString & a_ErrorMsg);
+
+	/** Decodes the specified (uncompressed) NBT data in any of the supported formats except for MCEdit .schematic.
+	Used by callers that have already tried cSchematicParser on the data and use its results directly when valid.
+	a_MCEditErrorMsg is the error from cSchematicParser, reported if the data is valid NBT but not in any other known format either;
+	data that cannot be NBT-parsed at all is reported as such.
+	Returns nullptr and sets a_ErrorMsg on failure. */
+	static cSchematicPtr LoadOtherFormats(const char * a_Data, size_t a_Length, const AString & a_MCEditErrorMsg, AString & a_ErrorMsg);
+
+	/** Finds the schematic's dimensions in the start of its (uncompressed) NBT data, without parsing the data.
+	Recognizes the Width / Height / Length tags (MCEdit, Sponge) and the EnclosingSize compound (Litematica)
+	and the size list (vanilla structure).
+	a_Data may be just the start of the data. Returns false if the dimensions weren't found. */
+	static bool PeekSize(const char * a_Data, size_t a_Length, int & a_SizeX, int & a_SizeY, int & a_SizeZ);
+
+	/** Maps the palette stored as a list of {Name, Properties} compounds (Litematica, vanilla structures, Anvil chunk sections)
+	onto legacy blocks. Returns false if the palette is not a list of compounds or is too large. */
+	static bool ReadBlockStatePalette(const cParsedNBT & a_NBT, int a_PaletteTag, std::vector<cLegacyBlock> & a_Palette);
+
+protected:
+	/** Decodes the Sponge schematic stored in the specified compound tag
+	(the root tag for v1 and v2, the "Schematic" child of the root for v3). */
+	static cSchematicPtr LoadSponge(const cParsedNBT & a_NBT, int a_SchematicTag, AString & a_ErrorMsg);
+
+	/** Decodes the Litematica schematic whose regions are stored in the specified compound tag.
+	All the regions are combined into a single schematic spanning their bounding box. */
+	static cSchematicPtr LoadLitematica(const cParsedNBT & a_NBT, int a_RegionsTag, AString & a_ErrorMsg);
+
+	/** Decodes the vanilla structure stored in the specified (root) compound tag.
+	The sparse block list is scattered directly into the schematic, the blocks not listed are air. */
+	static cSchematicPtr LoadStructure(const cParsedNBT & a_NBT, int a_RootTag, AString & a_ErrorMsg);
+};
+
+
+
+
@@ -0,0 +1,317 @@
+
+// SchematicParser.cpp
+
+// Implements the cSchematicParser class that extracts the block data out of the MCEdit .schematic NBT
+
+#include "Globals.h"
+#include "SchematicParser.h"
+
+
+
+
+
+/** Maximum nesting level of compounds and lists that is skipped; anything deeper is considered malicious. */
+static const int MAX_NESTING_DEPTH = 512;
+
+
+
+
+
+#define NEEDBYTES(N) \
+	if (m_Length - m_Pos < static_cast<size_t>(N)) \
+	{ \
+		return false; \
+	}
+
+
+
+
+
+cSchematicParser::cSchematicParser(const char * a_Data, size_t a_Length):
+	m_Data(a_Data),
+	m_Length(a_Length),
+	m_Pos(0),
+	m_SizeX(-1),
+	m_SizeY(-1),
+	m_SizeZ(-1),
+	m_BlockTypes(nullptr),
+	m_BlockMetas(nullptr),
+	m_NumBlockTypes(0),
+	m_NumBlockMetas(0)
+{
+	if (!Parse() && m_ErrorMsg.empty())
+	{
+		m_ErrorMsg = "Cannot NBT-parse the data.";
+	}
+}
+
+
+
+
+
+bool cSchematicParser::Parse(void)
+{
+	if ((m_Length < 3) || (m_Data[0] != TAG_Compound))
+	{
+		// Data too short, or the top-level tag is not a compound
+		return false;
+	}
+	m_Pos = 1;
+	size_t NameStart, NameLength;
+	if (!ReadString(NameStart, NameLength))
+	{
+		return false;
+	}
+
+	// Walk the root compound's children, pick the ones we need and skip all the others:
+	for (;;)
+	{
+		NEEDBYTES(1);
+		auto TagType = static_cast<eTagType>(m_Data[m_Pos]);
+		m_Pos++;
+		if (TagType == TAG_End)
+		{
+			break;
+		}
+		if (!ReadString(NameStart, NameLength))
+		{
+			return false;
+		}
+		const char * Name = m_Data + NameStart;
+		if ((TagType == TAG_Short) && (NameLength == 5) && (memcmp(Name, "Width", 5) == 0))
+		{
+			NEEDBYTES(2);
+			m_SizeX = GetBEShort(m_Data + m_Pos);
+			m_Pos += 2;
+		}
+		else if ((TagType == TAG_Short) && (NameLength == 6) && (memcmp(Name, "Height", 6) == 0))
+		{
+			NEEDBYTES(2);
+			m_SizeY = GetBEShort(m_Data + m_Pos);
+			m_Pos += 2;
+		}
+		else if ((TagType == TAG_Short) && (NameLength == 6) && (memcmp(Name, "Length", 6) == 0))
+		{
+			NEEDBYTES(2);
+			m_SizeZ = GetBEShort(m_Data + m_Pos);
+			m_Pos += 2;
+		}
+		else if ((TagType == TAG_ByteArray) && (NameLength == 6) && (memcmp(Name, "Blocks", 6) == 0))
+		{
+			if (!ReadArrayLength(1, m_NumBlockTypes))
+			{
+				return false;
+			}
+			m_BlockTypes = reinterpret_cast<const Byte *>(m_Data + m_Pos);
+			m_Pos += m_NumBlockTypes;
+		}
+		else if ((TagType == TAG_ByteArray) && (NameLength == 4) && (memcmp(Name, "Data", 4) == 0))
+		{
+			if (!ReadArrayLength(1, m_NumBlockMetas))
+			{
+				return false;
+			}
+			m_BlockMetas = reinterpret_cast<const Byte *>(m_Data + m_Pos);
+			m_Pos += m_NumBlockMetas;
+		}
+		else if (!SkipPayload(TagType, 1))
+		{
+			return false;
+		}
+	}  // for (-ever) - root compound children
+
+	// Check that we have all the needed data and that it is consistent:
+	if ((m_SizeX < 0) || (m_SizeY < 0) || (m_SizeZ < 0))
+	{
+		m_ErrorMsg = "NBT data doesn't contain dimensions!";
+		return false;
+	}
+	if ((m_BlockTypes == nullptr) || (m_BlockMetas == nullptr))
+	{
+		m_ErrorMsg = "NBT data doesn't contain block data or meta data!";
+		return false;
+	}
+	size_t NumBlocks = static_cast<size_t>(m_SizeX) * static_cast<size_t>(m_SizeY) * static_cast<size_t>(m_SizeZ);
+	if ((m_NumBlockTypes < NumBlocks) || (m_NumBlockMetas < NumBlocks))
+	{
+		m_ErrorMsg = Printf("NBT data is too short for the dimensions {%d, %d, %d} (blocks: " SIZE_T_FMT ", metas: " SIZE_T_FMT ")!",
+			m_SizeX, m_SizeY, m_SizeZ, m_NumBlockTypes, m_NumBlockMetas
+		);
+		return false;
+	}
+	return true;
+}
+
+
+
+
+
+bool cSchematicParser::ReadString(size_t & a_StringStart, size_t & a_StringLength)
+{
+	NEEDBYTES(2);
+	a_StringStart = m_Pos + 2;
+	a_StringLength = static_cast<size_t>(static_cast<UInt16>(GetBEShort(m_Data + m_Pos)));
+	m_Pos += 2;
+	NEEDBYTES(a_StringLength);
+	m_Pos += a_StringLength;
+	return true;
+}
+
+
+
+
+
+bool cSchematicParser::ReadArrayLength(size_t a_ElementSize, size_t & a_NumElements)
+{
+	NEEDBYTES(4);
+	int Len = GetBEInt(m_Data + m_Pos);
+	m_Pos += 4;
+	if ((Len < 0) || (static_cast<size_t>(Len) > (m_Length - m_Pos) / a_ElementSize))
+	{
+		// Invalid length, or not enough data
+		return false;
+	}
+	a_NumElements = static_cast<size_t>(Len);
+	return true;
+}
+
+
+
+
+
+bool cSchematicParser::SkipPayload(eTagType a_Type, int a_Depth)
+{
+	size_t NumElements;
+	switch (a_Type)
+	{
+		case TAG_Byte:   NEEDBYTES(1); m_Pos += 1; return true;
+		case TAG_Short:  NEEDBYTES(2); m_Pos += 2; return true;
+		case TAG_Int:    NEEDBYTES(4); m_Pos += 4; return true;
+		case TAG_Long:   NEEDBYTES(8); m_Pos += 8; return true;
+		case TAG_Float:  NEEDBYTES(4); m_Pos += 4; return true;
+		case TAG_Double: NEEDBYTES(8); m_Pos += 8; return true;
+		case TAG_String:
+		{
+			size_t Start, Length;
+			return ReadString(Start, Length);
+		}
+		case TAG_ByteArray:
+		{
+			if (!ReadArrayLength(1, NumElements))
+			{
+				return false;
+			}
+			m_Pos += NumElements;
+			return true;
+		}
+		case TAG_IntArray:
+		{
+			if (!ReadArrayLength(4, NumElements))
+			{
+				return false;
+			}
+			m_Pos += NumElements * 4;
+			return true;
+		}
+		case TAG_LongArray:
+		{
+			if (!ReadArrayLength(8, NumElements))
+			{
+				return false;
+			}
+			m_Pos += NumElements * 8;
+			return true;
+		}
+		case TAG_List:     return SkipList(a_Depth + 1);
+		case TAG_Compound: return SkipCompound(a_Depth + 1);
+		default:
+		{
+			// Unknown tag type, we cannot tell its length
+			return false;
+		}
+	}  // switch (a_Type)
+}
+
+
+
+
+
+bool cSchematicParser::SkipCompound(int a_Depth)
+{
+	if (a_Depth > MAX_NESTING_DEPTH)
+	{
+		return false;
+	}
+	for (;;)
+	{
+		NEEDBYTES(1);
+		auto TagType = static_cast<eTagType>(m_Data[m_Pos]);
+		m_Pos++;
+		if (TagType == TAG_End)
+		{
+			return true;
+		}
+		size_t NameStart, NameLength;
+		if (!ReadString(NameStart, NameLength) || !SkipPayload(TagType, a_Depth))
+		{
+			return false;
+		}
+	}  // for (-ever)
+}
+
+
+
+
+
+bool cSchematicParser::SkipList(int a_Depth)
+{
+	if (a_Depth > MAX_NESTING_DEPTH)
+	{
+		return false;
+	}
+	NEEDBYTES(5);
+	auto ItemType = static_cast<eTagType>(m_Data[m_Pos]);
+	int Count = GetBEInt(m_Data + m_Pos + 1);
+	m_Pos += 5;
+	if (Count <= 0)
+	{
+		// Empty list (the item type may be anything, including TAG_End)
+		return (Count == 0);
+	}
+
+	// Lists of fixed-size items can be skipped all at once:
+	size_t ItemSize = 0;
+	switch (ItemType)
+	{
+		case TAG_Byte:   ItemSize = 1; break;
+		case TAG_Short:  ItemSize = 2; break;
+		case TAG_Int:    ItemSize = 4; break;
+		case TAG_Long:   ItemSize = 8; break;
+		case TAG_Float:  ItemSize = 4; break;
+		case TAG_Double: ItemSize = 8; break;
+		default: break;
+	}
+	if (ItemSize > 0)
+	{
+		if (static_cast<size_t>(Count) > (m_Length - m_Pos) / ItemSize)
+		{
+			return false;
+		}
+		m_Pos += static_cast<size_t>(Count) * ItemSize;
+		return true;
+	}
+
+	// Variable-size items need to be skipped one by one:
+	for (int i = 0; i < Count; i++)
+	{
+		if (!SkipPayload(ItemType, a_Depth))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
@@ -0,0 +1,93 @@
+
+// SchematicParser.h
+
+// Declares the cSchematicParser class that extracts the block data out of the MCEdit .schematic NBT
+
+/*
+Unlike cParsedNBT, this parser doesn't build the tag tree for the whole file. It walks the root compound once,
+remembers the few tags needed for rendering (dimensions, block types and block metas) and skips over everything
+else (Entities, TileEntities, ...) using the lengths declared in the data, without storing any tags for them.
+The data pointer passed in the constructor is assumed to be valid throughout the object's life, the block arrays
+returned by the getters point directly into it.
+*/
+
+
+
+
+
+#pragma once
+
+#include "WorldStorage/FastNBT.h"
+
+
+
+
+
+class cSchematicParser
+{
+public:
+	cSchematicParser(const char * a_Data, size_t a_Length);
+
+	/** Returns true if the data has been parsed and contains everything needed for rendering. */
+	bool IsValid(void) const { return m_ErrorMsg.empty(); }
+
+	/** Returns the description of the problem encountered while parsing, or an empty string if the parsing succeeded. */
+	const AString & GetErrorMsg(void) const { return m_ErrorMsg; }
+
+	/** Returns the dimensions of the schematic, as stored in its Width, Height and Length tags. */
+	int GetSizeX(void) const { return m_SizeX; }
+	int GetSizeY(void) const { return m_SizeY; }
+	int GetSizeZ(void) const { return m_SizeZ; }
+
+	/** Returns the block types, indexed by [x + z * SizeX + y * SizeX * SizeZ].
+	Only valid if IsValid() returns true. */
+	const Byte * GetBlockTypes(void) const { return m_BlockTypes; }
+
+	/** Returns the block metas, indexed the same way as block types. The upper 4 bits of each value are not cleared.
+	Only valid if IsValid() returns true. */
+	const Byte * GetBlockMetas(void) const { return m_BlockMetas; }
+
+protected:
+	const char * m_Data;
+	size_t m_Length;
+
+	/** The current read position within m_Data, used while parsing. */
+	size_t m_Pos;
+
+	int m_SizeX;
+	int m_SizeY;
+	int m_SizeZ;
+	const Byte * m_BlockTypes;
+	const Byte * m_BlockMetas;
+
+	/** Length of the block types and block metas arrays, as declared in the data. */
+	size_t m_NumBlockTypes;
+	size_t m_NumBlockMetas;
+
+	/** Description of the parsing error; empty if parsing succeeded. */
+	AString m_ErrorMsg;
+
+
+	/** Walks the root compound and picks the needed tags. Returns true on success, sets m_ErrorMsg on failure. */
+	bool Parse(void);
+
+	/** Reads the size of a NBT string (2 bytes) and skips over the string data, returning its position in the params. */
+	bool ReadString(size_t & a_StringStart, size_t & a_StringLength);
+
+	/** Reads the length of an array tag's payload, in elements, and checks that the whole payload is present. */
+	bool ReadArrayLength(size_t a_ElementSize, size_t & a_NumElements);
+
+	/** Skips over the payload of a tag of the specified type, without storing anything.
+	a_Depth is the nesting level, used to refuse malicious data that would overflow the stack. */
+	bool SkipPayload(eTagType a_Type, int a_Depth);
+
+	/** Skips over the payload of a Compound tag. */
+	bool SkipCompound(int a_Depth);
+
+	/** Skips over the payload of a List tag. */
+	bool SkipList(int a_Depth);
+};
+
+
+
+
@@ -1,21 +1,33 @@
 
 // SchematicToPng.cpp
 
-// Implements the main app entrypoint
+// Implements the cSchematicToPng class encapsulating the entire app
 
 #include "Globals.h"
 #include <fstream>
 #include <thread>
+#include <atomic>
 #include <functional>
 #include "SchematicToPng.h"
-#include "OSSupport/GZipFile.h"
-#include "WorldStorage/FastNBT.h"
-#include "Logger.h"
-#include "LoggerListeners.h"
+#include "OSSupport/MappedFile.h"
+#include "StringCompression.h"
+#include "SchematicParser.h"
+#include "SchematicLoader.h"
+#include "AnvilLoader.h"
 #include "zlib/zlib.h"
 #include "BlockImage.h"
 #include "PngExporter.h"
 #include "JsonNet.h"
+#include "json/json.h"
+#include "FolderScanner.h"
+#include "BlockColors.h"
+#include "ContentHash.h"
+#include "Tracer.h"
+
+#ifdef _WIN32
+	#include <fcntl.h>
+	#include <io.h>
+#endif
 
 #ifndef INVALID_SOCKET
 	#define INVALID_SOCKET static_cast<SOCKET>(-1)
@@ -27,34 +39,42 @@
 // An array of 4096 zero bytes, used for writing the padding
 static const Byte g_Zeroes[4096] = {0};
 
+/** The images with at least this many pixels are rendered in bands by multiple workers. */
+static const size_t RENDER_BAND_MIN_IMAGE_PIXELS = 4 * 1024 * 1024;
 
+/** The minimum height of a single render band, in pixels. */
+static const int RENDER_BAND_MIN_HEIGHT = 256;
 
+/** The number of queued items searched for other items sharing an input file, when the read stage takes an item. */
+static const size_t INPUT_GROUP_SCAN_WINDOW = 1024;
 
+/** The maximum number of items in m_Queue; parsing the listfiles blocks while the queue is full. */
+static const size_t QUEUE_MAX_ITEMS = 4096;
 
-int main(int argc, char ** argv)
-{
-	cLogger::cListener * consoleLogListener = MakeConsoleListener();
-	cLogger::cListener * fileLogListener = new cFileListener();
-	cLogger::GetInstance().AttachListener(consoleLogListener);
-	cLogger::GetInstance().AttachListener(fileLogListener);
+/** The longest time between the manifest saves while busy, when running until terminated. */
+static const int MANIFEST_SAVE_INTERVAL_SEC = 10;
 
-	cLogger::InitiateMultithreading();
+/** The number of threads listing the folders in parallel, when scanning the input folders. */
+static const int FOLDER_SCAN_NUM_THREADS = 8;
 
-	cSchematicToPng App;
-	if (!App.Init(argc, argv))
-	{
-		return 1;
-	}
+/** The wildcard patterns of the files processed from the input folders, unless overridden on the command line. */
+static const char DEFAULT_FOLDER_PATTERNS[] = "*.schematic;*.schem;*.litematic;*.nbt";
 
-	App.Run();
+/** The number of items ordered by cost together, at the start and at most. */
+static const size_t ORDER_WINDOW_MIN_ITEMS = 64;
+static const size_t ORDER_WINDOW_MAX_ITEMS = 4096;
 
-	cLogger::GetInstance().DetachListener(consoleLogListener);
-	delete consoleLogListener;
-	cLogger::GetInstance().DetachListener(fileLogListener);
-	delete fileLogListener;
+/** The number of inputs whose costs are estimated together by a single task. */
+static const size_t COST_ESTIMATE_CHUNK = 16;
 
-	return 0;
-}
+/** The number of bytes read from the start of each input file (and uncompressed from it) when looking for its dimensions. */
+static const size_t COST_ESTIMATE_HEAD_SIZE = 4 * 1024;
+
+/** The guessed number of blocks per byte of the input file, for files whose dimensions cannot be peeked. */
+static const double COST_ESTIMATE_BLOCKS_PER_BYTE = 8;
+
+/** The cost of decoding a block, in the units of drawn pixels. */
+static const UInt64 COST_ESTIMATE_DECODE_PER_BLOCK = 4;
 
 
 
@@ -64,8 +84,22 @@ int main(int argc, char ** argv)
 // cSchematicToPng:
 
 cSchematicToPng::cSchematicToPng(void) :
+	m_Queue(QUEUE_MAX_ITEMS),
+	m_OrderWindowSize(ORDER_WINDOW_MIN_ITEMS),
+	m_FolderPatterns(StringSplitAndTrim(DEFAULT_FOLDER_PATTERNS, ";")),
+	m_IsRecursive(false),
+	m_WriteQueue(1),
+	m_NumJobsInFlight(0),
+	m_MaxJobsInFlight(1),
 	m_NumThreads(4),
-	m_KeepRunning(false)
+	m_NumIOThreads(2),
+	m_NumWriteThreads(0),
+	m_Order(ordLargestFirst),
+	m_NumUpToDate(0),
+	m_NumTempFiles(0),
+	m_NumQueuedItems(0),
+	m_KeepRunning(false),
+	m_IsPipeMode(false)
 {
 }
 
@@ -86,6 +120,9 @@ bool cSchematicToPng::Init(int argc, char ** argv)
 	}
 	#endif  // _WIN32
 
+	// The render cache folder is set up only after all the parameters are parsed, because indexing it evicts the images
+	// over the size limit, which may be given after the folder:
+	AString RenderCacheFolder;
 	for (int i = 1; i < argc; i++)
 	{
 		if (argv[i][0] == '-')
@@ -98,6 +135,79 @@ bool cSchematicToPng::Init(int argc, char ** argv)
 				}
 				i++;
 			}
+			else if ((NoCaseCompare(argv[i], "-iothreads") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_NumIOThreads))
+				{
+					std::cerr << "Cannot parse parameter for I/O thread count: " << argv[i + 1] << std::endl;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-writethreads") == 0) && (i < argc - 1))
+			{
+				if (!StringToInteger(argv[i + 1], m_NumWriteThreads))
+				{
+					std::cerr << "Cannot parse parameter for write thread count: " << argv[i + 1] << std::endl;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-order") == 0) && (i < argc - 1))
+			{
+				if (NoCaseCompare(argv[i + 1], "largest") == 0)
+				{
+					m_Order = ordLargestFirst;
+				}
+				else if (NoCaseCompare(argv[i + 1], "list") == 0)
+				{
+					m_Order = ordListed;
+				}
+				else
+				{
+					std::cerr << "Unknown processing order: " << argv[i + 1] << std::endl;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-manifest") == 0) && (i < argc - 1))
+			{
+				if (!m_Manifest.Load(argv[i + 1]))
+				{
+					std::cerr << "Cannot read manifest file " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-archive") == 0) && (i < argc - 1))
+			{
+				if (!m_Archive.Open(argv[i + 1]))
+				{
+					std::cerr << "Cannot create archive file " << argv[i + 1] << std::endl;
+					return false;
+				}
+				i++;
+			}
+			else if (NoCaseCompare(argv[i], "-stats") == 0)
+			{
+				m_Stats.Enable();
+			}
+			else if ((NoCaseCompare(argv[i], "-statsjson") == 0) && (i < argc - 1))
+			{
+				m_StatsFileName = argv[i + 1];
+				m_Stats.Enable();
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-trace") == 0) && (i < argc - 1))
+			{
+				#ifdef ENABLE_TRACING
+					m_TraceFileName = argv[i + 1];
+				#else
+					std::cerr << "This build doesn't support tracing, ignoring the -trace parameter" << std::endl;
+				#endif
+				i++;
+			}
+			else if (NoCaseCompare(argv[i], "-pipe") == 0)
+			{
+				m_IsPipeMode = true;
+			}
 			else if ((NoCaseCompare(argv[i], "-net") == 0) && (i < argc - 1))
 			{
 				UInt16 Port;
@@ -126,24 +236,158 @@ bool cSchematicToPng::Init(int argc, char ** argv)
 				i++;
 				m_KeepRunning = true;
 			}
+			else if ((NoCaseCompare(argv[i], "-schematiccache") == 0) && (i < argc - 1))
+			{
+				size_t CacheSizeMiB;
+				if (!StringToInteger(argv[i + 1], CacheSizeMiB))
+				{
+					std::cerr << "Cannot parse schematic cache size from parameter " << argv[i + 1] << std::endl;
+				}
+				else
+				{
+					cJsonNet::SetSchematicCacheSize(CacheSizeMiB MiB);
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-rendercache") == 0) && (i < argc - 1))
+			{
+				size_t CacheSizeMiB;
+				if (!StringToInteger(argv[i + 1], CacheSizeMiB))
+				{
+					std::cerr << "Cannot parse render cache size from parameter " << argv[i + 1] << std::endl;
+				}
+				else
+				{
+					cJsonNet::SetRenderCacheMemSize(CacheSizeMiB MiB);
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-rendercachedir") == 0) && (i < argc - 1))
+			{
+				RenderCacheFolder = argv[i + 1];
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-rendercachedirsize") == 0) && (i < argc - 1))
+			{
+				size_t CacheSizeMiB;
+				if (!StringToInteger(argv[i + 1], CacheSizeMiB))
+				{
+					std::cerr << "Cannot parse render cache folder size from parameter " << argv[i + 1] << std::endl;
+				}
+				else
+				{
+					cJsonNet::SetRenderCacheDiskSize(CacheSizeMiB MiB);
+				}
+				i++;
+			}
 			else if (
 				(strcmp(argv[i], "-") == 0) ||
 				(strcmp(argv[i], "--") == 0)
 			)
 			{
-				ProcessQueueStream(std::make_shared<cIosInputStream>(std::cin));
+				m_InputSources.emplace_back(cInputSource::isStdin, AString());
+			}
+			else if ((NoCaseCompare(argv[i], "-dir") == 0) && (i < argc - 1))
+			{
+				m_InputSources.emplace_back(cInputSource::isFolder, argv[i + 1]);
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-jobs") == 0) && (i < argc - 1))
+			{
+				m_InputSources.emplace_back(cInputSource::isJsonLines, argv[i + 1]);
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-watch") == 0) && (i < argc - 1))
+			{
+				m_InputSources.emplace_back(cInputSource::isWatched, argv[i + 1]);
+				m_KeepRunning = true;
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-pattern") == 0) && (i < argc - 1))
+			{
+				m_FolderPatterns = StringSplitAndTrim(argv[i + 1], ";");
+				i++;
+			}
+			else if (NoCaseCompare(argv[i], "-recursive") == 0)
+			{
+				m_IsRecursive = true;
+			}
+			else if ((NoCaseCompare(argv[i], "-outdir") == 0) && (i < argc - 1))
+			{
+				m_OutputFolder = argv[i + 1];
+				if (!m_OutputFolder.empty() && (m_OutputFolder.back() != '/') && (m_OutputFolder.back() != cFile::PathSeparator))
+				{
+					m_OutputFolder.push_back('/');
+				}
+				i++;
+			}
+			else if ((NoCaseCompare(argv[i], "-default") == 0) && (i < argc - 1))
+			{
+				if (m_DefaultItem == nullptr)
+				{
+					m_DefaultItem = std::make_shared<cQueueItem>(AString(), std::make_shared<cIosInputStream>(std::cin));
+				}
+				ProcessPropertyLine(m_DefaultItem->m_ErrorOut, *m_DefaultItem, argv[i + 1]);
+				i++;
 			}
 			else
 			{
 				std::cerr << "Cannot process parameter: " << argv[i] << std::endl;
 			}
 		}
+		else if (strpbrk(argv[i], "*?") != nullptr)
+		{
+			// A wildcard pattern of the files to process, the wildcards are only allowed in the file name:
+			AString Path(argv[i]);
+			auto LastSeparator = Path.find_last_of("/\\");
+			AString Folder = (LastSeparator == AString::npos) ? AString() : Path.substr(0, LastSeparator + 1);
+			if (Folder.find_first_of("*?") != AString::npos)
+			{
+				std::cerr << "Wildcards are only supported in the file name: " << argv[i] << std::endl;
+				continue;
+			}
+			m_InputSources.emplace_back(cInputSource::isFolder, Folder);
+			m_InputSources.back().m_Patterns.push_back(Path.substr(Folder.size()));
+		}
 		else
 		{
-			std::ifstream f(argv[i]);
-			ProcessQueueStream(std::make_shared<cIosInputStream>(f));
+			// The JSON-lines job lists are recognized by their extension:
+			bool IsJsonLines = (cFolderScanner::MatchesWildcard("*.jsonl", argv[i]) || cFolderScanner::MatchesWildcard("*.ndjson", argv[i]));
+			m_InputSources.emplace_back(IsJsonLines ? cInputSource::isJsonLines : cInputSource::isListFile, argv[i]);
 		}
 	}
+	if (!RenderCacheFolder.empty() && !cJsonNet::SetRenderCacheFolder(RenderCacheFolder))
+	{
+		std::cerr << "Cannot use render cache folder " << RenderCacheFolder << std::endl;
+	}
+	if (m_DefaultItem == nullptr)
+	{
+		m_DefaultItem = std::make_shared<cQueueItem>(AString(), std::make_shared<cIosInputStream>(std::cin));
+	}
+	if (m_IsPipeMode && (!m_InputSources.empty() || m_KeepRunning || m_Archive.IsOpen() || m_Manifest.IsEnabled() || !m_TraceFileName.empty()))
+	{
+		std::cerr << "The -pipe parameter renders only the schematic from stdin, it cannot be combined with other inputs or outputs" << std::endl;
+		return false;
+	}
+	if (m_Archive.IsOpen() && m_Manifest.IsEnabled())
+	{
+		// The manifest checks the output files, which don't exist when writing into an archive:
+		std::cerr << "The -manifest and -archive parameters cannot be combined" << std::endl;
+		return false;
+	}
+	if (m_Archive.IsOpen() && m_KeepRunning)
+	{
+		// The archive is finalized only at the end of the run, which never comes when running until terminated:
+		std::cerr << "The -archive parameter cannot be combined with -watch, -net or -jsonnet" << std::endl;
+		return false;
+	}
+	#ifdef ENABLE_TRACING
+		if (!m_TraceFileName.empty())
+		{
+			// The daemons never reach the end of Run(), their trace is written periodically:
+			cTracer::Start(m_TraceFileName, m_KeepRunning);
+		}
+	#endif
 	return true;
 }
 
@@ -153,49 +397,317 @@ bool cSchematicToPng::Init(int argc, char ** argv)
 
 void cSchematicToPng::Run(void)
 {
-	// Start the processing threads:
-	for (int i = 0; i < m_NumThreads; i++)
+	m_NumThreads = std::max(m_NumThreads, 1);
+	m_NumIOThreads = std::max(m_NumIOThreads, 1);
+	if (m_NumWriteThreads <= 0)
+	{
+		m_NumWriteThreads = m_NumIOThreads;
+	}
+	if (m_Archive.IsOpen())
+	{
+		// A single thread serializes all the images into the archive:
+		m_NumWriteThreads = 1;
+	}
+
+	// Enough jobs in flight to keep all the workers and the writers busy while the readers work on the next ones.
+	// The write queue can hold all of them, so that the workers never block on it:
+	m_MaxJobsInFlight = 2 * (m_NumThreads + m_NumIOThreads) + m_NumWriteThreads;
+	m_WriteQueue.SetMaxSize(static_cast<size_t>(m_MaxJobsInFlight));
+
+	// Start the pipeline, then feed it from the inputs:
+	m_Scheduler.Start(m_NumThreads);
+	for (int i = 0; i < m_NumIOThreads; i++)
+	{
+		m_ReadThreads.emplace_back(&cSchematicToPng::ReadStage, this);
+	}
+	for (int i = 0; i < m_NumWriteThreads; i++)
+	{
+		m_WriteThreads.emplace_back(&cSchematicToPng::WriteStage, this);
+	}
+	m_InputThread = std::thread(&cSchematicToPng::InputThread, this);
+
+	// Wait for the pipeline to finish, stage by stage:
+	m_InputThread.join();
+	for (auto & Thread: m_ReadThreads)
+	{
+		Thread.join();
+	}
+	m_Scheduler.WaitIdle();
+	m_WriteQueue.Close();
+	for (auto & Thread: m_WriteThreads)
+	{
+		Thread.join();
+	}
+	m_Scheduler.Stop();
+	m_ReadThreads.clear();
+	m_WriteThreads.clear();
+
+	if (m_Manifest.IsEnabled())
+	{
+		LOG("Skipped %d up-to-date items.", m_NumUpToDate.load());
+		m_Manifest.Save();
+	}
+	if (m_Archive.IsOpen())
+	{
+		m_Archive.Close();
+	}
+	if (m_Stats.IsEnabled())
+	{
+		m_Stats.LogReport();
+		if (!m_StatsFileName.empty() && !m_Stats.SaveJson(m_StatsFileName))
+		{
+			LOGWARNING("Cannot write the stats file %s", m_StatsFileName.c_str());
+		}
+	}
+	#ifdef ENABLE_TRACING
+		cTracer::Stop();
+	#endif
+}
+
+
+
+
+
+bool cSchematicToPng::RunPipe(void)
+{
+	auto Item = std::make_shared<cQueueItem>(*m_DefaultItem);
+	Item->m_InputFileName = "<stdin>";
+	if (Item->m_HasArea)
+	{
+		std::cerr << "Cannot render a world area in the pipe mode" << std::endl;
+		return false;
+	}
+
+	#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		_setmode(_fileno(stdout), _O_BINARY);
+	#endif
+
+	// Read the whole schematic data:
+	cBatchInput Input;
+	Input.m_Items.push_back(Item);
+	char Buffer[64 * 1024];
+	size_t NumRead;
+	while ((NumRead = fread(Buffer, 1, sizeof(Buffer), stdin)) > 0)
+	{
+		Input.m_FileData.append(Buffer, NumRead);
+	}
+	if (ferror(stdin))
+	{
+		std::cerr << "Cannot read the schematic data from stdin" << std::endl;
+		return false;
+	}
+
+	// Run all the stages in this thread; the whole image is rendered in one go, there are no other workers to share it:
+	if (!DecodeInput(Input, Input.m_NBTData))
+	{
+		return false;
+	}
+	auto BlockImage = ExtractBlockImage(*Item, Input.m_Parser.get(), Input.m_Decoded.get());
+	if (BlockImage == nullptr)
 	{
-		auto Thread = std::make_shared<cThread>(*this);
-		m_Threads.push_back(Thread);
-		Thread->Start();
+		return false;
+	}
+	AString PngData;
+	{
+		cPngExporter Exporter(*BlockImage, Item->m_HorzSize, Item->m_VertSize, Item->m_Markers);
+		Exporter.Render();
+		PngData = Exporter.Encode();
 	}
 
-	// Wait for all the threads to finish:
-	while (!m_Threads.empty())
+	if ((fwrite(PngData.data(), 1, PngData.size(), stdout) != PngData.size()) || (fflush(stdout) != 0))
 	{
-		m_Threads.back()->Wait();
-		m_Threads.pop_back();
+		std::cerr << "Cannot write the image to stdout" << std::endl;
+		return false;
 	}
+	return true;
 }
 
 
 
 
+
 cSchematicToPng::cQueueItemPtr cSchematicToPng::GetNextQueueItem(void)
 {
-	cCSLock Lock(m_CS);
-	while (m_Queue.empty())
+	TRACE_SCOPE("wait: input queue", 0);
+	cQueueItemPtr res;
+	if (!m_Queue.Pop(res))
+	{
+		// The queue has been closed and there are no more items, return an empty item to kill the thread
+		return nullptr;
+	}
+	return res;
+}
+
+
+
+
+
+void cSchematicToPng::InputThread(void)
+{
+	TRACE_THREAD_NAME("input");
+	bool ShouldOrder = (m_Order == ordLargestFirst);
+	for (const auto & Source: m_InputSources)
+	{
+		switch (Source.m_Kind)
+		{
+			case cInputSource::isListFile:
+			{
+				std::ifstream f(Source.m_Path);
+				ProcessQueueStream(std::make_shared<cIosInputStream>(f), ShouldOrder);
+				break;
+			}
+			case cInputSource::isStdin:
+			{
+				// Items piped in on stdin are processed as soon as they arrive, in their order:
+				FlushOrderWindow();
+				ProcessQueueStream(std::make_shared<cIosInputStream>(std::cin), false);
+				break;
+			}
+			case cInputSource::isFolder:
+			{
+				ScanInputFolder(Source);
+				break;
+			}
+			case cInputSource::isWatched:
+			{
+				WatchInputFolder(Source);
+				break;
+			}
+			case cInputSource::isJsonLines:
+			{
+				if (Source.m_Path == "-")
+				{
+					// Jobs piped in on stdin are processed as soon as they arrive, in their order:
+					FlushOrderWindow();
+					ProcessJsonLinesStream(std::make_shared<cIosInputStream>(std::cin), false);
+					break;
+				}
+				std::ifstream f(Source.m_Path);
+				if (!f.is_open())
+				{
+					std::cerr << "Cannot open job list file " << Source.m_Path << std::endl;
+					break;
+				}
+				ProcessJsonLinesStream(std::make_shared<cIosInputStream>(f), ShouldOrder);
+				break;
+			}
+		}
+	}
+	FlushOrderWindow();
+
+	if (!m_KeepRunning)
+	{
+		// All the input has been queued, let the read stage finish once it's processed:
+		m_Queue.Close();
+	}
+}
+
+
+
+
+
+void cSchematicToPng::ScanInputFolder(const cInputSource & a_Source)
+{
+	AString Folder = a_Source.m_Path;
+	if (!Folder.empty() && (Folder.back() != '/') && (Folder.back() != cFile::PathSeparator))
 	{
-		if (!m_KeepRunning)
+		Folder.push_back('/');
+	}
+	bool ShouldOrder = (m_Order == ordLargestFirst);
+
+	// Queue each file as soon as it is found, so that the processing overlaps with the scanning:
+	cFolderScanner Scanner(Folder, a_Source.m_Patterns.empty() ? m_FolderPatterns : a_Source.m_Patterns, m_IsRecursive,
+		[this, &Folder, ShouldOrder](const AString & a_RelFolder, const AString & a_FileName)
 		{
-			// Return an empty item to kill the thread
-			return nullptr;
+			QueueItem(CreateFolderItem(Folder, a_RelFolder, a_FileName), ShouldOrder);
 		}
-		// We should run forever, wait for a new item to arrive into the queue:
-		cCSUnlock Unlock(Lock);
-		m_evtQueue.Wait();
+	);
+	if (!Scanner.Scan(FOLDER_SCAN_NUM_THREADS))
+	{
+		std::cerr << "Cannot list folder " << a_Source.m_Path << std::endl;
 	}
-	auto res = m_Queue.back();
-	m_Queue.pop_back();
-	return res;
 }
 
 
 
 
 
-void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input)
+void cSchematicToPng::WatchInputFolder(const cInputSource & a_Source)
+{
+	AString Folder = a_Source.m_Path;
+	if (!Folder.empty() && (Folder.back() != '/') && (Folder.back() != cFile::PathSeparator))
+	{
+		Folder.push_back('/');
+	}
+
+	// The saved files are processed right away, in the order in which they were saved:
+	std::unique_ptr<cFolderWatcher> Watcher(new cFolderWatcher(Folder, m_FolderPatterns, m_IsRecursive,
+		[this, Folder](const AString & a_RelFolder, const AString & a_FileName)
+		{
+			QueueItem(CreateFolderItem(Folder, a_RelFolder, a_FileName), false);
+		}
+	));
+	AString ErrorMsg;
+	if (!Watcher->Start(ErrorMsg))
+	{
+		std::cerr << ErrorMsg << std::endl;
+		return;
+	}
+	LOG("Watching folder %s for changes.", a_Source.m_Path.c_str());
+	m_FolderWatchers.push_back(std::move(Watcher));
+}
+
+
+
+
+
+cSchematicToPng::cQueueItemPtr cSchematicToPng::CreateFolderItem(const AString & a_Folder, const AString & a_RelFolder, const AString & a_FileName)
+{
+	auto Item = std::make_shared<cQueueItem>(*m_DefaultItem);
+	Item->m_InputFileName = a_Folder + a_RelFolder + a_FileName;
+	if (m_OutputFolder.empty())
+	{
+		Item->m_OutputFileName = cFile::ChangeFileExt(Item->m_InputFileName, "png");
+	}
+	else
+	{
+		Item->m_OutputFileName = m_OutputFolder + cFile::ChangeFileExt(a_RelFolder + a_FileName, "png");
+	}
+	return Item;
+}
+
+
+
+
+
+void cSchematicToPng::QueueItem(cQueueItemPtr && a_Item, bool a_ShouldOrder)
+{
+	a_Item->m_ID = ++m_NumQueuedItems;
+	if (!a_ShouldOrder)
+	{
+		m_Queue.Push(std::move(a_Item));
+		return;
+	}
+	std::vector<cQueueItemPtr> Window;
+	{
+		std::unique_lock<std::mutex> Lock(m_OrderWindowMutex);
+		m_OrderWindow.push_back(std::move(a_Item));
+		if (m_OrderWindow.size() < m_OrderWindowSize)
+		{
+			return;
+		}
+		std::swap(Window, m_OrderWindow);
+		m_OrderWindowSize = std::min(m_OrderWindowSize * 2, ORDER_WINDOW_MAX_ITEMS);
+	}
+	QueueByCost(std::move(Window));
+}
+
+
+
+
+
+void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input, bool a_ShouldOrder)
 {
 	AString line;
 	cQueueItemPtr current;
@@ -216,9 +728,7 @@ void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input)
 				// Push the previously parsed item into the queue:
 				if (current != nullptr)
 				{
-					cCSLock Lock(m_CS);
-					m_Queue.push_back(current);
-					m_evtQueue.Set();
+					QueueItem(std::move(current), a_ShouldOrder);
 					current.reset();
 				}
 				continue;
@@ -238,9 +748,7 @@ void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input)
 			// Push the previously parsed item into the queue:
 			if (current != nullptr)
 			{
-				cCSLock Lock(m_CS);
-				m_Queue.push_back(current);
-				m_evtQueue.Set();
+				QueueItem(std::move(current), a_ShouldOrder);
 			}
 
 			// Create a new item for which to parse properties:
@@ -250,8 +758,7 @@ void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input)
 
 	if (current != nullptr)
 	{
-		cCSLock Lock(m_CS);
-		m_Queue.push_back(current);
+		QueueItem(std::move(current), a_ShouldOrder);
 	}
 }
 
@@ -259,9 +766,179 @@ void cSchematicToPng::ProcessQueueStream(cInputStreamPtr a_Input)
 
 
 
-bool cSchematicToPng::ProcessPropertyLine(cInputStreamPtr a_Input, cSchematicToPng::cQueueItem & a_Item, const AString & a_PropertyLine)
+void cSchematicToPng::ProcessJsonLinesStream(cInputStreamPtr a_Input, bool a_ShouldOrder)
 {
-	// Find the property being set:
+	Json::CharReaderBuilder Builder;
+	Builder["collectComments"] = false;
+	std::unique_ptr<Json::CharReader> Reader(Builder.newCharReader());
+	AString Line;
+	while (a_Input->GetLine(Line))
+	{
+		if (Line.find_first_not_of(" \t\r") == AString::npos)
+		{
+			continue;
+		}
+		Json::Value Job;
+		JSONCPP_STRING Err;
+		if (!Reader->parse(Line.data(), Line.data() + Line.size(), &Job, &Err) || !Job.isObject())
+		{
+			std::replace(Err.begin(), Err.end(), '\n', ' ');
+			a_Input->LineError(Printf("Invalid JSON job: %s", Err.empty() ? "not an object" : TrimString(Err).c_str()));
+			continue;
+		}
+
+		try
+		{
+			const Json::Value & ConstJob = Job;
+			const auto & InputFile = ConstJob["InputFile"];
+			if (!InputFile.isString() || InputFile.asString().empty())
+			{
+				a_Input->LineError(ConstJob.isMember("BlockData") ?
+					"Embedded BlockData is not supported in job lists, use InputFile" :
+					"Missing InputFile in the job"
+				);
+				continue;
+			}
+			cQueueItem Base(InputFile.asString(), a_Input);
+			if (!ApplyJsonProperties(a_Input, Base, ConstJob))
+			{
+				continue;
+			}
+
+			// Each variant renders the same input into another output, with its properties overriding the job's ones:
+			const auto & Variants = ConstJob["Variants"];
+			if (!Variants.isArray() || Variants.empty())
+			{
+				QueueItem(std::make_shared<cQueueItem>(Base), a_ShouldOrder);
+				continue;
+			}
+			for (const auto & Variant: Variants)
+			{
+				if (!Variant.isObject() || !Variant.isMember("OutputFile"))
+				{
+					a_Input->LineError("Each variant must be an object with its own OutputFile");
+					continue;
+				}
+				auto Item = std::make_shared<cQueueItem>(Base);
+				if (ApplyJsonProperties(a_Input, *Item, Variant))
+				{
+					QueueItem(std::move(Item), a_ShouldOrder);
+				}
+			}
+		}
+		catch (const std::exception & exc)
+		{
+			// Members of a wrong type:
+			a_Input->LineError(Printf("Invalid JSON job: %s", exc.what()));
+		}
+	}
+}
+
+
+
+
+
+bool cSchematicToPng::ApplyJsonProperties(cInputStreamPtr a_Input, cQueueItem & a_Item, const Json::Value & a_Props)
+{
+	static const struct
+	{
+		const char * m_Name;
+		int cQueueItem::* m_Member;
+	} IntProps[] =
+	{
+		{"StartX",   &cQueueItem::m_StartX},
+		{"EndX",     &cQueueItem::m_EndX},
+		{"StartY",   &cQueueItem::m_StartY},
+		{"EndY",     &cQueueItem::m_EndY},
+		{"StartZ",   &cQueueItem::m_StartZ},
+		{"EndZ",     &cQueueItem::m_EndZ},
+		{"HorzSize", &cQueueItem::m_HorzSize},
+		{"VertSize", &cQueueItem::m_VertSize},
+	};
+	for (const auto & Prop: IntProps)
+	{
+		if (a_Props.isMember(Prop.m_Name))
+		{
+			a_Item.*Prop.m_Member = a_Props[Prop.m_Name].asInt();
+		}
+	}
+	if (a_Props.isMember("OutputFile"))
+	{
+		a_Item.m_OutputFileName = a_Props["OutputFile"].asString();
+	}
+	if (a_Props.isMember("NumCWRotations"))
+	{
+		a_Item.m_NumCCWRotations = (4 - (a_Props["NumCWRotations"].asInt() % 4)) % 4;
+	}
+	if (a_Props.isMember("NumCCWRotations"))
+	{
+		a_Item.m_NumCCWRotations = a_Props["NumCCWRotations"].asInt();
+	}
+
+	// The markers replace those of the job, if present in a variant:
+	if (a_Props.isMember("Markers"))
+	{
+		a_Item.m_Markers.clear();
+		a_Item.m_MarkerSpecs.clear();
+		for (const auto & Marker: a_Props["Markers"])
+		{
+			AString Spec = Printf("%d, %d, %d, %s",
+				Marker["X"].asInt(), Marker["Y"].asInt(), Marker["Z"].asInt(), Marker["Shape"].asString().c_str()
+			);
+			if (Marker.isMember("Color"))
+			{
+				Spec.append(", ");
+				Spec.append(Marker["Color"].asString());
+			}
+			if (!AddMarker(a_Item, Spec))
+			{
+				a_Input->LineError(Printf("Invalid marker \"%s\"", Spec.c_str()));
+				return false;
+			}
+		}
+	}
+
+	// The area of an Anvil world, as an array of the two corners' coords:
+	if (a_Props.isMember("Area"))
+	{
+		const auto & Area = a_Props["Area"];
+		int Coords[6];
+		if (!Area.isArray() || (Area.size() != ARRAYCOUNT(Coords)))
+		{
+			a_Input->LineError("Invalid Area, expected an array of 6 coords");
+			return false;
+		}
+		for (Json::ArrayIndex i = 0; i < ARRAYCOUNT(Coords); i++)
+		{
+			Coords[i] = Area[i].asInt();
+		}
+		SetArea(a_Item, Coords);
+	}
+	return true;
+}
+
+
+
+
+
+void cSchematicToPng::SetArea(cQueueItem & a_Item, const int (&a_Coords)[6])
+{
+	a_Item.m_HasArea = true;
+	a_Item.m_AreaMinX = std::min(a_Coords[0], a_Coords[3]);
+	a_Item.m_AreaMinY = std::min(a_Coords[1], a_Coords[4]);
+	a_Item.m_AreaMinZ = std::min(a_Coords[2], a_Coords[5]);
+	a_Item.m_AreaMaxX = std::max(a_Coords[0], a_Coords[3]);
+	a_Item.m_AreaMaxY = std::max(a_Coords[1], a_Coords[4]);
+	a_Item.m_AreaMaxZ = std::max(a_Coords[2], a_Coords[5]);
+}
+
+
+
+
+
+bool cSchematicToPng::ProcessPropertyLine(cInputStreamPtr a_Input, cSchematicToPng::cQueueItem & a_Item, const AString & a_PropertyLine)
+{
+	// Find the property being set:
 	auto propStart = a_PropertyLine.find_first_not_of(" \t");
 	auto propEnd = a_PropertyLine.find_first_of(" \t=:", propStart);
 	if (propEnd == AString::npos)
@@ -336,6 +1013,21 @@ bool cSchematicToPng::ProcessPropertyLine(cInputStreamPtr a_Input, cSchematicToP
 	{
 		return AddMarker(a_Item, value);
 	}
+	else if (NoCaseCompare(prop, "area") == 0)
+	{
+		// "x1, y1, z1, x2, y2, z2", the corners may be given in any order:
+		auto split = StringSplitAndTrim(value, ",;");
+		int Coords[6];
+		for (size_t i = 0; i < ARRAYCOUNT(Coords); i++)
+		{
+			if ((split.size() != ARRAYCOUNT(Coords)) || !StringToInteger(split[i], Coords[i]))
+			{
+				a_Input->LineError(Printf("Invalid area specification: \"%s\"", value.c_str()));
+				return false;
+			}
+		}
+		SetArea(a_Item, Coords);
+	}
 	else
 	{
 		a_Input->LineError(Printf("Unknown property name: \"%s\"", prop.c_str()));
@@ -394,6 +1086,8 @@ bool cSchematicToPng::AddMarker(cSchematicToPng::cQueueItem & a_Item, const AStr
 
 	// Add the marker:
 	a_Item.m_Markers.push_back(std::make_shared<cMarker>(x, y, z, shape, Color));
+	a_Item.m_MarkerSpecs.append(a_MarkerValue);
+	a_Item.m_MarkerSpecs.push_back('\n');
 	return true;
 }
 
@@ -401,29 +1095,295 @@ bool cSchematicToPng::AddMarker(cSchematicToPng::cQueueItem & a_Item, const AStr
 
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// cSchematicToPng::cThread:
+void cSchematicToPng::FlushOrderWindow(void)
+{
+	std::vector<cQueueItemPtr> Window;
+	{
+		std::unique_lock<std::mutex> Lock(m_OrderWindowMutex);
+		std::swap(Window, m_OrderWindow);
+	}
+	QueueByCost(std::move(Window));
+}
+
+
+
+
+
+void cSchematicToPng::QueueByCost(std::vector<cQueueItemPtr> && a_Items)
+{
+	// Group the items by their input, in the order of the inputs' first appearance:
+	std::vector<std::vector<cQueueItemPtr>> Groups;
+	std::map<AString, size_t> FileGroups;
+	for (auto & Item: a_Items)
+	{
+		if (Item->m_HasArea)
+		{
+			Groups.emplace_back();
+			Groups.back().push_back(std::move(Item));
+			continue;
+		}
+		auto itr = FileGroups.find(Item->m_InputFileName);
+		if (itr == FileGroups.end())
+		{
+			itr = FileGroups.insert(std::make_pair(Item->m_InputFileName, Groups.size())).first;
+			Groups.emplace_back();
+		}
+		Groups[itr->second].push_back(std::move(Item));
+	}
+	a_Items.clear();
+	FileGroups.clear();
+	if (Groups.empty())
+	{
+		return;
+	}
 
-cSchematicToPng::cThread::cThread(cSchematicToPng & a_Parent) :
-	super("SchematicToPng thread"),
-	m_Parent(a_Parent)
+	// Estimate the costs, each input is peeked only once. Most of the time is spent waiting for the disk, so the inputs
+	// are estimated in parallel, in chunks, by this thread and by helper tasks on the scheduler's idle workers.
+	// A helper task may start only after all the chunks are done (and then has nothing left to do),
+	// so the state it uses is shared through a pointer instead of living on this thread's stack.
+	// The pipeline is processing the previous window in the meantime, so this doesn't delay anything but the first window:
+	struct cEstimate
+	{
+		std::vector<std::vector<cQueueItemPtr>> m_Groups;
+		std::vector<UInt64> m_Costs;
+		size_t m_NumChunks;
+		std::atomic<size_t> m_NextChunk;
+		size_t m_NumChunksDone;  // Protected by m_Mutex
+		std::mutex m_Mutex;
+		std::condition_variable m_CondDone;
+	};
+	auto Estimate = std::make_shared<cEstimate>();
+	Estimate->m_Groups = std::move(Groups);
+	Estimate->m_Costs.resize(Estimate->m_Groups.size(), 0);
+	Estimate->m_NumChunks = (Estimate->m_Groups.size() + COST_ESTIMATE_CHUNK - 1) / COST_ESTIMATE_CHUNK;
+	Estimate->m_NextChunk = 0;
+	Estimate->m_NumChunksDone = 0;
+	auto EstimateChunks = [Estimate]()
+	{
+		size_t NumDone = 0;
+		for (;;)
+		{
+			size_t Chunk = Estimate->m_NextChunk++;
+			if (Chunk >= Estimate->m_NumChunks)
+			{
+				break;
+			}
+			size_t End = std::min((Chunk + 1) * COST_ESTIMATE_CHUNK, Estimate->m_Groups.size());
+			for (size_t i = Chunk * COST_ESTIMATE_CHUNK; i < End; i++)
+			{
+				int Size[3];
+				if (!EstimateInputSize(*Estimate->m_Groups[i].front(), Size))
+				{
+					// The read stage will report the error
+					continue;
+				}
+				for (const auto & Item: Estimate->m_Groups[i])
+				{
+					Estimate->m_Costs[i] += EstimateCost(*Item, Size);
+				}
+			}
+			NumDone++;
+		}
+		if (NumDone == 0)
+		{
+			return;
+		}
+		std::unique_lock<std::mutex> Lock(Estimate->m_Mutex);
+		Estimate->m_NumChunksDone += NumDone;
+		if (Estimate->m_NumChunksDone == Estimate->m_NumChunks)
+		{
+			Estimate->m_CondDone.notify_all();
+		}
+	};
+	size_t NumHelpers = std::min(static_cast<size_t>(m_NumThreads), Estimate->m_NumChunks - 1);
+	for (size_t i = 0; i < NumHelpers; i++)
+	{
+		m_Scheduler.Submit(EstimateChunks);
+	}
+	EstimateChunks();
+	{
+		std::unique_lock<std::mutex> Lock(Estimate->m_Mutex);
+		Estimate->m_CondDone.wait(Lock, [&Estimate]() { return (Estimate->m_NumChunksDone == Estimate->m_NumChunks); });
+	}
+	Groups = std::move(Estimate->m_Groups);
+	const auto & Costs = Estimate->m_Costs;
+
+	// Queue the groups from the most expensive one:
+	std::vector<size_t> Order(Groups.size());
+	for (size_t i = 0; i < Order.size(); i++)
+	{
+		Order[i] = i;
+	}
+	std::stable_sort(Order.begin(), Order.end(), [&Costs](size_t a_Idx1, size_t a_Idx2)
+		{
+			return (Costs[a_Idx1] > Costs[a_Idx2]);
+		}
+	);
+	for (auto Idx: Order)
+	{
+		for (auto & Item: Groups[Idx])
+		{
+			m_Queue.Push(std::move(Item));
+		}
+	}
+}
+
+
+
+
+
+bool cSchematicToPng::EstimateInputSize(const cQueueItem & a_Item, int (&a_Size)[3])
 {
+	if (a_Item.m_HasArea)
+	{
+		a_Size[0] = a_Item.m_AreaMaxX - a_Item.m_AreaMinX + 1;
+		a_Size[1] = a_Item.m_AreaMaxY - a_Item.m_AreaMinY + 1;
+		a_Size[2] = a_Item.m_AreaMaxZ - a_Item.m_AreaMinZ + 1;
+		return true;
+	}
+
+	cFile f;
+	if (!f.Open(a_Item.m_InputFileName, cFile::fmRead))
+	{
+		return false;
+	}
+	char Head[COST_ESTIMATE_HEAD_SIZE];
+	int HeadSize = f.Read(Head, sizeof(Head));
+	int FileSize = f.GetSize();
+	f.Close();
+	if (HeadSize <= 0)
+	{
+		return false;
+	}
+	AString Uncompressed;
+	const char * Data = Head;
+	size_t DataSize = static_cast<size_t>(HeadSize);
+	if ((HeadSize >= 2) && (static_cast<Byte>(Head[0]) == 0x1f) && (static_cast<Byte>(Head[1]) == 0x8b))
+	{
+		if (UncompressStringGZIPHead(Head, DataSize, COST_ESTIMATE_HEAD_SIZE, Uncompressed) != Z_OK)
+		{
+			return false;
+		}
+		Data = Uncompressed.data();
+		DataSize = Uncompressed.size();
+	}
+	if (!cSchematicLoader::PeekSize(Data, DataSize, a_Size[0], a_Size[1], a_Size[2]))
+	{
+		// Unknown dimensions, guess the number of blocks from the file size, as a cube:
+		double NumBlocks = static_cast<double>(std::max(FileSize, 0)) * COST_ESTIMATE_BLOCKS_PER_BYTE;
+		int Side = static_cast<int>(pow(NumBlocks, 1.0 / 3)) + 1;
+		a_Size[0] = a_Size[1] = a_Size[2] = Side;
+	}
+	return true;
+}
+
+
+
+
+
+UInt64 cSchematicToPng::EstimateCost(const cQueueItem & a_Item, const int (&a_Size)[3])
+{
+	// Apply the cropping, the same way as ExtractBlockImage() does:
+	const int Starts[3] = {a_Item.m_StartX, a_Item.m_StartY, a_Item.m_StartZ};
+	const int Ends[3]   = {a_Item.m_EndX,   a_Item.m_EndY,   a_Item.m_EndZ};
+	UInt64 NumBlocks = 1;
+	for (int i = 0; i < 3; i++)
+	{
+		int Start = (Starts[i] == -1) ? 0 : std::min(a_Size[i], std::max(Starts[i], 0));
+		int End = (Ends[i] == -1) ? a_Size[i] - 1 : std::min(a_Size[i] - 1, std::max(Ends[i], 0));
+		NumBlocks *= static_cast<UInt64>(std::max(End - Start + 1, 0));
+	}
+
+	// Each block draws roughly HorzSize * HorzSize pixels of the top face and HorzSize * VertSize pixels of each side face:
+	UInt64 HorzSize = static_cast<UInt64>(std::max(a_Item.m_HorzSize, 1));
+	UInt64 VertSize = static_cast<UInt64>(std::max(a_Item.m_VertSize, 1));
+	return NumBlocks * (HorzSize * (HorzSize + 2 * VertSize) + COST_ESTIMATE_DECODE_PER_BLOCK);
 }
 
 
 
 
 
-void cSchematicToPng::cThread::Execute(void)
+bool cSchematicToPng::IsSameInput(const cQueueItem & a_Item1, const cQueueItem & a_Item2)
 {
+	return (
+		!a_Item1.m_HasArea &&
+		!a_Item2.m_HasArea &&
+		(a_Item1.m_InputFileName == a_Item2.m_InputFileName)
+	);
+}
+
+
+
+
+
+void cSchematicToPng::ReadStage(void)
+{
+	TRACE_THREAD_NAME("reader");
 	for (;;)
 	{
-		auto Item = m_Parent.GetNextQueueItem();
+		auto Item = GetNextQueueItem();
 		if (Item == nullptr)
 		{
 			return;
 		}
-		ProcessItem(*Item);
+
+		// Wait for a free slot in the pipeline and claim all the free slots for the item and its group:
+		int NumClaimed;
+		{
+			TRACE_SCOPE("wait: job slot", Item->m_ID);
+			std::unique_lock<std::mutex> Lock(m_JobsMutex);
+			m_CondJobFinished.wait(Lock, [this]() { return (m_NumJobsInFlight < m_MaxJobsInFlight); });
+			NumClaimed = m_MaxJobsInFlight - m_NumJobsInFlight;
+			m_NumJobsInFlight = m_MaxJobsInFlight;
+		}
+
+		// Pick the items sharing the same input from the front part of the queue, as many as there are claimed slots:
+		auto Input = std::make_shared<cBatchInput>();
+		Input->m_Items.push_back(Item);
+		if (!Item->m_HasArea && (NumClaimed > 1))
+		{
+			m_Queue.TakeIf(
+				[&Item](const cQueueItemPtr & a_Other) { return IsSameInput(*Item, *a_Other); },
+				INPUT_GROUP_SCAN_WINDOW, static_cast<size_t>(NumClaimed - 1), Input->m_Items
+			);
+		}
+		int NumItems = static_cast<int>(Input->m_Items.size());
+
+		// Return the slots not used by the group:
+		if (NumClaimed > NumItems)
+		{
+			FinishJobs(NumClaimed - NumItems);
+		}
+
+		// World areas read only the parts of the region files they need, that's done together with the decoding:
+		if (!Item->m_HasArea)
+		{
+			// Copy the file out of the mapping, so that the actual disk reads happen here, not in the decode task:
+			TRACE_SCOPE_DETAIL("read", Item->m_ID, Item->m_InputFileName);
+			auto ReadStart = cStageStats::Now();
+			cMappedFile f;
+			if (!f.Open(Item->m_InputFileName))
+			{
+				for (const auto & GroupItem: Input->m_Items)
+				{
+					GroupItem->m_ErrorOut->Error(Printf("Cannot open file %s for reading!", Item->m_InputFileName.c_str()));
+				}
+				FinishJobs(NumItems);
+				continue;
+			}
+			Input->m_FileData.assign(f.GetData(), f.GetSize());
+			Input->m_Times.m_StageNsec[cStageStats::stRead] = cStageStats::Now() - ReadStart;
+			if (m_Manifest.IsEnabled())
+			{
+				RemoveUpToDateItems(*Input);
+				if (Input->m_Items.empty())
+				{
+					continue;
+				}
+			}
+		}
+		m_Scheduler.Submit([this, Input]() { DecodeTask(Input); });
 	}
 }
 
@@ -431,45 +1391,406 @@ void cSchematicToPng::cThread::Execute(void)
 
 
 
-void cSchematicToPng::cThread::ProcessItem(const cSchematicToPng::cQueueItem & a_Item)
+void cSchematicToPng::RemoveUpToDateItems(cBatchInput & a_Input)
 {
-	// Read and unGZip the schematic file:
-	cGZipFile f;
-	if (!f.Open(a_Item.m_InputFileName, cGZipFile::fmRead))
+	size_t NumRemaining = 0;
+	for (auto & Item: a_Input.m_Items)
 	{
-		a_Item.m_ErrorOut->Error(Printf("Cannot open file %s for reading!", a_Item.m_InputFileName.c_str()));
+		Item->m_ManifestKey = GetManifestKey(*Item, a_Input.m_FileData);
+		if (m_Manifest.IsUpToDate(Item->m_OutputFileName, Item->m_ManifestKey))
+		{
+			continue;
+		}
+		a_Input.m_Items[NumRemaining++] = std::move(Item);
+	}
+	int NumUpToDate = static_cast<int>(a_Input.m_Items.size() - NumRemaining);
+	a_Input.m_Items.resize(NumRemaining);
+	if (NumUpToDate > 0)
+	{
+		m_NumUpToDate += NumUpToDate;
+		FinishJobs(NumUpToDate);
+	}
+}
+
+
+
+
+
+AString cSchematicToPng::GetManifestKey(const cQueueItem & a_Item, const AString & a_FileData)
+{
+	// The block colors are compiled in, hash them only once:
+	static const UInt64 BlockColorsHash = GetContentHash(g_BlockColors, sizeof(g_BlockColors));
+
+	return Printf("v%d|%016llx|%016llx-%llu|%d|%d|%d|%d|%d|%d|%d|%d|%d|%016llx-%llu",
+		cPngExporter::OUTPUT_VERSION,
+		static_cast<unsigned long long>(BlockColorsHash),
+		static_cast<unsigned long long>(GetContentHash(a_FileData)), static_cast<unsigned long long>(a_FileData.size()),
+		a_Item.m_StartX, a_Item.m_EndX, a_Item.m_StartY, a_Item.m_EndY, a_Item.m_StartZ, a_Item.m_EndZ,
+		a_Item.m_NumCCWRotations, a_Item.m_HorzSize, a_Item.m_VertSize,
+		static_cast<unsigned long long>(GetContentHash(a_Item.m_MarkerSpecs)), static_cast<unsigned long long>(a_Item.m_MarkerSpecs.size())
+	);
+}
+
+
+
+
+
+void cSchematicToPng::DecodeTask(const cBatchInputPtr & a_Input)
+{
+	// Buffer for the uncompressed NBT data of single items, kept between the jobs so that its memory is reused instead of reallocated.
+	// Inputs shared by multiple items keep their own buffer, it is needed until all their items are extracted:
+	static thread_local AString NBTBuffer;
+
+	bool IsShared = (a_Input->m_Items.size() > 1);
+	bool IsOK;
+	{
+		TRACE_SCOPE_DETAIL("decode", a_Input->m_Items.front()->m_ID, a_Input->m_Items.front()->m_InputFileName);
+		IsOK = DecodeInput(*a_Input, IsShared ? a_Input->m_NBTData : NBTBuffer);
+	}
+	m_Stats.AddInput(a_Input->m_Times);
+	a_Input->m_FileData.clear();
+	a_Input->m_FileData.shrink_to_fit();
+	if (!IsOK)
+	{
+		FinishJobs(static_cast<int>(a_Input->m_Items.size()));
 		return;
 	}
-	AString contents;
-	if (f.ReadRestOfFile(contents) < 0)
+	if (!IsShared)
 	{
-		a_Item.m_ErrorOut->Error(Printf("Cannot read file %s!", a_Item.m_InputFileName.c_str()));
+		ExtractTask(a_Input, a_Input->m_Items.front());
 		return;
 	}
 
-	// Parse the NBT:
-	cParsedNBT nbt(contents.data(), contents.size());
-	if (!nbt.IsValid())
+	// Fan the items out over the workers:
+	for (const auto & Item: a_Input->m_Items)
+	{
+		m_Scheduler.Submit([this, a_Input, Item]() { ExtractTask(a_Input, Item); });
+	}
+}
+
+
+
+
+
+void cSchematicToPng::ExtractTask(const cBatchInputPtr & a_Input, const cQueueItemPtr & a_Item)
+{
+	auto Job = std::make_shared<cBatchJob>();
+	Job->m_Item = a_Item;
+	Job->m_Times = a_Input->m_Times;
 	{
-		a_Item.m_ErrorOut->Error(Printf("Cannot parse input file %s!", a_Item.m_InputFileName.c_str()));
+		TRACE_SCOPE_DETAIL("extract", a_Item->m_ID, a_Item->m_OutputFileName);
+		Job->m_BlockImage = ExtractBlockImage(*a_Item, a_Input->m_Parser.get(), a_Input->m_Decoded.get(), &Job->m_Times);
+	}
+	if (Job->m_BlockImage == nullptr)
+	{
+		FinishJobs(1);
 		return;
 	}
-	int tHeight = nbt.FindChildByName(0, "Height");
-	int tLength = nbt.FindChildByName(0, "Length");
-	int tWidth  = nbt.FindChildByName(0, "Width");
+	const auto & Img = *Job->m_BlockImage;
+	Job->m_Times.m_NumVoxels = static_cast<UInt64>(Img.GetSizeX()) * static_cast<UInt64>(Img.GetSizeY()) * static_cast<UInt64>(Img.GetSizeZ());
+	m_Scheduler.Submit([this, Job]() { RenderTask(Job); });
+}
+
+
+
+
+
+void cSchematicToPng::RenderTask(const cBatchJobPtr & a_Job)
+{
+	const auto & Item = *a_Job->m_Item;
+	a_Job->m_Exporter.reset(new cPngExporter(*a_Job->m_BlockImage, Item.m_HorzSize, Item.m_VertSize, Item.m_Markers));
+	auto & Exporter = *a_Job->m_Exporter;
+
+	// Split large images into bands, so that the idle workers can steal them instead of waiting for a single huge render.
+	// The markers aren't clipped to the bands, so the images with markers are rendered as a whole:
+	int Height = Exporter.GetImgHeight();
+	a_Job->m_Times.m_NumPixels = static_cast<UInt64>(Exporter.GetImgWidth()) * static_cast<UInt64>(Height);
+	int NumBands = 1;
 	if (
-		(tHeight <= 0) || (tLength <= 0) || (tWidth <= 0) ||
-		(nbt.GetType(tHeight) != TAG_Short) ||
-		(nbt.GetType(tLength) != TAG_Short) ||
-		(nbt.GetType(tWidth) != TAG_Short)
+		Item.m_Markers.empty() &&
+		(m_NumThreads > 1) &&
+		(static_cast<size_t>(Exporter.GetImgWidth()) * static_cast<size_t>(Height) >= RENDER_BAND_MIN_IMAGE_PIXELS)
 	)
 	{
-		a_Item.m_ErrorOut->Error(Printf("File %s doesn't contain dimensions!", a_Item.m_InputFileName.c_str()));
+		NumBands = std::min(2 * m_NumThreads, std::max(Height / RENDER_BAND_MIN_HEIGHT, 1));
+	}
+	if (NumBands <= 1)
+	{
+		{
+			TRACE_SCOPE_DETAIL("render", Item.m_ID, Item.m_OutputFileName);
+			auto RenderStart = cStageStats::Now();
+			Exporter.Render();
+			a_Job->m_Times.m_StageNsec[cStageStats::stRender] = cStageStats::Now() - RenderStart;
+		}
+		m_Scheduler.Submit([this, a_Job]() { EncodeTask(a_Job); });
 		return;
 	}
-	int Height = nbt.GetShort(tHeight);
-	int Length = nbt.GetShort(tLength);
-	int Width  = nbt.GetShort(tWidth);
+
+	// The last band to finish stores the summed render time and submits the encoding:
+	auto NumRemaining = std::make_shared<std::atomic<int>>(NumBands);
+	auto RenderNsec = std::make_shared<std::atomic<Int64>>(0);
+	for (int i = 0; i < NumBands; i++)
+	{
+		int MinY = static_cast<int>(static_cast<Int64>(Height) * i / NumBands);
+		int MaxY = static_cast<int>(static_cast<Int64>(Height) * (i + 1) / NumBands);
+		m_Scheduler.Submit([this, a_Job, NumRemaining, RenderNsec, MinY, MaxY]()
+			{
+				{
+					TRACE_SCOPE_DETAIL("render band", a_Job->m_Item->m_ID, Printf("rows %d - %d of %s", MinY, MaxY, a_Job->m_Item->m_OutputFileName.c_str()));
+					auto RenderStart = cStageStats::Now();
+					a_Job->m_Exporter->RenderRows(MinY, MaxY);
+					*RenderNsec += cStageStats::Now() - RenderStart;
+				}
+				if (--*NumRemaining == 0)
+				{
+					a_Job->m_Times.m_StageNsec[cStageStats::stRender] = RenderNsec->load();
+					m_Scheduler.Submit([this, a_Job]() { EncodeTask(a_Job); });
+				}
+			}
+		);
+	}
+}
+
+
+
+
+
+void cSchematicToPng::EncodeTask(const cBatchJobPtr & a_Job)
+{
+	{
+		TRACE_SCOPE_DETAIL("encode", a_Job->m_Item->m_ID, a_Job->m_Item->m_OutputFileName);
+		auto EncodeStart = cStageStats::Now();
+		a_Job->m_PngData = a_Job->m_Exporter->Encode();
+		a_Job->m_Times.m_StageNsec[cStageStats::stEncode] = cStageStats::Now() - EncodeStart;
+	}
+
+	// The image data is no longer needed, free it before the job waits for the write:
+	a_Job->m_Exporter.reset();
+	a_Job->m_BlockImage.reset();
+	m_WriteQueue.Push(cBatchJobPtr(a_Job));
+}
+
+
+
+
+
+void cSchematicToPng::WriteStage(void)
+{
+	TRACE_THREAD_NAME("writer");
+	cBatchJobPtr Job;
+	for (;;)
+	{
+		{
+			TRACE_SCOPE("wait: write queue", 0);
+			if (!m_WriteQueue.Pop(Job))
+			{
+				break;
+			}
+		}
+		const auto & FileName = Job->m_Item->m_OutputFileName;
+		{
+			TRACE_SCOPE_DETAIL("write", Job->m_Item->m_ID, FileName);
+			auto WriteStart = cStageStats::Now();
+			bool IsWritten;
+			if (m_Archive.IsOpen())
+			{
+				IsWritten = m_Archive.AddEntry(FileName, Job->m_PngData);
+			}
+			else
+			{
+				IsWritten = WriteOutputFile(FileName, Job->m_PngData);
+				if (IsWritten && !Job->m_Item->m_ManifestKey.empty())
+				{
+					m_Manifest.Set(FileName, Job->m_Item->m_ManifestKey);
+				}
+			}
+			if (IsWritten)
+			{
+				Job->m_Times.m_StageNsec[cStageStats::stWrite] = cStageStats::Now() - WriteStart;
+				m_Stats.AddItem(FileName, Job->m_Times);
+			}
+		}
+		Job.reset();
+		FinishJobs(1);
+	}
+}
+
+
+
+
+
+bool cSchematicToPng::WriteOutputFile(const AString & a_FileName, const AString & a_Data)
+{
+	// The temporary file is in the same folder, so that the rename doesn't need to move the data.
+	// Its name is unique, so that several writers of the same output don't clash:
+	AString TempFileName = Printf("%s.%d.tmp", a_FileName.c_str(), ++m_NumTempFiles);
+	cFile f;
+	if (!f.Open(TempFileName, cFile::fmWrite))
+	{
+		// The output folder may not exist yet (mirrored input folders), create it and retry:
+		auto LastSeparator = a_FileName.find_last_of("/\\");
+		if ((LastSeparator != AString::npos) && (LastSeparator > 0) && cFile::CreateFolderRecursive(a_FileName.substr(0, LastSeparator)))
+		{
+			f.Open(TempFileName, cFile::fmWrite);
+		}
+	}
+	if (!f.IsOpen())
+	{
+		LOGWARNING("Cannot open file %s for writing", TempFileName.c_str());
+		return false;
+	}
+	bool IsWritten = (f.Write(a_Data.data(), a_Data.size()) == static_cast<int>(a_Data.size()));
+	f.Close();
+	if (!IsWritten)
+	{
+		LOGWARNING("Cannot write file %s", TempFileName.c_str());
+		cFile::Delete(TempFileName);
+		return false;
+	}
+
+	// Rename() replaces the file atomically on POSIX; elsewhere it fails if the file exists, delete it and retry then:
+	if (!cFile::Rename(TempFileName, a_FileName))
+	{
+		cFile::Delete(a_FileName);
+		if (!cFile::Rename(TempFileName, a_FileName))
+		{
+			LOGWARNING("Cannot rename file %s to %s", TempFileName.c_str(), a_FileName.c_str());
+			cFile::Delete(TempFileName);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+
+
+void cSchematicToPng::FinishJobs(int a_NumJobs)
+{
+	bool ShouldSaveManifest = false;
+	{
+		std::unique_lock<std::mutex> Lock(m_JobsMutex);
+		m_NumJobsInFlight -= a_NumJobs;
+
+		// When running until terminated, there's no end of the run to save the manifest at. Save it whenever the pipeline
+		// becomes idle, and at least once per MANIFEST_SAVE_INTERVAL_SEC while it's busy:
+		if (m_KeepRunning && m_Manifest.IsEnabled())
+		{
+			auto Now = std::chrono::steady_clock::now();
+			if ((m_NumJobsInFlight == 0) || (Now - m_LastManifestSave >= std::chrono::seconds(MANIFEST_SAVE_INTERVAL_SEC)))
+			{
+				m_LastManifestSave = Now;
+				ShouldSaveManifest = true;
+			}
+		}
+	}
+	m_CondJobFinished.notify_all();
+	if (ShouldSaveManifest)
+	{
+		m_Manifest.Save();
+	}
+}
+
+
+
+
+
+bool cSchematicToPng::DecodeInput(cBatchInput & a_Input, AString & a_NBTBuffer)
+{
+	const auto & FirstItem = *a_Input.m_Items.front();
+	const AString & FileName = FirstItem.m_InputFileName;
+
+	// Anvil world areas are decoded directly into a cSchematic:
+	if (FirstItem.m_HasArea)
+	{
+		AString ErrorMsg;
+		auto LoadStart = cStageStats::Now();
+		a_Input.m_Decoded = cAnvilLoader::LoadArea(
+			FileName,
+			FirstItem.m_AreaMinX, FirstItem.m_AreaMinY, FirstItem.m_AreaMinZ,
+			FirstItem.m_AreaMaxX, FirstItem.m_AreaMaxY, FirstItem.m_AreaMaxZ,
+			&m_Scheduler, ErrorMsg
+		);
+		a_Input.m_Times.m_StageNsec[cStageStats::stParse] = cStageStats::Now() - LoadStart;
+		if (a_Input.m_Decoded == nullptr)
+		{
+			for (const auto & Item: a_Input.m_Items)
+			{
+				Item->m_ErrorOut->Error(Printf("Cannot load area from world %s: %s", FileName.c_str(), ErrorMsg.c_str()));
+			}
+			return false;
+		}
+		return true;
+	}
+
+	// UnGZip the file data in a single go, reusing the buffer from the previous items:
+	const AString & Data = a_Input.m_FileData;
+	AString & contents = a_NBTBuffer;
+	contents.clear();
+	auto UnGZipStart = cStageStats::Now();
+	if ((Data.size() >= 2) && (static_cast<Byte>(Data[0]) == 0x1f) && (static_cast<Byte>(Data[1]) == 0x8b))
+	{
+		if (UncompressStringGZIP(Data.data(), Data.size(), contents) != Z_OK)
+		{
+			for (const auto & Item: a_Input.m_Items)
+			{
+				Item->m_ErrorOut->Error(Printf("Cannot read file %s!", FileName.c_str()));
+			}
+			return false;
+		}
+	}
+	else
+	{
+		// Not GZIP-ped, use the data as-is (same as gzread() does):
+		contents.assign(Data);
+	}
+
+	auto ParseStart = cStageStats::Now();
+	a_Input.m_Times.m_StageNsec[cStageStats::stUnGZip] = ParseStart - UnGZipStart;
+
+	// Parse the NBT; MCEdit .schematic block data is used directly, other formats are decoded into a cSchematic:
+	std::unique_ptr<cSchematicParser> Parser(new cSchematicParser(contents.data(), contents.size()));
+	if (Parser->IsValid())
+	{
+		a_Input.m_Parser = std::move(Parser);
+		a_Input.m_Times.m_StageNsec[cStageStats::stParse] = cStageStats::Now() - ParseStart;
+		return true;
+	}
+	AString ErrorMsg;
+	a_Input.m_Decoded = cSchematicLoader::LoadOtherFormats(contents.data(), contents.size(), Parser->GetErrorMsg(), ErrorMsg);
+	a_Input.m_Times.m_StageNsec[cStageStats::stParse] = cStageStats::Now() - ParseStart;
+	if (a_Input.m_Decoded == nullptr)
+	{
+		for (const auto & Item: a_Input.m_Items)
+		{
+			Item->m_ErrorOut->Error(Printf("Cannot parse input file %s: %s", FileName.c_str(), ErrorMsg.c_str()));
+		}
+		return false;
+	}
+	return true;
+}
+
+
+
+
+
+std::unique_ptr<cBlockImage> cSchematicToPng::ExtractBlockImage(const cQueueItem & a_Item, const cSchematicParser * a_Parser, const cSchematic * a_Decoded, cStageStats::cTimes * a_Times)
+{
+	auto ExtractStart = cStageStats::Now();
+	int Width, Height, Length;
+	if (a_Parser != nullptr)
+	{
+		Height = a_Parser->GetSizeY();
+		Length = a_Parser->GetSizeZ();
+		Width  = a_Parser->GetSizeX();
+	}
+	else
+	{
+		Height = a_Decoded->GetSizeY();
+		Length = a_Decoded->GetSizeZ();
+		Width  = a_Decoded->GetSizeX();
+	}
 
 	// Get the start and end coords (merge config and file contents):
 	int StartX = (a_Item.m_StartX == -1) ? 0 : std::min(Width, std::max(a_Item.m_StartX, 0));
@@ -483,51 +1804,49 @@ void cSchematicToPng::cThread::ProcessItem(const cSchematicToPng::cQueueItem & a
 		a_Item.m_ErrorOut->Error(Printf("The specified dimensions result in an empty area ({%d, %d, %d}) in file %s!",
 			EndX - StartX, EndY - StartY, EndZ - StartZ, a_Item.m_InputFileName.c_str()
 		));
-		return;
-	}
-
-	// Get the pointers to block data in the NBT:
-	int tBlocks = nbt.FindChildByName(0, "Blocks");
-	int tMetas = nbt.FindChildByName(0, "Data");
-	if (
-		(tBlocks <= 0) || (tMetas <= 0) ||
-		(nbt.GetType(tBlocks) != TAG_ByteArray) ||
-		(nbt.GetType(tMetas)  != TAG_ByteArray)
-	)
-	{
-		a_Item.m_ErrorOut->Error(Printf("File %s doesn't contain block data or meta data!", a_Item.m_InputFileName.c_str()));
-		return;
+		return nullptr;
 	}
-	auto Blocks = reinterpret_cast<const Byte *>(nbt.GetData(tBlocks));
-	auto Metas  = reinterpret_cast<const Byte *>(nbt.GetData(tMetas));
 
-	// Copy the block data out of the NBT:
+	// Copy the block data out of the NBT (or the decoded schematic):
 	int SizeX = EndX - StartX + 1;
 	int SizeY = EndY - StartY + 1;
 	int SizeZ = EndZ - StartZ + 1;
-	cBlockImage Img(SizeX, SizeY, SizeZ);
-	for (int y = 0; y < SizeY; y++)
+	std::unique_ptr<cBlockImage> Img(new cBlockImage(SizeX, SizeY, SizeZ));
+	if (a_Decoded != nullptr)
+	{
+		a_Decoded->CopyToImage(*Img, StartX, StartY, StartZ);
+	}
+	else
 	{
-		for (int z = 0; z < SizeZ; z++)
+		auto Blocks = a_Parser->GetBlockTypes();
+		auto Metas  = a_Parser->GetBlockMetas();
+		for (int y = 0; y < SizeY; y++)
 		{
-			for (int x = 0; x < SizeX; x++)
+			for (int z = 0; z < SizeZ; z++)
 			{
-				int idx = StartX + x + (StartZ + z) * Width + (StartY + y) * Width * Length;
-				Byte BlockType = Blocks[idx];
-				Byte BlockMeta = Metas[idx] & 0x0f;
-				Img.SetBlock(x, y, z, BlockType, BlockMeta);
+				for (int x = 0; x < SizeX; x++)
+				{
+					int idx = StartX + x + (StartZ + z) * Width + (StartY + y) * Width * Length;
+					Byte BlockType = Blocks[idx];
+					Byte BlockMeta = Metas[idx] & 0x0f;
+					Img->SetBlock(x, y, z, BlockType, BlockMeta);
+				}
 			}
 		}
 	}
 
 	// Apply the rotations:
+	auto RotateStart = cStageStats::Now();
 	for (int i = 0; i < a_Item.m_NumCCWRotations; i++)
 	{
-		Img.RotateCCW();
+		Img->RotateCCW();
 	}
-
-	// Export as PNG image:
-	cPngExporter::Export(Img, a_Item.m_OutputFileName, a_Item.m_HorzSize, a_Item.m_VertSize, a_Item.m_Markers);
+	if (a_Times != nullptr)
+	{
+		a_Times->m_StageNsec[cStageStats::stExtract] = RotateStart - ExtractStart;
+		a_Times->m_StageNsec[cStageStats::stRotate] = cStageStats::Now() - RotateStart;
+	}
+	return Img;
 }
 
 
@@ -578,7 +1897,7 @@ void cSchematicToPng::NetAcceptThread(SOCKET s)
 		send(n, WelcomeMsg.data(), WelcomeMsg.size(), 0);
 
 		// Create a new thread that parses queue items out from the socket:
-		auto thr = std::thread(std::bind(&cSchematicToPng::ProcessQueueStream, this, std::make_shared<cSocketInputStream>(n)));
+		auto thr = std::thread(std::bind(&cSchematicToPng::ProcessQueueStream, this, std::make_shared<cSocketInputStream>(n), false));
 		thr.detach();
 	}
 }
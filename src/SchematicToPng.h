@@ -11,11 +11,29 @@
 
 #include "Marker.h"
 #include "InputStream.h"
+#include "ArchiveWriter.h"
+#include "BoundedQueue.h"
+#include "TaskScheduler.h"
+#include "BuildManifest.h"
+#include "FolderWatcher.h"
+#include "StageStats.h"
 
 
 
 
 
+// fwd:
+class cBlockImage;
+class cPngExporter;
+class cSchematic;
+class cSchematicParser;
+namespace Json
+{
+	class Value;
+}
+
+
+
 
 class cSchematicToPng
 {
@@ -29,6 +47,13 @@ public:
 	
 	/** Runs the entire app. */
 	void Run(void);
+
+	/** Returns true if the app was started in the pipe mode (rendering a single schematic from stdin to stdout). */
+	bool IsPipeMode(void) const { return m_IsPipeMode; }
+
+	/** Runs the pipe mode: reads the schematic data from stdin, renders it using the default properties and writes
+	the PNG data to stdout. Runs entirely in the calling thread. Returns true on success. */
+	bool RunPipe(void);
 	
 protected:
 
@@ -49,6 +74,24 @@ protected:
 		cMarkerPtrs m_Markers;
 		cInputStreamPtr m_ErrorOut;
 
+		/** The marker specifications, as listed, separated by newlines. Identify the markers in the incremental build key. */
+		AString m_MarkerSpecs;
+
+		/** The key of the item's build in the incremental build manifest, set by the read stage. Empty if not used. */
+		AString m_ManifestKey;
+
+		/** The sequence number of the item, assigned when queued. Identifies the item's events in the trace. */
+		Int64 m_ID;
+
+		/** If true, m_InputFileName is an Anvil world folder and the area between the m_Area coords (inclusive) is rendered from it. */
+		bool m_HasArea;
+		int m_AreaMinX;
+		int m_AreaMinY;
+		int m_AreaMinZ;
+		int m_AreaMaxX;
+		int m_AreaMaxY;
+		int m_AreaMaxZ;
+
 		cQueueItem(const AString & a_InputFileName, cInputStreamPtr a_ErrorOut):
 			m_InputFileName(a_InputFileName),
 			m_OutputFileName(cFile::ChangeFileExt(a_InputFileName, "png")),
@@ -61,54 +104,199 @@ protected:
 			m_HorzSize(4),
 			m_VertSize(5),
 			m_NumCCWRotations(0),
-			m_ErrorOut(a_ErrorOut)
+			m_ErrorOut(a_ErrorOut),
+			m_ID(0),
+			m_HasArea(false),
+			m_AreaMinX(0),
+			m_AreaMinY(0),
+			m_AreaMinZ(0),
+			m_AreaMaxX(0),
+			m_AreaMaxY(0),
+			m_AreaMaxZ(0)
 		{
 		}
 	};
 
 	typedef std::shared_ptr<cQueueItem> cQueueItemPtr;
-	typedef std::vector<cQueueItemPtr> cQueueItemPtrs;
 
 
-	/** A single thread processing the schematic files from the queue */
-	class cThread :
-		public cIsThread
+	/** An input file on its way through the read and decode stages, shared by all the queue items rendering it,
+	so that the file is read and decoded only once for all of them. */
+	struct cBatchInput
+	{
+		/** The items rendering this input, in the order in which they were queued. */
+		std::vector<cQueueItemPtr> m_Items;
+
+		/** The raw contents of the input file, filled by the read stage. Empty for world areas, those are read by the decode stage. */
+		AString m_FileData;
+
+		/** The uncompressed NBT data, used only if there are multiple items; m_Parser points into it.
+		A single item uses the decoding worker's buffer instead. */
+		AString m_NBTData;
+
+		/** The parser of the MCEdit schematic NBT data, filled by the decode stage. */
+		std::unique_ptr<cSchematicParser> m_Parser;
+
+		/** The decoded blocks of the inputs other than MCEdit schematics, filled by the decode stage. */
+		std::shared_ptr<cSchematic> m_Decoded;
+
+		/** The times of the read and decode stages, if the stats are enabled. */
+		cStageStats::cTimes m_Times;
+	};
+
+	typedef std::shared_ptr<cBatchInput> cBatchInputPtr;
+
+
+	/** A single item on its way through the render, encode and write stages, accumulating the results of the stages. */
+	struct cBatchJob
 	{
-		typedef cIsThread super;
-		
-	public:
-		cThread(cSchematicToPng & a_Parent);
-		
-	protected:
-		cSchematicToPng & m_Parent;
-		
-		
-		/** Processes the specified item from the queue. */
-		void ProcessItem(const cQueueItem & a_Item);
-		
-		// cIsThread overrides:
-		virtual void Execute(void) override;
-	} ;
-
-	typedef std::shared_ptr<cThread> cThreadPtr;
-	typedef std::vector<cThreadPtr> cThreadPtrs;
-
-
-	/** The mutex protecting m_Queue agains multithreaded access. */
-	cCriticalSection m_CS;
-
-	/** The queue of schematic files to be processed by the threads. Protected by m_CS. */
-	cQueueItemPtrs m_Queue;
-
-	/** Event that is set each time a new item arrives into m_Queue. */
-	cEvent m_evtQueue;
-
-	/** List of threads that the server has running. */
-	cThreadPtrs m_Threads;
-
-	/** The number of threads that should be started. Configurable on the command line. */
+		cQueueItemPtr m_Item;
+
+		/** The cropped and rotated blocks, filled by the decode stage. */
+		std::unique_ptr<cBlockImage> m_BlockImage;
+
+		/** The exporter holding the rasterized image, filled by the render stage. */
+		std::unique_ptr<cPngExporter> m_Exporter;
+
+		/** The encoded PNG data, filled by the encode stage. */
+		AString m_PngData;
+
+		/** The times of the item's stages (including its input's ones), if the stats are enabled. */
+		cStageStats::cTimes m_Times;
+	};
+
+	typedef std::shared_ptr<cBatchJob> cBatchJobPtr;
+	typedef cBoundedQueue<cBatchJobPtr> cBatchJobQueue;
+
+
+	/** A source of the items to process, specified on the command line. */
+	struct cInputSource
+	{
+		enum eKind
+		{
+			isListFile,  ///< m_Path is a listfile
+			isStdin,     ///< The listfile is read from stdin
+			isFolder,    ///< The files in the m_Path folder matching m_Patterns are processed, with the default properties
+			isWatched,   ///< The files saved into the m_Path folder matching m_FolderPatterns are processed, with the default properties
+			isJsonLines, ///< m_Path is a JSON-lines job list ("-" for stdin)
+		} m_Kind;
+
+		AString m_Path;
+
+		/** The wildcard patterns of the files to process, for isFolder. If empty, m_FolderPatterns is used. */
+		AStringVector m_Patterns;
+
+		cInputSource(eKind a_Kind, const AString & a_Path):
+			m_Kind(a_Kind),
+			m_Path(a_Path)
+		{
+		}
+	};
+
+
+	/** The queue of schematic files to be processed, in the order in which they will be processed.
+	Bounded, so that the inputs are parsed only as fast as the items are processed and the memory stays flat. */
+	cBoundedQueue<cQueueItemPtr> m_Queue;
+
+	/** The sources of the items, in the order in which they were specified on the command line. */
+	std::vector<cInputSource> m_InputSources;
+
+	/** The thread processing m_InputSources into m_Queue, while the pipeline is already processing the items. */
+	std::thread m_InputThread;
+
+	/** Protects m_OrderWindow and m_OrderWindowSize, while they are used by multiple folder scanning threads. */
+	std::mutex m_OrderWindowMutex;
+
+	/** The items parsed from the inputs, waiting to be ordered by cost and queued. */
+	std::vector<cQueueItemPtr> m_OrderWindow;
+
+	/** The number of items in m_OrderWindow at which it is ordered and queued. Starts small, so that the first items
+	are processed soon, and grows up to ORDER_WINDOW_MAX_ITEMS. */
+	size_t m_OrderWindowSize;
+
+	/** The wildcard patterns of the files processed from the folders given by "-dir". */
+	AStringVector m_FolderPatterns;
+
+	/** If true, the subfolders of the input folders are scanned as well. */
+	bool m_IsRecursive;
+
+	/** The folder where the images of the files found in the input folders are written, mirroring their subfolders.
+	Ends with a slash. If empty, each image is written next to its input file. */
+	AString m_OutputFolder;
+
+	/** The watchers of the folders given by "-watch", running until the app terminates. */
+	std::vector<std::unique_ptr<cFolderWatcher>> m_FolderWatchers;
+
+	/** The item holding the default properties of the files found in the input folders. */
+	cQueueItemPtr m_DefaultItem;
+
+	/** Runs the CPU-bound stages of the batch pipeline (decode, render, encode) as tasks, on m_NumThreads workers. */
+	cTaskScheduler m_Scheduler;
+
+	/** The queue of the encoded jobs waiting for the write stage. */
+	cBatchJobQueue m_WriteQueue;
+
+	/** The threads of the I/O stages of the batch pipeline (read, write). */
+	std::vector<std::thread> m_ReadThreads;
+	std::vector<std::thread> m_WriteThreads;
+
+	/** Protects m_NumJobsInFlight against multithreaded access. */
+	std::mutex m_JobsMutex;
+
+	/** Signalled when a job leaves the pipeline. */
+	std::condition_variable m_CondJobFinished;
+
+	/** The number of items read but not yet written (or failed). Protected by m_JobsMutex.
+	The read stage waits while this is at m_MaxJobsInFlight, so that the memory used by the pipeline stays bounded;
+	an input shared by several items is grouped with only as many of them as there are free slots, so the limit is never exceeded. */
+	int m_NumJobsInFlight;
+	int m_MaxJobsInFlight;
+
+	/** The time of the last manifest save when running until terminated, see FinishJobs(). Protected by m_JobsMutex. */
+	std::chrono::steady_clock::time_point m_LastManifestSave;
+
+	/** The number of workers running the CPU-bound stages. Configurable on the command line. */
 	int m_NumThreads;
 
+	/** The number of threads in each of the I/O stages (read, write). Configurable on the command line. */
+	int m_NumIOThreads;
+
+	/** The number of threads in the write stage, if set on the command line; 0 to use m_NumIOThreads.
+	More writers keep more writes in flight, which helps on filesystems with a high latency (network). */
+	int m_NumWriteThreads;
+
+	/** The order in which the batch items are processed. */
+	enum eOrder
+	{
+		ordLargestFirst,  ///< The items estimated to be the most expensive first, to shorten the tail of the batch (default)
+		ordListed,        ///< The order in which they are listed in the listfiles
+	} m_Order;
+
+	/** The manifest of the outputs built by the previous runs, for the incremental builds. Enabled on the command line. */
+	cBuildManifest m_Manifest;
+
+	/** The number of items skipped because their output was up to date. */
+	std::atomic<int> m_NumUpToDate;
+
+	/** The number of temporary output files created so far, used to give each of them a unique name. */
+	std::atomic<int> m_NumTempFiles;
+
+	/** The per-stage timings of the batch pipeline, collected if enabled on the command line and reported at the end. */
+	cStageStats m_Stats;
+
+	/** The file into which the stage timings are written as JSON, if requested on the command line. */
+	AString m_StatsFileName;
+
+	/** The number of items queued so far, used to assign the items' IDs. */
+	std::atomic<Int64> m_NumQueuedItems;
+
+	/** The file into which the trace of the pipeline is written, if requested on the command line. */
+	AString m_TraceFileName;
+
+	/** The archive into which all the output images are stored, if enabled on the command line.
+	When open, the write stage runs a single thread that serializes the images into it, instead of writing files. */
+	cArchiveWriter m_Archive;
+
 	/** The thread that accepts incoming connections in the network-daemon mode. */
 	std::thread m_NetAcceptThread;
 
@@ -116,13 +304,117 @@ protected:
 	Used for network-daemon mode. */
 	bool m_KeepRunning;
 
+	/** If true, a single schematic is rendered from stdin to stdout by RunPipe(), instead of running the batch pipeline. */
+	bool m_IsPipeMode;
 
-	/** Retrieves one item from the queue (and removes it from the queue).
-	Returns nullptr when queue empty. */
+
+	/** Retrieves one item from the queue (and removes it from the queue), in the order in which they were queued.
+	Waits for an item to arrive if the queue is empty; returns nullptr once the queue is closed and empty. */
 	cQueueItemPtr GetNextQueueItem(void);
 
-	/** Processes a stream with the queue list into m_Queue. */
-	void ProcessQueueStream(cInputStreamPtr a_Input);
+	/** The body of m_InputThread: processes the input sources into m_Queue, then closes the queue (unless running as a daemon). */
+	void InputThread(void);
+
+	/** Scans the folder tree of the input source and queues all the files found in it, with the default properties. */
+	void ScanInputFolder(const cInputSource & a_Source);
+
+	/** Starts watching the folder tree of the input source, queueing the files saved into it, with the default properties. */
+	void WatchInputFolder(const cInputSource & a_Source);
+
+	/** Creates a new item, with the default properties, for the file found in an input folder.
+	a_Folder is the input folder, ending with a slash (unless empty); a_RelFolder is the file's folder relative to it. */
+	cQueueItemPtr CreateFolderItem(const AString & a_Folder, const AString & a_RelFolder, const AString & a_FileName);
+
+	/** Queues the item parsed from a listfile, found in a folder, or received from the network.
+	If a_ShouldOrder is true, the item is added into m_OrderWindow, which is queued once full; otherwise it is queued directly.
+	May be called from multiple threads at once. */
+	void QueueItem(cQueueItemPtr && a_Item, bool a_ShouldOrder);
+
+	/** Queues the items waiting in m_OrderWindow, using QueueByCost(). */
+	void FlushOrderWindow(void);
+
+	/** Queues the items so that the most expensive ones are processed first (Longest Processing Time first),
+	so that the batch doesn't end with a few workers processing huge items while the others are idle.
+	The items sharing an input file are kept together, so that the read stage picks them as a single input,
+	ordered by their total cost. Items with the same cost keep their listed order.
+	The costs are estimated in parallel, with the help of the idle workers. Called without m_OrderWindowMutex held,
+	so that the other threads can keep adding items while this one estimates and waits for the space in m_Queue. */
+	void QueueByCost(std::vector<cQueueItemPtr> && a_Items);
+
+	/** Finds the dimensions of the item's whole input: peeked from the start of the file, or guessed from the file size.
+	Returns false if the input cannot be read. */
+	static bool EstimateInputSize(const cQueueItem & a_Item, int (&a_Size)[3]);
+
+	/** Estimates the relative cost of processing the item, whose whole input has the specified dimensions:
+	the number of blocks after cropping, times the number of pixels drawn per block. */
+	static UInt64 EstimateCost(const cQueueItem & a_Item, const int (&a_Size)[3]);
+
+	/** Returns true if the two items render the same input file, so that they can share its reading and decoding.
+	World areas are never shared, each of them reads only the part of the world it needs. */
+	static bool IsSameInput(const cQueueItem & a_Item1, const cQueueItem & a_Item2);
+
+	/** The read stage, run by each of the read threads: takes the items from m_Queue, together with the queued items
+	sharing the same input file, reads their input file into memory and submits the decode task. */
+	void ReadStage(void);
+
+	/** Removes the items whose output is up to date, according to m_Manifest, from the input, marking them as finished.
+	Sets the manifest key of the remaining items. The input's file data must have been read already. */
+	void RemoveUpToDateItems(cBatchInput & a_Input);
+
+	/** Returns the key identifying the item's build, for the incremental build manifest:
+	the renderer version, the block colors, the input file contents and all the params affecting the image. */
+	static AString GetManifestKey(const cQueueItem & a_Item, const AString & a_FileData);
+
+	/** The decode task: parses the file data (or loads the world area) and extracts the items' block images from it.
+	With multiple items, the extraction of each of them is submitted as a separate task. */
+	void DecodeTask(const cBatchInputPtr & a_Input);
+
+	/** The extract task: crops and rotates the item's block image out of the decoded input, then continues with its rendering. */
+	void ExtractTask(const cBatchInputPtr & a_Input, const cQueueItemPtr & a_Item);
+
+	/** The render task: draws the block image and markers. Large images are split into bands rendered as separate tasks. */
+	void RenderTask(const cBatchJobPtr & a_Job);
+
+	/** The encode task: compresses the rendered image into PNG data and hands it over to the write stage. */
+	void EncodeTask(const cBatchJobPtr & a_Job);
+
+	/** The write stage, run by each of the write threads: writes the PNG data into the output files,
+	or appends it to the archive. */
+	void WriteStage(void);
+
+	/** Writes the data into the specified file, creating its folder if needed.
+	The data is written into a temporary file next to it first, then renamed over the file, so that the file
+	is replaced atomically and readers never see a partially written image. Returns true on success. */
+	bool WriteOutputFile(const AString & a_FileName, const AString & a_Data);
+
+	/** Marks the specified number of items as having left the pipeline, letting the read stage start others.
+	When running until terminated, also saves the manifest from time to time. */
+	void FinishJobs(int a_NumJobs);
+
+	/** Decodes the input, filling either its m_Parser (MCEdit schematic) or m_Decoded (other inputs).
+	a_NBTBuffer receives the uncompressed NBT data that m_Parser points into.
+	Reports the errors to the error outputs of all the input's items and returns false on failure. */
+	bool DecodeInput(cBatchInput & a_Input, AString & a_NBTBuffer);
+
+	/** Crops and rotates the blocks of the item, loaded either by a_Parser (MCEdit schematic) or into a_Decoded (other inputs).
+	Exactly one of the two is non-nullptr. Reports the errors to the item's error output and returns nullptr on failure.
+	If a_Times is given, the times of the extract and rotate stages are stored in it. */
+	std::unique_ptr<cBlockImage> ExtractBlockImage(const cQueueItem & a_Item, const cSchematicParser * a_Parser, const cSchematic * a_Decoded, cStageStats::cTimes * a_Times = nullptr);
+
+	/** Processes a stream with the queue list into m_Queue. If a_ShouldOrder is true, the items are ordered by their cost. */
+	void ProcessQueueStream(cInputStreamPtr a_Input, bool a_ShouldOrder);
+
+	/** Processes a stream with the JSON-lines job list into m_Queue, each line as soon as it is read.
+	If a_ShouldOrder is true, the items are ordered by their cost. Invalid lines are reported and skipped. */
+	void ProcessJsonLinesStream(cInputStreamPtr a_Input, bool a_ShouldOrder);
+
+	/** Applies the properties from a job (or variant) object of the JSON-lines job list to the specified queue item.
+	The members are named the same as the parameters of the JSON protocol's RenderSchematic command.
+	Reports the errors to a_Input and returns false on error. */
+	bool ApplyJsonProperties(cInputStreamPtr a_Input, cQueueItem & a_Item, const Json::Value & a_Props);
+
+	/** Sets the item to render the area between the two corners (given in any order) of an Anvil world. */
+	static void SetArea(cQueueItem & a_Item, const int (&a_Coords)[6]);
 
 	/** Applies the property specified in a_PropertyLine to the specified queue item.
 	Returns true if successful, outputs message to stderr and returns false on error. */
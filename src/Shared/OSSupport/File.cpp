@@ -364,6 +364,20 @@ int cFile::GetSize(const AString & a_FileName)
 
 
 
+unsigned cFile::GetLastModificationTime(const AString & a_FileName)
+{
+	struct stat st;
+	if (stat(a_FileName.c_str(), &st) != 0)
+	{
+		return 0;
+	}
+	return static_cast<unsigned>(st.st_mtime);
+}
+
+
+
+
+
 bool cFile::CreateFolder(const AString & a_FolderPath)
 {
 	#ifdef _WIN32
@@ -377,6 +391,27 @@ bool cFile::CreateFolder(const AString & a_FolderPath)
 
 
 
+bool cFile::CreateFolderRecursive(const AString & a_FolderPath)
+{
+	// Create all the parent folders first, skipping the root and the drive letter:
+	for (size_t i = 1; i < a_FolderPath.size(); i++)
+	{
+		if (((a_FolderPath[i] == '/') || (a_FolderPath[i] == PathSeparator)) && (a_FolderPath[i - 1] != ':'))
+		{
+			AString Parent = a_FolderPath.substr(0, i);
+			if (!IsFolder(Parent))
+			{
+				CreateFolder(Parent);
+			}
+		}
+	}
+	return (CreateFolder(a_FolderPath) || IsFolder(a_FolderPath));
+}
+
+
+
+
+
 AStringVector cFile::GetFolderContents(const AString & a_Folder)
 {
 	AStringVector AllFiles;
@@ -438,6 +473,114 @@ AStringVector cFile::GetFolderContents(const AString & a_Folder)
 
 
 
+bool cFile::GetFolderContents(const AString & a_Folder, AStringVector & a_Files, AStringVector & a_Folders)
+{
+	#ifdef _WIN32
+
+	AString FileFilter = a_Folder;
+	if (
+		!FileFilter.empty() &&
+		(FileFilter[FileFilter.length() - 1] != '\\') &&
+		(FileFilter[FileFilter.length() - 1] != '/')
+	)
+	{
+		FileFilter.push_back('\\');
+	}
+	FileFilter.append("*.*");
+	HANDLE hFind;
+	WIN32_FIND_DATAA FindFileData;
+	if ((hFind = FindFirstFileA(FileFilter.c_str(), &FindFileData)) == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	do
+	{
+		const char * Name = FindFileData.cFileName;
+		if ((strcmp(Name, ".") == 0) || (strcmp(Name, "..") == 0))
+		{
+			continue;
+		}
+		if ((FindFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+		{
+			if ((FindFileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0)
+			{
+				a_Folders.push_back(Name);
+			}
+		}
+		else
+		{
+			a_Files.push_back(Name);
+		}
+	} while (FindNextFileA(hFind, &FindFileData));
+	FindClose(hFind);
+	return true;
+
+	#else  // _WIN32
+
+	AString Folder = a_Folder.empty() ? AString(".") : a_Folder;
+	DIR * dp = opendir(Folder.c_str());
+	if (dp == nullptr)
+	{
+		return false;
+	}
+	if (Folder.back() != '/')
+	{
+		Folder.push_back('/');
+	}
+	struct dirent * dirp;
+	while ((dirp = readdir(dp)) != nullptr)
+	{
+		const char * Name = dirp->d_name;
+		if ((strcmp(Name, ".") == 0) || (strcmp(Name, "..") == 0))
+		{
+			continue;
+		}
+		switch (dirp->d_type)
+		{
+			case DT_REG: a_Files.push_back(Name); break;
+			case DT_DIR: a_Folders.push_back(Name); break;
+			case DT_LNK:
+			case DT_UNKNOWN:
+			{
+				// The type is not known without a stat(); folders are only accepted if they are not symlinks:
+				AString Path = Folder + Name;
+				struct stat st;
+				if (lstat(Path.c_str(), &st) != 0)
+				{
+					break;
+				}
+				bool IsLink = S_ISLNK(st.st_mode);
+				if (IsLink && (stat(Path.c_str(), &st) != 0))
+				{
+					break;
+				}
+				if (S_ISREG(st.st_mode))
+				{
+					a_Files.push_back(Name);
+				}
+				else if (S_ISDIR(st.st_mode) && !IsLink)
+				{
+					a_Folders.push_back(Name);
+				}
+				break;
+			}
+			default:
+			{
+				// Pipes, sockets, devices - ignore
+				break;
+			}
+		}
+	}
+	closedir(dp);
+	return true;
+
+	#endif  // else _WIN32
+}
+
+
+
+
+
 AString cFile::ReadWholeFile(const AString & a_FileName)
 {
 	cFile f;
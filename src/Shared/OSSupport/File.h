@@ -120,9 +120,16 @@ public:
 	
 	/** Returns the size of the file, or a negative number on error */
 	static int GetSize(const AString & a_FileName);
+
+	/** Returns the last modification time of the file, as a Unix timestamp, or 0 on error */
+	static unsigned GetLastModificationTime(const AString & a_FileName);
 	
 	/** Creates a new folder with the specified name. Returns true if successful. Path may be relative or absolute */
 	static bool CreateFolder(const AString & a_FolderPath);
+
+	/** Creates a new folder with the specified name, creating its parents if needed. Path may be relative or absolute.
+	Returns true if the folder exists afterwards (created now, or already present). */
+	static bool CreateFolderRecursive(const AString & a_FolderPath);
 	
 	/** Returns the entire contents of the specified file as a string. Returns empty string on error. */
 	static AString ReadWholeFile(const AString & a_FileName);
@@ -136,6 +143,12 @@ public:
 	/** Returns the list of all items in the specified folder (files, folders, nix pipes, whatever's there). */
 	static AStringVector GetFolderContents(const AString & a_Folder);  // Exported in ManualBindings.cpp
 
+	/** Lists the regular files and the subfolders of the specified folder separately, without the "." and ".." entries.
+	Uses the entry types reported by the folder listing, so that most filesystems need no extra stat() per entry.
+	Symlinks are followed for files, but not for folders, so that a recursive scan cannot loop.
+	Returns false if the folder cannot be listed. */
+	static bool GetFolderContents(const AString & a_Folder, AStringVector & a_Files, AStringVector & a_Folders);
+
 	int Printf(const char * a_Fmt, ...) FORMATSTRING(2, 3);
 	
 	/** Flushes all the bufferef output into the file (only when writing) */
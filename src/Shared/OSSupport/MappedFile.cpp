@@ -0,0 +1,169 @@
+
+// MappedFile.cpp
+
+// Implements the cMappedFile class representing a read-only memory-mapped file
+
+#include "Globals.h"
+#include "MappedFile.h"
+#ifndef _WIN32
+	#include <sys/mman.h>
+#endif  // !_WIN32
+
+
+
+
+
+cMappedFile::cMappedFile(void) :
+	m_Data(nullptr),
+	m_Size(0),
+	m_IsOpen(false),
+	#ifdef _WIN32
+	m_File(INVALID_HANDLE_VALUE),
+	m_Mapping(nullptr)
+	#else
+	m_File(-1)
+	#endif
+{
+}
+
+
+
+
+
+cMappedFile::~cMappedFile()
+{
+	Close();
+}
+
+
+
+
+
+#ifdef _WIN32
+
+bool cMappedFile::Open(const AString & a_FileName)
+{
+	ASSERT(!IsOpen());  // You should close the file before opening another one
+	Close();
+
+	m_File = CreateFileA((FILE_IO_PREFIX + a_FileName).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER Size;
+	if (!GetFileSizeEx(m_File, &Size))
+	{
+		Close();
+		return false;
+	}
+	m_IsOpen = true;
+	m_Size = static_cast<size_t>(Size.QuadPart);
+	if (m_Size == 0)
+	{
+		// Empty files cannot be mapped
+		return true;
+	}
+	m_Mapping = CreateFileMapping(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_Data = reinterpret_cast<const char *>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_Data == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+
+
+
+
+void cMappedFile::Close(void)
+{
+	if (m_Data != nullptr)
+	{
+		UnmapViewOfFile(m_Data);
+		m_Data = nullptr;
+	}
+	if (m_Mapping != nullptr)
+	{
+		CloseHandle(m_Mapping);
+		m_Mapping = nullptr;
+	}
+	if (m_File != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_File);
+		m_File = INVALID_HANDLE_VALUE;
+	}
+	m_Size = 0;
+	m_IsOpen = false;
+}
+
+#else  // _WIN32
+
+bool cMappedFile::Open(const AString & a_FileName)
+{
+	ASSERT(!IsOpen());  // You should close the file before opening another one
+	Close();
+
+	m_File = open((FILE_IO_PREFIX + a_FileName).c_str(), O_RDONLY);
+	if (m_File < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if ((fstat(m_File, &st) != 0) || !S_ISREG(st.st_mode))
+	{
+		Close();
+		return false;
+	}
+	m_IsOpen = true;
+	m_Size = static_cast<size_t>(st.st_size);
+	if (m_Size == 0)
+	{
+		// Empty files cannot be mapped
+		return true;
+	}
+	void * Data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (Data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	m_Data = reinterpret_cast<const char *>(Data);
+
+	// The whole file is going to be read sequentially:
+	madvise(Data, m_Size, MADV_SEQUENTIAL);
+	return true;
+}
+
+
+
+
+
+void cMappedFile::Close(void)
+{
+	if (m_Data != nullptr)
+	{
+		munmap(const_cast<char *>(m_Data), m_Size);
+		m_Data = nullptr;
+	}
+	if (m_File >= 0)
+	{
+		close(m_File);
+		m_File = -1;
+	}
+	m_Size = 0;
+	m_IsOpen = false;
+}
+
+#endif  // else _WIN32
+
+
+
+
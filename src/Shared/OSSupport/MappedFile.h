@@ -0,0 +1,67 @@
+
+// MappedFile.h
+
+// Declares the cMappedFile class representing a read-only memory-mapped file
+
+/*
+The whole file is mapped into the process' address space, so that it can be processed directly, without
+reading it into a buffer first. The mapping is valid until the object is closed or destroyed.
+Usage:
+1, Construct a cMappedFile instance
+2, Open a file using Open(), check return value for success
+3, Use GetData() and GetSize() to access the contents
+4, Destroy the instance
+*/
+
+
+
+
+
+#pragma once
+
+
+
+
+
+class cMappedFile
+{
+public:
+	cMappedFile(void);
+
+	/** Auto-closes the file, if open */
+	~cMappedFile();
+
+	/** Opens the file and maps all its contents into memory. Returns true if successful.
+	Empty files are opened successfully, but GetData() returns nullptr for them. */
+	bool Open(const AString & a_FileName);
+
+	/** Unmaps and closes the file. Closing an unopened file is a legal nop. */
+	void Close(void);
+
+	bool IsOpen(void) const { return m_IsOpen; }
+
+	/** Returns the pointer to the mapped file contents, or nullptr if not open or empty. */
+	const char * GetData(void) const { return m_Data; }
+
+	/** Returns the size of the mapped file contents, in bytes. */
+	size_t GetSize(void) const { return m_Size; }
+
+protected:
+	const char * m_Data;
+	size_t m_Size;
+	bool m_IsOpen;
+
+	#ifdef _WIN32
+	HANDLE m_File;
+	HANDLE m_Mapping;
+	#else
+	int m_File;
+	#endif
+
+private:
+	DISALLOW_COPY_AND_ASSIGN(cMappedFile);
+} ;
+
+
+
+
@@ -117,60 +117,254 @@ int CompressStringGZIP(const char * a_Data, size_t a_Length, AString & a_Compres
 
 
 
-extern int UncompressStringGZIP(const char * a_Data, size_t a_Length, AString & a_Uncompressed)
+/** The maximum compression ratio achievable by deflate; GZIP size hints above this ratio are considered bogus. */
+static const size_t MAX_DEFLATE_RATIO = 1032;
+
+/** zlib only takes 32-bit sizes, larger data needs to be processed in chunks of at most this size. */
+static const size_t MAX_ZLIB_CHUNK = 1024 MiB;
+
+
+
+
+
+/** Provides the compressed data to InflateGZIP() in chunks. */
+class cInflateSource
 {
-	// Uncompresses a_Data into a_Uncompressed using GZIP; returns Z_OK for success or Z_XXX error constants same as zlib
+public:
+	virtual ~cInflateSource() {}
 
-	a_Uncompressed.reserve(a_Length);
+	/** Returns the next chunk of the compressed data, at most MAX_ZLIB_CHUNK bytes long.
+	Returns false if there is no more data. */
+	virtual bool GetNextChunk(const char *& a_Data, size_t & a_Size) = 0;
+};
+
+
+
+
+
+/** Provides compressed data from a memory buffer. */
+class cMemoryInflateSource:
+	public cInflateSource
+{
+public:
+	cMemoryInflateSource(const char * a_Data, size_t a_Length):
+		m_Data(a_Data),
+		m_Length(a_Length)
+	{
+	}
+
+	virtual bool GetNextChunk(const char *& a_Data, size_t & a_Size) override
+	{
+		if (m_Length == 0)
+		{
+			return false;
+		}
+		a_Data = m_Data;
+		a_Size = std::min(m_Length, MAX_ZLIB_CHUNK);
+		m_Data += a_Size;
+		m_Length -= a_Size;
+		return true;
+	}
+
+protected:
+	const char * m_Data;
+	size_t m_Length;
+};
+
+
+
+
+
+/** Maps each char to its Base64 value; -1 for the padding char, -2 for chars that are not part of Base64 (skipped). */
+static const signed char g_UnBase64[256] =
+{
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, 62, -2, -2, -2, 63,  // '+', '/'
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -2, -2, -2, -1, -2, -2,  // '0' - '9', '='
+	-2,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,  // 'A' - 'O'
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -2, -2, -2, -2, -2,  // 'P' - 'Z'
+	-2, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,  // 'a' - 'o'
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -2, -2, -2, -2, -2,  // 'p' - 'z'
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+	-2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2, -2,
+};
+
+
+
+
+
+/** Provides compressed data by decoding Base64 text in small chunks, so that the whole decoded data is never stored.
+Decodes the same way as Base64Decode() does - skips invalid chars and stops at the padding. */
+class cBase64InflateSource:
+	public cInflateSource
+{
+public:
+	cBase64InflateSource(const char * a_Base64, size_t a_Length):
+		m_Base64(a_Base64),
+		m_Length(a_Length),
+		m_Pos(0),
+		m_Bits(0),
+		m_NumBits(0)
+	{
+	}
+
+	virtual bool GetNextChunk(const char *& a_Data, size_t & a_Size) override
+	{
+		size_t NumOut = 0;
+		while ((m_Pos < m_Length) && (NumOut < sizeof(m_Buffer)))
+		{
+			int c = g_UnBase64[static_cast<Byte>(m_Base64[m_Pos])];
+			m_Pos++;
+			if (c == -1)
+			{
+				// Padding, no more data
+				m_Pos = m_Length;
+				break;
+			}
+			if (c < 0)
+			{
+				continue;
+			}
+			m_Bits = (m_Bits << 6) | static_cast<UInt32>(c);
+			m_NumBits += 6;
+			if (m_NumBits >= 8)
+			{
+				m_NumBits -= 8;
+				m_Buffer[NumOut++] = static_cast<char>(m_Bits >> m_NumBits);
+			}
+		}
+		a_Data = m_Buffer;
+		a_Size = NumOut;
+		return (NumOut > 0);
+	}
+
+protected:
+	const char * m_Base64;
+	size_t m_Length;
+	size_t m_Pos;
+
+	/** The decoded bits that haven't been output yet (the lowest m_NumBits bits). */
+	UInt32 m_Bits;
+	int m_NumBits;
+
+	/** The decoded data of the current chunk. */
+	char m_Buffer[48 KiB];
+};
+
+
+
+
+
+/** Uncompresses the GZIP data from a_Source, appending to a_Uncompressed. a_SizeHint is the expected size of the output, 0 if unknown.
+Returns Z_OK for success or Z_XXX error constants same as zlib. */
+static int InflateGZIP(cInflateSource & a_Source, size_t a_SizeHint, AString & a_Uncompressed)
+{
+	// Pre-size the output using the size hint, so that the usual single-member data
+	// is inflated in a single call, without any reallocation or copying.
+	// If the hint is wrong (multiple members, over 4 GiB, garbage), the output is grown as needed.
+	size_t OutStart = a_Uncompressed.size();
+	size_t OutPos = OutStart;
+	size_t LastMemberEnd = OutStart;
+	bool HasFinishedMember = false;
+	a_Uncompressed.resize(OutStart + ((a_SizeHint > 0) ? a_SizeHint : 64 KiB));
 
-	char Buffer[64 KiB];
 	z_stream strm;
 	memset(&strm, 0, sizeof(strm));
-	strm.next_in = (Bytef *)a_Data;
-	strm.avail_in = (uInt)a_Length;
-	strm.next_out = (Bytef *)Buffer;
-	strm.avail_out = sizeof(Buffer);
-	
 	int res = inflateInit2(&strm, 31);  // Force GZIP decoding
 	if (res != Z_OK)
 	{
 		LOG("%s: uncompression initialization failed: %d (\"%s\").", __FUNCTION__, res, strm.msg);
+		a_Uncompressed.resize(OutStart);
 		return res;
 	}
 	
+	bool HasMoreInput = true;
 	for (;;)
 	{
-		res = inflate(&strm, Z_NO_FLUSH);
+		// Provide more input and output space, if needed:
+		if ((strm.avail_in == 0) && HasMoreInput)
+		{
+			const char * Data;
+			size_t Size;
+			HasMoreInput = a_Source.GetNextChunk(Data, Size);
+			if (HasMoreInput)
+			{
+				strm.next_in = (Bytef *)Data;
+				strm.avail_in = (uInt)Size;
+			}
+		}
+		if (OutPos == a_Uncompressed.size())
+		{
+			a_Uncompressed.resize(OutStart + (OutPos - OutStart) * 2);
+		}
+		strm.next_out = (Bytef *)(&a_Uncompressed[OutPos]);
+		strm.avail_out = (uInt)std::min(a_Uncompressed.size() - OutPos, MAX_ZLIB_CHUNK);
+		uInt AvailOut = strm.avail_out;
+
+		res = inflate(&strm, Z_FINISH);
+		OutPos += AvailOut - strm.avail_out;
 		switch (res)
 		{
-			case Z_OK:
+			case Z_STREAM_END:
 			{
-				// Some data has been uncompressed. Consume the buffer and continue uncompressing
-				a_Uncompressed.append(Buffer, sizeof(Buffer) - strm.avail_out);
-				strm.next_out = (Bytef *)Buffer;
-				strm.avail_out = sizeof(Buffer);
+				// Finished uncompressing a GZIP member. If there's more data, it should be another member:
+				LastMemberEnd = OutPos;
+				HasFinishedMember = true;
+				if ((strm.avail_in == 0) && HasMoreInput)
+				{
+					const char * Data;
+					size_t Size;
+					HasMoreInput = a_Source.GetNextChunk(Data, Size);
+					if (HasMoreInput)
+					{
+						strm.next_in = (Bytef *)Data;
+						strm.avail_in = (uInt)Size;
+					}
+				}
 				if (strm.avail_in == 0)
 				{
-					// All data has been uncompressed
 					inflateEnd(&strm);
+					a_Uncompressed.resize(OutPos);
 					return Z_OK;
 				}
+				inflateReset(&strm);
 				break;
 			}
 			
-			case Z_STREAM_END:
+			case Z_OK:
+			case Z_BUF_ERROR:
 			{
-				// Finished uncompressing. Consume the rest of the buffer and return
-				a_Uncompressed.append(Buffer, sizeof(Buffer) - strm.avail_out);
-				inflateEnd(&strm);
-				return Z_OK;
+				// Either the output space or the input has been exhausted
+				if ((strm.avail_in == 0) && !HasMoreInput && (strm.avail_out > 0))
+				{
+					// All data has been uncompressed
+					inflateEnd(&strm);
+					a_Uncompressed.resize(OutPos);
+					return Z_OK;
+				}
+				break;
 			}
 			
 			default:
 			{
+				inflateEnd(&strm);
+				if (HasFinishedMember)
+				{
+					// Garbage after a complete GZIP member (such as zero padding), ignore it:
+					a_Uncompressed.resize(LastMemberEnd);
+					return Z_OK;
+				}
+
 				// An error has occurred, log it and return the error value
 				LOG("%s: uncompression failed: %d (\"%s\").", __FUNCTION__, res, strm.msg);
-				inflateEnd(&strm);
+				a_Uncompressed.resize(OutStart);
 				return res;
 			}
 		}  // switch (res)
@@ -181,6 +375,134 @@ extern int UncompressStringGZIP(const char * a_Data, size_t a_Length, AString &
 
 
 
+/** Returns the ISIZE value from the GZIP trailer (last 4 bytes, little endian), if plausible for the specified compressed size.
+Returns 0 if the value cannot have been produced by deflate. */
+static size_t CheckGZIPSizeHint(const Byte * a_Trailer, size_t a_CompressedLength)
+{
+	size_t res = static_cast<size_t>(a_Trailer[0]) | (static_cast<size_t>(a_Trailer[1]) << 8) | (static_cast<size_t>(a_Trailer[2]) << 16) | (static_cast<size_t>(a_Trailer[3]) << 24);
+	if (res / MAX_DEFLATE_RATIO > a_CompressedLength)
+	{
+		// Cannot have been compressed this much, probably trailing garbage
+		return 0;
+	}
+	return res;
+}
+
+
+
+
+
+size_t GetGZIPUncompressedSizeHint(const char * a_Data, size_t a_Length)
+{
+	// The GZIP member is at least 18 bytes (10 header + 8 trailer) and starts with the magic bytes 1f 8b:
+	if ((a_Length < 18) || (static_cast<Byte>(a_Data[0]) != 0x1f) || (static_cast<Byte>(a_Data[1]) != 0x8b))
+	{
+		return 0;
+	}
+
+	// The last 4 bytes are the ISIZE field, the uncompressed size of the last member modulo 4 GiB:
+	return CheckGZIPSizeHint(reinterpret_cast<const Byte *>(a_Data + a_Length - 4), a_Length);
+}
+
+
+
+
+
+size_t GetBase64GZIPUncompressedSizeHint(const char * a_Base64, size_t a_Length)
+{
+	// Strip the padding and any trailing non-Base64 chars:
+	while ((a_Length > 0) && (g_UnBase64[static_cast<Byte>(a_Base64[a_Length - 1])] < 0))
+	{
+		a_Length--;
+	}
+	if (a_Length < 24)
+	{
+		// Too short to contain a GZIP member (18 bytes)
+		return 0;
+	}
+
+	// Decode the last 8 chars (48 bits) that contain the last 4 bytes of the data.
+	// Assumes there are no non-Base64 chars in the middle; if there are, the hint is simply wrong.
+	UInt64 Bits = 0;
+	for (size_t i = a_Length - 8; i < a_Length; i++)
+	{
+		int c = g_UnBase64[static_cast<Byte>(a_Base64[i])];
+		if (c < 0)
+		{
+			return 0;
+		}
+		Bits = (Bits << 6) | static_cast<UInt64>(c);
+	}
+
+	// The decoded data ends at the last whole byte, any bits after that are padding:
+	size_t NumTrailingBits = (a_Length * 6) % 8;
+	Bits >>= NumTrailingBits;
+	Byte Trailer[4];
+	for (int i = 3; i >= 0; i--)
+	{
+		Trailer[i] = static_cast<Byte>(Bits & 0xff);
+		Bits >>= 8;
+	}
+	return CheckGZIPSizeHint(Trailer, a_Length * 6 / 8);
+}
+
+
+
+
+
+extern int UncompressStringGZIP(const char * a_Data, size_t a_Length, AString & a_Uncompressed)
+{
+	// Uncompresses a_Data into a_Uncompressed using GZIP; returns Z_OK for success or Z_XXX error constants same as zlib
+	cMemoryInflateSource Source(a_Data, a_Length);
+	return InflateGZIP(Source, GetGZIPUncompressedSizeHint(a_Data, a_Length), a_Uncompressed);
+}
+
+
+
+
+
+extern int UncompressStringGZIPHead(const char * a_Data, size_t a_Length, size_t a_MaxSize, AString & a_Uncompressed)
+{
+	a_Uncompressed.resize(a_MaxSize);
+	z_stream strm;
+	memset(&strm, 0, sizeof(strm));
+	strm.next_in = (Bytef *)a_Data;
+	strm.avail_in = (uInt)std::min(a_Length, MAX_ZLIB_CHUNK);
+	strm.next_out = (Bytef *)(&a_Uncompressed[0]);
+	strm.avail_out = (uInt)std::min(a_MaxSize, MAX_ZLIB_CHUNK);
+	uInt AvailOut = strm.avail_out;
+	int res = inflateInit2(&strm, 31);  // Force GZIP decoding
+	if (res != Z_OK)
+	{
+		a_Uncompressed.clear();
+		return res;
+	}
+
+	// The output space or the input runs out long before the end of the data, so the result is usually Z_BUF_ERROR:
+	res = inflate(&strm, Z_SYNC_FLUSH);
+	a_Uncompressed.resize(AvailOut - strm.avail_out);
+	inflateEnd(&strm);
+	if (((res == Z_OK) || (res == Z_STREAM_END) || (res == Z_BUF_ERROR)) && !a_Uncompressed.empty())
+	{
+		return Z_OK;
+	}
+	return (res == Z_OK) ? Z_BUF_ERROR : res;
+}
+
+
+
+
+
+extern int UncompressBase64GZIP(const char * a_Base64, size_t a_Length, AString & a_Uncompressed)
+{
+	cBase64InflateSource Source(a_Base64, a_Length);
+	return InflateGZIP(Source, GetBase64GZIPUncompressedSizeHint(a_Base64, a_Length), a_Uncompressed);
+}
+
+
+
+
+
 extern int InflateString(const char * a_Data, size_t a_Length, AString & a_Uncompressed)
 {
 	a_Uncompressed.reserve(a_Length);
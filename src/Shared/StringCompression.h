@@ -18,9 +18,29 @@ extern int UncompressString(const char * a_Data, size_t a_Length, AString & a_Un
 /// Compresses a_Data into a_Compressed using GZIP; returns Z_OK for success or Z_XXX error constants same as zlib
 extern int CompressStringGZIP(const char * a_Data, size_t a_Length, AString & a_Compressed);
 
-/// Uncompresses a_Data into a_Uncompressed using GZIP; returns Z_OK for success or Z_XXX error constants same as zlib
+/** Uncompresses a_Data into a_Uncompressed using GZIP; returns Z_OK for success or Z_XXX error constants same as zlib
+The uncompressed data is appended to a_Uncompressed, so that its already allocated buffer can be reused.
+Multi-member GZIP data is supported. */
 extern int UncompressStringGZIP(const char * a_Data, size_t a_Length, AString & a_Uncompressed);
 
+/** Uncompresses at most a_MaxSize bytes from the start of the GZIP data into a_Uncompressed (replacing its contents).
+Used for peeking at the headers of compressed files; a_Data may be just the start of the GZIP data.
+Returns Z_OK if at least some data was uncompressed, or Z_XXX error constants same as zlib. */
+extern int UncompressStringGZIPHead(const char * a_Data, size_t a_Length, size_t a_MaxSize, AString & a_Uncompressed);
+
+/** Returns the uncompressed size of the GZIP data, as stored in its trailer, or 0 if not available.
+This is only a hint: it is the size of the last member only, modulo 4 GiB. */
+extern size_t GetGZIPUncompressedSizeHint(const char * a_Data, size_t a_Length);
+
+/** Uncompresses the Base64-encoded GZIP data in a_Base64 into a_Uncompressed; returns Z_OK for success or Z_XXX error constants same as zlib
+The Base64 is decoded in small chunks that are fed directly into the inflater, the whole decoded data is never stored.
+The uncompressed data is appended to a_Uncompressed, same as with UncompressStringGZIP(). */
+extern int UncompressBase64GZIP(const char * a_Base64, size_t a_Length, AString & a_Uncompressed);
+
+/** Returns the uncompressed size of the Base64-encoded GZIP data, as stored in its trailer, or 0 if not available.
+The same limitations as for GetGZIPUncompressedSizeHint() apply. */
+extern size_t GetBase64GZIPUncompressedSizeHint(const char * a_Base64, size_t a_Length);
+
 /** Uncompresses a_Data into a_Uncompressed using Inflate; returns Z_OK for success or Z_XXX error constants same as zlib */
 extern int InflateString(const char * a_Data, size_t a_Length, AString & a_Uncompressed);
 
@@ -10,19 +10,54 @@
 
 
 
-/** If a list being loaded has more than this number of items, it's considered corrupted. */
-static const int MAX_LIST_ITEMS = 10000;
+/** Returns the minimum number of bytes that a payload of the specified tag type takes in the data.
+Used to reject list counts that cannot fit into the rest of the data before reading the items. */
+static size_t GetMinPayloadSize(eTagType a_Type)
+{
+	switch (a_Type)
+	{
+		case TAG_Byte:      return 1;
+		case TAG_Short:     return 2;
+		case TAG_Int:       return 4;
+		case TAG_Long:      return 8;
+		case TAG_Float:     return 4;
+		case TAG_Double:    return 8;
+		case TAG_ByteArray: return 4;  // The length
+		case TAG_String:    return 2;  // The length
+		case TAG_List:      return 5;  // The item type and the count
+		case TAG_Compound:  return 1;  // The TAG_End
+		case TAG_IntArray:  return 4;  // The length
+		case TAG_LongArray: return 4;  // The length
+		default:            return 1;  // Invalid types fail when reading the first item
+	}
+}
 
 
 
 
 
-// The number of NBT tags that are reserved when an NBT parsing is started.
+// The minimum number of NBT tags that are reserved when an NBT parsing is started.
 // You can override this by using a cmdline define
 #ifndef NBT_RESERVE_SIZE
 	#define NBT_RESERVE_SIZE 200
 #endif  // NBT_RESERVE_SIZE
 
+// The expected average number of data bytes per NBT tag, used for estimating the number of tags to reserve.
+// Tag-heavy data (tile entities, palettes) has about 8 - 16 bytes per tag, array-heavy data has much more.
+// You can override this by using a cmdline define
+#ifndef NBT_BYTES_PER_TAG_ESTIMATE
+	#define NBT_BYTES_PER_TAG_ESTIMATE 32
+#endif  // NBT_BYTES_PER_TAG_ESTIMATE
+
+// The maximum number of NBT tags that are reserved up-front, regardless of the data size.
+// Larger data grows the tag array as needed, the estimate is too rough to commit more memory on it.
+// You can override this by using a cmdline define
+#ifndef NBT_RESERVE_MAX
+	#define NBT_RESERVE_MAX 65536
+#endif  // NBT_RESERVE_MAX
+
+static_assert(sizeof(cFastNBTTag) == 24, "cFastNBTTag is expected to be compact");
+
 #ifdef _MSC_VER
 	// Dodge a C4127 (conditional expression is constant) for this specific macro usage
 	#define RETURN_FALSE_IF_FALSE(X) do { if (!X) return false; } while ((false, false))
@@ -64,19 +99,26 @@ bool cParsedNBT::Parse(void)
 		// Data too short
 		return false;
 	}
+	if (m_Length > 0xffffffffu)
+	{
+		// The tags use 32-bit offsets into the data
+		return false;
+	}
 	if (m_Data[0] != TAG_Compound)
 	{
 		// The top-level tag must be a Compound
 		return false;
 	}
 	
-	m_Tags.reserve(NBT_RESERVE_SIZE);
+	m_Tags.reserve(Clamp<size_t>(m_Length / NBT_BYTES_PER_TAG_ESTIMATE, NBT_RESERVE_SIZE, NBT_RESERVE_MAX));
 	
 	m_Tags.push_back(cFastNBTTag(TAG_Compound, -1));
 	
 	m_Pos = 1;
 	
-	RETURN_FALSE_IF_FALSE(ReadString(m_Tags.back().m_NameStart, m_Tags.back().m_NameLength));
+	UInt32 NameLength;
+	RETURN_FALSE_IF_FALSE(ReadString(m_Tags.back().m_NameStart, NameLength));
+	m_Tags.back().m_NameLength = static_cast<UInt16>(NameLength);
 	RETURN_FALSE_IF_FALSE(ReadCompound());
 	
 	return true;
@@ -86,17 +128,14 @@ bool cParsedNBT::Parse(void)
 
 
 
-bool cParsedNBT::ReadString(size_t & a_StringStart, size_t & a_StringLen)
+bool cParsedNBT::ReadString(UInt32 & a_StringStart, UInt32 & a_StringLen)
 {
 	NEEDBYTES(2);
-	a_StringStart = m_Pos + 2;
-	a_StringLen = (size_t)GetBEShort(m_Data + m_Pos);
-	if (a_StringLen > 0xffff)
-	{
-		// Suspicious string length
-		return false;
-	}
-	m_Pos += 2 + a_StringLen;
+	a_StringStart = static_cast<UInt32>(m_Pos + 2);
+	a_StringLen = static_cast<UInt16>(GetBEShort(m_Data + m_Pos));
+	m_Pos += 2;
+	NEEDBYTES(a_StringLen);
+	m_Pos += a_StringLen;
 	return true;
 }
 
@@ -120,17 +159,15 @@ bool cParsedNBT::ReadCompound(void)
 		{
 			break;
 		}
-		m_Tags.push_back(cFastNBTTag(TagType, static_cast<int>(ParentIdx), PrevSibling));
+		m_Tags.push_back(cFastNBTTag(TagType, static_cast<int>(ParentIdx)));
 		if (PrevSibling >= 0)
 		{
 			m_Tags[static_cast<size_t>(PrevSibling)].m_NextSibling = (int)m_Tags.size() - 1;
 		}
-		else
-		{
-			m_Tags[ParentIdx].m_FirstChild = (int)m_Tags.size() - 1;
-		}
 		PrevSibling = (int)m_Tags.size() - 1;
-		RETURN_FALSE_IF_FALSE(ReadString(m_Tags.back().m_NameStart, m_Tags.back().m_NameLength));
+		UInt32 NameLength;
+		RETURN_FALSE_IF_FALSE(ReadString(m_Tags.back().m_NameStart, NameLength));
+		m_Tags.back().m_NameLength = static_cast<UInt16>(NameLength);
 		RETURN_FALSE_IF_FALSE(ReadTag());
 	}  // while (true)
 	m_Tags[ParentIdx].m_LastChild = PrevSibling;
@@ -149,8 +186,9 @@ bool cParsedNBT::ReadList(eTagType a_ChildrenType)
 	NEEDBYTES(4);
 	int Count = GetBEInt(m_Data + m_Pos);
 	m_Pos += 4;
-	if ((Count < 0) || (Count > MAX_LIST_ITEMS))
+	if ((Count < 0) || (static_cast<size_t>(Count) > (m_Length - m_Pos) / GetMinPayloadSize(a_ChildrenType)))
 	{
+		// The items cannot fit into the rest of the data, the list is corrupted
 		return false;
 	}
 
@@ -160,15 +198,11 @@ bool cParsedNBT::ReadList(eTagType a_ChildrenType)
 	int PrevSibling = -1;
 	for (int i = 0; i < Count; i++)
 	{
-		m_Tags.push_back(cFastNBTTag(a_ChildrenType, static_cast<int>(ParentIdx), PrevSibling));
+		m_Tags.push_back(cFastNBTTag(a_ChildrenType, static_cast<int>(ParentIdx)));
 		if (PrevSibling >= 0)
 		{
 			m_Tags[static_cast<size_t>(PrevSibling)].m_NextSibling = static_cast<int>(m_Tags.size()) - 1;
 		}
-		else
-		{
-			m_Tags[ParentIdx].m_FirstChild = static_cast<int>(m_Tags.size()) - 1;
-		}
 		PrevSibling = static_cast<int>(m_Tags.size()) - 1;
 		RETURN_FALSE_IF_FALSE(ReadTag());
 	}  // for (i)
@@ -184,7 +218,7 @@ bool cParsedNBT::ReadList(eTagType a_ChildrenType)
 	case TAG_##TAGTYPE: \
 	{ \
 		NEEDBYTES(LEN); \
-		Tag.m_DataStart = m_Pos; \
+		Tag.m_DataStart = static_cast<UInt32>(m_Pos); \
 		Tag.m_DataLength = LEN; \
 		m_Pos += LEN; \
 		return true; \
@@ -193,7 +227,7 @@ bool cParsedNBT::ReadList(eTagType a_ChildrenType)
 bool cParsedNBT::ReadTag(void)
 {
 	cFastNBTTag & Tag = m_Tags.back();
-	switch (Tag.m_Type)
+	switch (static_cast<eTagType>(Tag.m_Type))
 	{
 		CASE_SIMPLE_TAG(Byte,   1)
 		CASE_SIMPLE_TAG(Short,  2)
@@ -218,8 +252,8 @@ bool cParsedNBT::ReadTag(void)
 				return false;
 			}
 			NEEDBYTES(len);
-			Tag.m_DataLength = static_cast<size_t>(len);
-			Tag.m_DataStart = m_Pos;
+			Tag.m_DataLength = static_cast<UInt32>(len);
+			Tag.m_DataStart = static_cast<UInt32>(m_Pos);
 			m_Pos += static_cast<size_t>(len);
 			return true;
 		}
@@ -251,12 +285,28 @@ bool cParsedNBT::ReadTag(void)
 			}
 			len *= 4;
 			NEEDBYTES(len);
-			Tag.m_DataLength = static_cast<size_t>(len);
-			Tag.m_DataStart = m_Pos;
+			Tag.m_DataLength = static_cast<UInt32>(len);
+			Tag.m_DataStart = static_cast<UInt32>(m_Pos);
 			m_Pos += static_cast<size_t>(len);
 			return true;
 		}
 		
+		case TAG_LongArray:
+		{
+			NEEDBYTES(4);
+			int len = GetBEInt(m_Data + m_Pos);
+			m_Pos += 4;
+			if ((len < 0) || (static_cast<size_t>(len) > (m_Length - m_Pos) / 8))
+			{
+				// Invalid length
+				return false;
+			}
+			Tag.m_DataLength = static_cast<UInt32>(len) * 8;
+			Tag.m_DataStart = static_cast<UInt32>(m_Pos);
+			m_Pos += Tag.m_DataLength;
+			return true;
+		}
+		
 		default:
 		{
 			ASSERT(!"Unhandled NBT tag type");
@@ -271,6 +321,25 @@ bool cParsedNBT::ReadTag(void)
 
 
 
+int cParsedNBT::GetPrevSibling(int a_Tag) const
+{
+	int Parent = m_Tags[static_cast<size_t>(a_Tag)].m_Parent;
+	if (Parent < 0)
+	{
+		return -1;
+	}
+	int Prev = -1;
+	for (int Child = GetFirstChild(Parent); (Child != a_Tag) && (Child != -1); Child = m_Tags[static_cast<size_t>(Child)].m_NextSibling)
+	{
+		Prev = Child;
+	}
+	return Prev;
+}
+
+
+
+
+
 int cParsedNBT::FindChildByName(int a_Tag, const char * a_Name, size_t a_NameLength) const
 {
 	if (a_Tag < 0)
@@ -286,7 +355,8 @@ int cParsedNBT::FindChildByName(int a_Tag, const char * a_Name, size_t a_NameLen
 	{
 		a_NameLength = strlen(a_Name);
 	}
-	for (int Child = m_Tags[static_cast<size_t>(a_Tag)].m_FirstChild; Child != -1; Child = m_Tags[static_cast<size_t>(Child)].m_NextSibling)
+
+	for (int Child = GetFirstChild(a_Tag); Child != -1; Child = m_Tags[static_cast<size_t>(Child)].m_NextSibling)
 	{
 		if (
 			(m_Tags[static_cast<size_t>(Child)].m_NameLength == a_NameLength) &&
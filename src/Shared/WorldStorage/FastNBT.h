@@ -40,7 +40,8 @@ enum eTagType
 	TAG_List      = 9,
 	TAG_Compound  = 10,
 	TAG_IntArray  = 11,
-	TAG_Max       = 11,  // The maximum value for a tag type
+	TAG_LongArray = 12,
+	TAG_Max       = 12,  // The maximum value for a tag type
 } ;
 
 
@@ -52,54 +53,51 @@ It contains indices to the parent array of tags, building the NBT tree this way.
 Also contains indices into the data stream being parsed, used for values;
 NO dynamically allocated memory is used!
 Structure (all with the tree structure it describes) supports moving in memory (std::vector reallocation)
+The structure is kept at 24 bytes, because large NBTs (palettes, tile entities) produce a lot of tags:
+the offsets are 32-bit (cParsedNBT refuses data over 4 GiB), the first child of a tag is always stored right after
+the tag itself and the previous sibling is found by walking the parent's children, so neither needs to be stored.
 */
 struct cFastNBTTag
 {
 public:
 	
-	eTagType m_Type;
-	
-	// The following members are indices into the data stream. m_DataLength == 0 if no data available
+	// The following members are indices into the data stream.
 	// They must not be pointers, because the datastream may be copied into another AString object in the meantime.
-	size_t m_NameStart;
-	size_t m_NameLength;
-	size_t m_DataStart;
-	size_t m_DataLength;
+	UInt32 m_NameStart;
+	UInt32 m_DataStart;
+	
+	union
+	{
+		/** For primitive tags, the length of the data. 0 if no data available. */
+		UInt32 m_DataLength;
+		
+		/** For Compound and List tags, the index of the last child, -1 if none. */
+		int m_LastChild;
+	};
 	
 	// The following members are indices into the array returned; -1 if not valid
 	// They must not be pointers, because pointers would not survive std::vector reallocation
 	int m_Parent;
-	int m_PrevSibling;
 	int m_NextSibling;
-	int m_FirstChild;
-	int m_LastChild;
+	
+	UInt16 m_NameLength;
+	
+	/** The eTagType of this tag, stored in a single byte. */
+	Byte m_Type;
 	
 	cFastNBTTag(eTagType a_Type, int a_Parent) :
-		m_Type(a_Type),
 		m_NameStart(0),
-		m_NameLength(0),
 		m_DataStart(0),
 		m_DataLength(0),
 		m_Parent(a_Parent),
-		m_PrevSibling(-1),
 		m_NextSibling(-1),
-		m_FirstChild(-1),
-		m_LastChild(-1)
-	{
-	}
-
-	cFastNBTTag(eTagType a_Type, int a_Parent, int a_PrevSibling) :
-		m_Type(a_Type),
-		m_NameStart(0),
 		m_NameLength(0),
-		m_DataStart(0),
-		m_DataLength(0),
-		m_Parent(a_Parent),
-		m_PrevSibling(a_PrevSibling),
-		m_NextSibling(-1),
-		m_FirstChild(-1),
-		m_LastChild(-1)
+		m_Type(static_cast<Byte>(a_Type))
 	{
+		if ((a_Type == TAG_Compound) || (a_Type == TAG_List))
+		{
+			m_LastChild = -1;
+		}
 	}
 } ;
 
@@ -111,7 +109,7 @@ public:
 Also implements data accessor functions for tree traversal and value getters
 The data pointer passed in the constructor is assumed to be valid throughout the object's life. Care must be taken not to initialize from a temporary.
 The parser decomposes the input data into a tree of tags that is stored as an array of cFastNBTTag items,
-and accessing the tree is done by using the array indices for tags. Each tag stores the indices for its parent,
+and accessing the tree is done by using the array indices for tags. The accessors return the indices for a tag's parent,
 first child, last child, prev sibling and next sibling, a value of -1 indicates that the indice is not valid.
 Each primitive tag also stores the length of the contained data, in bytes.
 */
@@ -122,20 +120,32 @@ public:
 	
 	bool IsValid(void) const {return m_IsValid; }
 	
+	/** Returns the position in the data at which the parsing failed. Only meaningful if IsValid() returns false. */
+	size_t GetErrorPos(void) const { return m_Pos; }
+	
 	/** Returns the root tag of the hierarchy. */
 	int GetRoot(void) const {return 0; }
 
 	/** Returns the first child of the specified tag, or -1 if none / not applicable. */
-	int GetFirstChild (int a_Tag) const { return m_Tags[(size_t)a_Tag].m_FirstChild; }
+	int GetFirstChild (int a_Tag) const
+	{
+		// The first child, if any, is always stored right after its parent:
+		size_t Child = static_cast<size_t>(a_Tag) + 1;
+		return ((Child < m_Tags.size()) && (m_Tags[Child].m_Parent == a_Tag)) ? static_cast<int>(Child) : -1;
+	}
 	
 	/** Returns the last child of the specified tag, or -1 if none / not applicable. */
-	int GetLastChild  (int a_Tag) const { return m_Tags[(size_t)a_Tag].m_LastChild; }
+	int GetLastChild  (int a_Tag) const
+	{
+		return IsContainer(a_Tag) ? m_Tags[(size_t)a_Tag].m_LastChild : -1;
+	}
 	
 	/** Returns the next sibling of the specified tag, or -1 if none. */
 	int GetNextSibling(int a_Tag) const { return m_Tags[(size_t)a_Tag].m_NextSibling; }
 	
-	/** Returns the previous sibling of the specified tag, or -1 if none. */
-	int GetPrevSibling(int a_Tag) const { return m_Tags[(size_t)a_Tag].m_PrevSibling; }
+	/** Returns the previous sibling of the specified tag, or -1 if none.
+	The previous sibling is not stored, this walks the parent's children up to a_Tag. */
+	int GetPrevSibling(int a_Tag) const;
 	
 	/** Returns the length of the tag's data, in bytes.
 	Not valid for Compound or List tags! */
@@ -167,13 +177,14 @@ public:
 	/** Returns the child tag of the specified path (Name1/Name2/Name3...), or -1 if no such tag. */
 	int FindTagByPath(int a_Tag, const AString & a_Path) const;
 	
-	eTagType GetType(int a_Tag) const { return m_Tags[(size_t)a_Tag].m_Type; }
+	eTagType GetType(int a_Tag) const { return static_cast<eTagType>(m_Tags[(size_t)a_Tag].m_Type); }
 	
 	/** Returns the children type for a List tag; undefined on other tags. If list empty, returns TAG_End. */
 	eTagType GetChildrenType(int a_Tag) const
 	{
 		ASSERT(m_Tags[(size_t)a_Tag].m_Type == TAG_List);
-		return (m_Tags[(size_t)a_Tag].m_FirstChild < 0) ? TAG_End : m_Tags[(size_t)m_Tags[(size_t)a_Tag].m_FirstChild].m_Type;
+		int FirstChild = GetFirstChild(a_Tag);
+		return (FirstChild < 0) ? TAG_End : GetType(FirstChild);
 	}
 	
 	/** Returns the value stored in a Byte tag. Not valid for any other tag type. */
@@ -263,10 +274,105 @@ protected:
 	size_t m_Pos;
 
 	bool Parse(void);
-	bool ReadString(size_t & a_StringStart, size_t & a_StringLen);  // Reads a simple string (2 bytes length + data), sets the string descriptors
+	bool ReadString(UInt32 & a_StringStart, UInt32 & a_StringLen);  // Reads a simple string (2 bytes length + data), sets the string descriptors
 	bool ReadCompound(void);  // Reads the latest tag as a compound
 	bool ReadList(eTagType a_ChildrenType);  // Reads the latest tag as a list of items of type a_ChildrenType
 	bool ReadTag(void);       // Reads the latest tag, depending on its m_Type setting
+
+	/** Returns true if the specified tag is a Compound or a List, and thus can have children. */
+	bool IsContainer(int a_Tag) const
+	{
+		return (m_Tags[(size_t)a_Tag].m_Type == TAG_Compound) || (m_Tags[(size_t)a_Tag].m_Type == TAG_List);
+	}
+} ;
+
+
+
+
+
+
+/** Reads consecutive unsigned values bit-packed into the data of a LongArray tag, such as the palette indices in
+Litematica regions or Anvil chunk sections.
+Values are packed starting at the least significant bit of each long (the longs themselves are big-endian in the data).
+Two packing variants exist: in the "spanning" one (Litematica, Anvil before 1.16) a value may be split across two longs,
+in the "padded" one (Anvil 1.16+) the unused high bits of each long are skipped, so that each value fits a single long.
+The reader keeps a 64-bit window of the not-yet-consumed bits and refills it a whole long at a time,
+so each value costs a couple of shifts and masks, regardless of the bits per value.
+The caller is responsible for not reading more values than the data contains, see GetNumValues(). */
+class cPackedLongArrayReader
+{
+public:
+	cPackedLongArrayReader(const char * a_Data, size_t a_NumLongs, int a_BitsPerValue, bool a_SpansLongs):
+		m_Data(a_Data),
+		m_NumLongs(a_NumLongs),
+		m_NextLong(0),
+		m_Window(0),
+		m_WindowBits(0),
+		m_BitsPerValue(a_BitsPerValue),
+		m_SpansLongs(a_SpansLongs),
+		m_Mask((static_cast<UInt64>(1) << a_BitsPerValue) - 1)
+	{
+		ASSERT((a_BitsPerValue > 0) && (a_BitsPerValue <= 32));
+	}
+
+	/** Returns the number of values stored in the data. */
+	size_t GetNumValues(void) const
+	{
+		return m_SpansLongs ?
+			m_NumLongs * 64 / static_cast<size_t>(m_BitsPerValue) :
+			m_NumLongs * static_cast<size_t>(64 / m_BitsPerValue);
+	}
+
+	/** Returns the next value. */
+	inline UInt32 Next(void)
+	{
+		if (m_WindowBits >= m_BitsPerValue)
+		{
+			UInt32 res = static_cast<UInt32>(m_Window & m_Mask);
+			m_Window >>= m_BitsPerValue;
+			m_WindowBits -= m_BitsPerValue;
+			return res;
+		}
+		UInt64 Long = ReadLong();
+		if (!m_SpansLongs || (m_WindowBits == 0))
+		{
+			// Start afresh from the new long (dropping the padding bits of the previous one):
+			m_Window = Long >> m_BitsPerValue;
+			m_WindowBits = 64 - m_BitsPerValue;
+			return static_cast<UInt32>(Long & m_Mask);
+		}
+
+		// The value is split between the rest of the window and the new long:
+		UInt32 res = static_cast<UInt32>((m_Window | (Long << m_WindowBits)) & m_Mask);
+		int NumBitsFromLong = m_BitsPerValue - m_WindowBits;
+		m_Window = Long >> NumBitsFromLong;
+		m_WindowBits = 64 - NumBitsFromLong;
+		return res;
+	}
+
+protected:
+	const char * m_Data;
+	size_t m_NumLongs;
+	size_t m_NextLong;
+
+	/** The not-yet-consumed bits of the current long, in the lowest m_WindowBits bits. */
+	UInt64 m_Window;
+	int m_WindowBits;
+
+	int m_BitsPerValue;
+	bool m_SpansLongs;
+	UInt64 m_Mask;
+
+
+	/** Returns the next long from the data, in host byte order; returns 0 past the end of the data. */
+	inline UInt64 ReadLong(void)
+	{
+		if (m_NextLong >= m_NumLongs)
+		{
+			return 0;
+		}
+		return NetworkToHostULong8(m_Data + 8 * m_NextLong++);
+	}
 } ;
 
 
@@ -0,0 +1,273 @@
+
+// StageStats.cpp
+
+// Implements the cStageStats class that collects the time spent in each stage of the batch pipeline
+
+#include "Globals.h"
+#include "StageStats.h"
+#include <chrono>
+#include "json/json.h"
+
+
+
+
+
+/** The number of the slowest items listed in the report. */
+static const size_t NUM_SLOWEST_ITEMS = 10;
+
+
+
+
+
+/** Returns the a_Percentile-th percentile (nearest rank) of the sorted samples. */
+static UInt32 GetPercentile(const std::vector<UInt32> & a_SortedSamples, int a_Percentile)
+{
+	if (a_SortedSamples.empty())
+	{
+		return 0;
+	}
+	size_t Rank = (a_SortedSamples.size() * static_cast<size_t>(a_Percentile) + 99) / 100;
+	return a_SortedSamples[std::max<size_t>(Rank, 1) - 1];
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cStageStats::cTimes:
+
+cStageStats::cTimes::cTimes(void):
+	m_NumVoxels(0),
+	m_NumPixels(0)
+{
+	for (auto & Nsec: m_StageNsec)
+	{
+		Nsec = 0;
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cStageStats:
+
+cStageStats::cStageStats(void):
+	m_IsEnabled(false),
+	m_StartNsec(0),
+	m_NumItems(0),
+	m_NumVoxels(0),
+	m_NumPixels(0)
+{
+	for (auto & Nsec: m_TotalNsec)
+	{
+		Nsec = 0;
+	}
+}
+
+
+
+
+
+void cStageStats::Enable(void)
+{
+	m_IsEnabled = true;
+	m_StartNsec = Now();
+}
+
+
+
+
+
+Int64 cStageStats::Now(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+
+
+void cStageStats::AddInput(const cTimes & a_Times)
+{
+	if (!m_IsEnabled)
+	{
+		return;
+	}
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	AddSamples(a_Times, 0, FIRST_ITEM_STAGE);
+}
+
+
+
+
+
+void cStageStats::AddItem(const AString & a_Name, const cTimes & a_Times)
+{
+	if (!m_IsEnabled)
+	{
+		return;
+	}
+	Int64 TotalNsec = 0;
+	for (auto Nsec: a_Times.m_StageNsec)
+	{
+		TotalNsec += Nsec;
+	}
+	auto IsSlower = [](const cItem & a_Item1, const cItem & a_Item2) { return (a_Item1.m_TotalNsec > a_Item2.m_TotalNsec); };
+
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	AddSamples(a_Times, FIRST_ITEM_STAGE, stCount);
+	m_NumItems += 1;
+	m_NumVoxels += a_Times.m_NumVoxels;
+	m_NumPixels += a_Times.m_NumPixels;
+
+	// Keep the slowest items in a min-heap, replacing its fastest item once full:
+	if (m_SlowestItems.size() < NUM_SLOWEST_ITEMS)
+	{
+		m_SlowestItems.push_back({a_Name, a_Times, TotalNsec});
+		std::push_heap(m_SlowestItems.begin(), m_SlowestItems.end(), IsSlower);
+	}
+	else if (TotalNsec > m_SlowestItems.front().m_TotalNsec)
+	{
+		std::pop_heap(m_SlowestItems.begin(), m_SlowestItems.end(), IsSlower);
+		m_SlowestItems.back() = {a_Name, a_Times, TotalNsec};
+		std::push_heap(m_SlowestItems.begin(), m_SlowestItems.end(), IsSlower);
+	}
+}
+
+
+
+
+
+void cStageStats::LogReport(void)
+{
+	auto Report = GetReport();
+	const auto & Throughput = Report["Throughput"];
+	LOG("Stage timings of %u items in %.2f s:", Report["NumItems"].asUInt(), Report["WallTimeSec"].asDouble());
+	LOG("  %-8s %10s %9s %9s %9s %9s %9s %9s", "Stage", "Total s", "Count", "Mean ms", "p50 ms", "p90 ms", "p99 ms", "Max ms");
+	for (const auto & Stage: Report["Stages"])
+	{
+		LOG("  %-8s %10.3f %9u %9.3f %9.3f %9.3f %9.3f %9.3f",
+			Stage["Stage"].asCString(), Stage["TotalSec"].asDouble(), Stage["Count"].asUInt(), Stage["MeanMsec"].asDouble(),
+			Stage["P50Msec"].asDouble(), Stage["P90Msec"].asDouble(), Stage["P99Msec"].asDouble(), Stage["MaxMsec"].asDouble()
+		);
+	}
+	LOG("Throughput: %.1f files/s, %.4g voxels/s, %.4g pixels/s",
+		Throughput["FilesPerSec"].asDouble(), Throughput["VoxelsPerSec"].asDouble(), Throughput["PixelsPerSec"].asDouble()
+	);
+	LOG("Slowest items:");
+	for (const auto & Item: Report["SlowestItems"])
+	{
+		AString Stages;
+		for (int i = 0; i < stCount; i++)
+		{
+			AppendPrintf(Stages, "%s%s %.1f", Stages.empty() ? "" : ", ", GetStageName(i), Item["StageMsec"][GetStageName(i)].asDouble());
+		}
+		LOG("  %9.3f ms  %s (%s)", Item["TotalMsec"].asDouble(), Item["Name"].asCString(), Stages.c_str());
+	}
+}
+
+
+
+
+
+bool cStageStats::SaveJson(const AString & a_FileName)
+{
+	auto Contents = GetReport().toStyledString();
+	cFile f(a_FileName, cFile::fmWrite);
+	return (f.IsOpen() && (f.Write(Contents.data(), Contents.size()) == static_cast<int>(Contents.size())));
+}
+
+
+
+
+
+void cStageStats::AddSamples(const cTimes & a_Times, int a_FirstStage, int a_EndStage)
+{
+	for (int i = a_FirstStage; i < a_EndStage; i++)
+	{
+		m_Samples[i].push_back(static_cast<UInt32>(std::min<Int64>(a_Times.m_StageNsec[i] / 1000, 0xffffffff)));
+		m_TotalNsec[i] += a_Times.m_StageNsec[i];
+	}
+}
+
+
+
+
+
+Json::Value cStageStats::GetReport(void)
+{
+	double WallSec = static_cast<double>(Now() - m_StartNsec) / 1e9;
+	Json::Value Report;
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	Report["WallTimeSec"] = WallSec;
+	Report["NumItems"] = static_cast<Json::UInt64>(m_NumItems);
+
+	Report["Stages"] = Json::Value(Json::arrayValue);
+	for (int i = 0; i < stCount; i++)
+	{
+		auto Sorted = m_Samples[i];
+		std::sort(Sorted.begin(), Sorted.end());
+		Json::Value Stage;
+		Stage["Stage"] = GetStageName(i);
+		Stage["Count"] = static_cast<Json::UInt64>(Sorted.size());
+		Stage["TotalSec"] = static_cast<double>(m_TotalNsec[i]) / 1e9;
+		Stage["MeanMsec"] = Sorted.empty() ? 0.0 : static_cast<double>(m_TotalNsec[i]) / 1e6 / static_cast<double>(Sorted.size());
+		Stage["P50Msec"] = GetPercentile(Sorted, 50) / 1e3;
+		Stage["P90Msec"] = GetPercentile(Sorted, 90) / 1e3;
+		Stage["P99Msec"] = GetPercentile(Sorted, 99) / 1e3;
+		Stage["MaxMsec"] = (Sorted.empty() ? 0 : Sorted.back()) / 1e3;
+		Report["Stages"].append(Stage);
+	}
+
+	Json::Value Throughput;
+	double Sec = std::max(WallSec, 1e-9);
+	Throughput["FilesPerSec"] = static_cast<double>(m_NumItems) / Sec;
+	Throughput["VoxelsPerSec"] = static_cast<double>(m_NumVoxels) / Sec;
+	Throughput["PixelsPerSec"] = static_cast<double>(m_NumPixels) / Sec;
+	Report["Throughput"] = Throughput;
+
+	auto Slowest = m_SlowestItems;
+	std::sort(Slowest.begin(), Slowest.end(), [](const cItem & a_Item1, const cItem & a_Item2) { return (a_Item1.m_TotalNsec > a_Item2.m_TotalNsec); });
+	Report["SlowestItems"] = Json::Value(Json::arrayValue);
+	for (const auto & Item: Slowest)
+	{
+		Json::Value ItemValue;
+		ItemValue["Name"] = Item.m_Name;
+		ItemValue["TotalMsec"] = static_cast<double>(Item.m_TotalNsec) / 1e6;
+		ItemValue["NumVoxels"] = static_cast<Json::UInt64>(Item.m_Times.m_NumVoxels);
+		ItemValue["NumPixels"] = static_cast<Json::UInt64>(Item.m_Times.m_NumPixels);
+		for (int i = 0; i < stCount; i++)
+		{
+			ItemValue["StageMsec"][GetStageName(i)] = static_cast<double>(Item.m_Times.m_StageNsec[i]) / 1e6;
+		}
+		Report["SlowestItems"].append(ItemValue);
+	}
+	return Report;
+}
+
+
+
+
+
+const char * cStageStats::GetStageName(int a_Stage)
+{
+	switch (a_Stage)
+	{
+		case stRead:    return "read";
+		case stUnGZip:  return "ungzip";
+		case stParse:   return "parse";
+		case stExtract: return "extract";
+		case stRotate:  return "rotate";
+		case stRender:  return "render";
+		case stEncode:  return "encode";
+		case stWrite:   return "write";
+	}
+	return "unknown";
+}
+
+
+
+
@@ -0,0 +1,136 @@
+
+// StageStats.h
+
+// Declares the cStageStats class that collects the time spent in each stage of the batch pipeline
+
+/*
+The stages are timed by the pipeline as they run and the times are added here; when disabled, adding the times
+does nothing. The stages of an input (read, ungzip, parse) are added once per input, even if shared by multiple items;
+the stages of each item are added once it's written, together with the item's totals used for the slowest-items list.
+All the samples are kept, so that the exact percentiles can be reported at the end.
+*/
+
+
+
+
+
+#pragma once
+
+#include <mutex>
+
+
+
+
+
+// fwd:
+namespace Json
+{
+	class Value;
+}
+
+
+
+
+
+class cStageStats
+{
+public:
+	enum eStage
+	{
+		stRead,      ///< Reading the input file
+		stUnGZip,    ///< Uncompressing the input data
+		stParse,     ///< Parsing the NBT, decoding non-MCEdit formats (and loading the world areas)
+		stExtract,   ///< Copying the blocks into the block image
+		stRotate,    ///< Rotating the block image
+		stRender,    ///< Rasterizing the image (summed over all the bands)
+		stEncode,    ///< Encoding the PNG data
+		stWrite,     ///< Writing the output file
+
+		stCount,
+	};
+
+	/** The first stage timed per item; the stages before it are timed per input. */
+	static const int FIRST_ITEM_STAGE = stExtract;
+
+
+	/** The times of the stages of a single input or item, in nanoseconds. */
+	struct cTimes
+	{
+		Int64 m_StageNsec[stCount];
+
+		/** The number of blocks and pixels in the item's image, for the throughput. */
+		UInt64 m_NumVoxels;
+		UInt64 m_NumPixels;
+
+		cTimes(void);
+	};
+
+
+	cStageStats(void);
+
+	/** Starts collecting the stats, measuring the throughput from now on. */
+	void Enable(void);
+
+	bool IsEnabled(void) const { return m_IsEnabled; }
+
+	/** Returns the current time of a monotonic clock, in nanoseconds. */
+	static Int64 Now(void);
+
+	/** Adds the times of the input stages (FIRST_ITEM_STAGE excluded and after), read once for all the input's items. */
+	void AddInput(const cTimes & a_Times);
+
+	/** Adds the times of the item stages (FIRST_ITEM_STAGE and after) of an item that has been written.
+	a_Times should contain the times of the item's input stages as well, they are counted in the item's total. */
+	void AddItem(const AString & a_Name, const cTimes & a_Times);
+
+	/** Logs the report of the stages' totals and percentiles, the throughput and the slowest items. */
+	void LogReport(void);
+
+	/** Writes the same report as LogReport() as a JSON file. Returns false on failure. */
+	bool SaveJson(const AString & a_FileName);
+
+	/** Returns the report of the stages' totals and percentiles, the throughput and the slowest items, as a JSON value. */
+	Json::Value GetReport(void);
+
+protected:
+	/** An item, remembered for the list of the slowest ones. */
+	struct cItem
+	{
+		AString m_Name;
+		cTimes m_Times;
+		Int64 m_TotalNsec;
+	};
+
+
+	bool m_IsEnabled;
+
+	/** The time at which the stats were enabled, for the throughput. */
+	Int64 m_StartNsec;
+
+	/** Protects all the following members against multithreaded access. */
+	std::mutex m_Mutex;
+
+	/** The samples of each stage, in microseconds. */
+	std::vector<UInt32> m_Samples[stCount];
+
+	/** The total time of each stage, in nanoseconds. */
+	Int64 m_TotalNsec[stCount];
+
+	UInt64 m_NumItems;
+	UInt64 m_NumVoxels;
+	UInt64 m_NumPixels;
+
+	/** The slowest items so far, as a min-heap by their total time. */
+	std::vector<cItem> m_SlowestItems;
+
+
+	/** Adds the samples of the stages [a_FirstStage, a_EndStage). Expects m_Mutex to be locked. */
+	void AddSamples(const cTimes & a_Times, int a_FirstStage, int a_EndStage);
+
+	/** Returns the name of the stage, as used in the reports. */
+	static const char * GetStageName(int a_Stage);
+};
+
+
+
+
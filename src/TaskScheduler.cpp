@@ -0,0 +1,205 @@
+
+// TaskScheduler.cpp
+
+// Implements the cTaskScheduler class implementing a work-stealing thread pool
+
+#include "Globals.h"
+#include "TaskScheduler.h"
+#include "Tracer.h"
+
+
+
+
+
+/** The scheduler whose worker is running in the current thread, nullptr in non-worker threads. */
+static thread_local cTaskScheduler * g_CurrentScheduler = nullptr;
+
+/** The index of the worker running in the current thread, valid only if g_CurrentScheduler is set. */
+static thread_local size_t g_CurrentWorkerIdx = 0;
+
+
+
+
+
+cTaskScheduler::cTaskScheduler(void):
+	m_NumQueued(0),
+	m_NumUnfinished(0),
+	m_ShouldTerminate(false)
+{
+}
+
+
+
+
+
+cTaskScheduler::~cTaskScheduler()
+{
+	Stop();
+}
+
+
+
+
+
+void cTaskScheduler::Start(int a_NumWorkers)
+{
+	ASSERT(m_Threads.empty());
+	m_ShouldTerminate = false;
+	size_t NumWorkers = static_cast<size_t>(std::max(a_NumWorkers, 1));
+	for (size_t i = 0; i < NumWorkers; i++)
+	{
+		m_Workers.emplace_back(new cWorker);
+	}
+	for (size_t i = 0; i < NumWorkers; i++)
+	{
+		m_Threads.emplace_back(&cTaskScheduler::WorkerThread, this, i);
+	}
+}
+
+
+
+
+
+void cTaskScheduler::Stop(void)
+{
+	if (m_Threads.empty())
+	{
+		return;
+	}
+	WaitIdle();
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_ShouldTerminate = true;
+	}
+	m_CondWork.notify_all();
+	for (auto & Thread: m_Threads)
+	{
+		Thread.join();
+	}
+	m_Threads.clear();
+	m_Workers.clear();
+}
+
+
+
+
+
+void cTaskScheduler::Submit(cTask && a_Task)
+{
+	m_NumUnfinished++;
+	if (g_CurrentScheduler == this)
+	{
+		auto & Worker = *m_Workers[g_CurrentWorkerIdx];
+		std::unique_lock<std::mutex> Lock(Worker.m_Mutex);
+		Worker.m_Tasks.push_back(std::move(a_Task));
+		m_NumQueued++;
+	}
+	else
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_Tasks.push_back(std::move(a_Task));
+		m_NumQueued++;
+	}
+
+	// Wake up a sleeping worker; the workers check m_NumQueued under m_Mutex before sleeping, so the wakeup cannot get lost:
+	{
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+	}
+	m_CondWork.notify_one();
+}
+
+
+
+
+
+void cTaskScheduler::WaitIdle(void)
+{
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	m_CondIdle.wait(Lock, [this]() { return (m_NumUnfinished == 0); });
+}
+
+
+
+
+
+void cTaskScheduler::WorkerThread(size_t a_WorkerIdx)
+{
+	g_CurrentScheduler = this;
+	g_CurrentWorkerIdx = a_WorkerIdx;
+	TRACE_THREAD_NAME("worker");
+	cTask Task;
+	for (;;)
+	{
+		if (TakeTask(a_WorkerIdx, Task))
+		{
+			Task();
+			Task = nullptr;
+			if (--m_NumUnfinished == 0)
+			{
+				std::unique_lock<std::mutex> Lock(m_Mutex);
+				m_CondIdle.notify_all();
+			}
+			continue;
+		}
+
+		// No task anywhere, sleep until one is submitted:
+		TRACE_SCOPE("idle", 0);
+		std::unique_lock<std::mutex> Lock(m_Mutex);
+		m_CondWork.wait(Lock, [this]() { return ((m_NumQueued > 0) || m_ShouldTerminate); });
+		if ((m_NumQueued == 0) && m_ShouldTerminate)
+		{
+			break;
+		}
+	}
+	g_CurrentScheduler = nullptr;
+}
+
+
+
+
+
+bool cTaskScheduler::TakeTask(size_t a_WorkerIdx, cTask & a_Task)
+{
+	// Own deque first, in FIFO order:
+	{
+		auto & Worker = *m_Workers[a_WorkerIdx];
+		std::unique_lock<std::mutex> Lock(Worker.m_Mutex);
+		if (!Worker.m_Tasks.empty())
+		{
+			a_Task = std::move(Worker.m_Tasks.front());
+			Worker.m_Tasks.pop_front();
+			m_NumQueued--;
+			return true;
+		}
+	}
+
+	// Steal from the back of the other workers' deques, so that the owner keeps working on the front:
+	size_t NumWorkers = m_Workers.size();
+	for (size_t i = 1; i < NumWorkers; i++)
+	{
+		auto & Victim = *m_Workers[(a_WorkerIdx + i) % NumWorkers];
+		std::unique_lock<std::mutex> Lock(Victim.m_Mutex);
+		if (!Victim.m_Tasks.empty())
+		{
+			a_Task = std::move(Victim.m_Tasks.back());
+			Victim.m_Tasks.pop_back();
+			m_NumQueued--;
+			return true;
+		}
+	}
+
+	// Start a new task from the shared queue:
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	if (!m_Tasks.empty())
+	{
+		a_Task = std::move(m_Tasks.front());
+		m_Tasks.pop_front();
+		m_NumQueued--;
+		return true;
+	}
+	return false;
+}
+
+
+
+
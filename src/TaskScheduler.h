@@ -0,0 +1,104 @@
+
+// TaskScheduler.h
+
+// Declares the cTaskScheduler class implementing a work-stealing thread pool
+
+/*
+Each worker has its own deque of tasks; there's also a shared queue for the tasks submitted from outside the workers.
+A task submitted from within a running task (a continuation, or a part of a split job) goes to the end of the
+worker's own deque; the tasks submitted from outside are started in the order of their submission.
+A worker takes the tasks from the front of its own deque first, then steals from the back of the other workers'
+deques, and only then starts a new task from the shared queue. This way the jobs already in progress are finished
+(with the help of the idle workers) before new ones are started, which keeps both the latency and the memory low.
+The deques are guarded by a mutex each; the tasks are coarse enough that the locking doesn't show up in profiles.
+*/
+
+
+
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+
+
+
+class cTaskScheduler
+{
+public:
+	typedef std::function<void(void)> cTask;
+
+
+	cTaskScheduler(void);
+
+	/** Stops the workers, if running. */
+	~cTaskScheduler();
+
+	/** Starts the specified number of worker threads. */
+	void Start(int a_NumWorkers);
+
+	/** Waits for all the queued tasks to finish, then stops the worker threads. */
+	void Stop(void);
+
+	/** Queues the task for execution.
+	From outside the workers, the tasks are started in the order of submission.
+	From within a task, the new task goes to the current worker's own deque, from where idle workers may steal it. */
+	void Submit(cTask && a_Task);
+
+	/** Blocks until there are no queued or running tasks. */
+	void WaitIdle(void);
+
+	/** Returns the number of worker threads. */
+	int GetNumWorkers(void) const { return static_cast<int>(m_Threads.size()); }
+
+protected:
+	/** The task deque of a single worker. */
+	struct cWorker
+	{
+		std::mutex m_Mutex;
+		std::deque<cTask> m_Tasks;
+	};
+
+
+	std::vector<std::unique_ptr<cWorker>> m_Workers;
+	std::vector<std::thread> m_Threads;
+
+	/** Protects m_Tasks and m_ShouldTerminate, and is used for the sleeping / waking of the workers and the idle waiters. */
+	std::mutex m_Mutex;
+
+	/** The tasks submitted from outside the workers, in the order of submission. Protected by m_Mutex. */
+	std::deque<cTask> m_Tasks;
+
+	/** Signalled when a task is queued, or the workers should terminate. */
+	std::condition_variable m_CondWork;
+
+	/** Signalled when the last unfinished task finishes. */
+	std::condition_variable m_CondIdle;
+
+	/** The number of tasks in all the queues (excluding the running ones). */
+	std::atomic<size_t> m_NumQueued;
+
+	/** The number of tasks submitted but not yet finished (including the running ones). */
+	std::atomic<size_t> m_NumUnfinished;
+
+	/** Set when the workers should terminate once there are no more tasks. Protected by m_Mutex. */
+	bool m_ShouldTerminate;
+
+
+	/** The main loop of a single worker thread. */
+	void WorkerThread(size_t a_WorkerIdx);
+
+	/** Takes the next task for the specified worker: from its own deque, stolen from the others, or from the shared queue.
+	Returns false if there's no task anywhere. */
+	bool TakeTask(size_t a_WorkerIdx, cTask & a_Task);
+};
+
+
+
+
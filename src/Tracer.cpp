@@ -0,0 +1,341 @@
+
+// Tracer.cpp
+
+// Implements the cTracer class that records a timeline of the work done by each thread, exported as a Chrome trace
+
+#include "Globals.h"
+#include "Tracer.h"
+
+#ifdef ENABLE_TRACING
+
+#include <chrono>
+
+
+
+
+
+/** The number of the most recent events kept for each thread. */
+static const size_t TRACE_EVENTS_PER_THREAD = 8192;
+
+/** The interval in which the file is rewritten, for the long-running modes. */
+static const int TRACE_FLUSH_INTERVAL_SEC = 10;
+
+
+
+
+
+/** Appends the string to a_Dest as a JSON string literal. */
+static void AppendJsonString(AString & a_Dest, const char * a_String)
+{
+	a_Dest.push_back('"');
+	for (const char * c = a_String; *c != 0; c++)
+	{
+		switch (*c)
+		{
+			case '"':  a_Dest.append("\\\""); break;
+			case '\\': a_Dest.append("\\\\"); break;
+			default:
+			{
+				if (static_cast<unsigned char>(*c) < 0x20)
+				{
+					AppendPrintf(a_Dest, "\\u%04x", static_cast<unsigned char>(*c));
+				}
+				else
+				{
+					a_Dest.push_back(*c);
+				}
+				break;
+			}
+		}
+	}
+	a_Dest.push_back('"');
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cTracer::cThreadBuffer:
+
+cTracer::cThreadBuffer::cThreadBuffer(int a_TID):
+	m_TID(a_TID),
+	m_NumEvents(0),
+	m_Events(new cEvent[TRACE_EVENTS_PER_THREAD])
+{
+	for (size_t i = 0; i < TRACE_EVENTS_PER_THREAD; i++)
+	{
+		m_Events[i].m_Seq.store(0, std::memory_order_relaxed);
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cTracer::cThreadBufferHolder:
+
+cTracer::cThreadBufferHolder::~cThreadBufferHolder()
+{
+	if (m_Buffer != nullptr)
+	{
+		std::unique_lock<std::mutex> Lock(s_Mutex);
+		s_FreeBuffers.push_back(m_Buffer);
+	}
+}
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// cTracer:
+
+std::atomic<bool> cTracer::s_IsEnabled(false);
+std::mutex cTracer::s_Mutex;
+std::vector<std::unique_ptr<cTracer::cThreadBuffer>> cTracer::s_Buffers;
+std::vector<cTracer::cThreadBuffer *> cTracer::s_FreeBuffers;
+AString cTracer::s_FileName;
+std::thread cTracer::s_FlushThread;
+std::condition_variable cTracer::s_CondStop;
+thread_local cTracer::cThreadBufferHolder cTracer::t_Buffer;
+
+
+
+
+
+void cTracer::Start(const AString & a_FileName, bool a_ShouldFlushPeriodically)
+{
+	{
+		std::unique_lock<std::mutex> Lock(s_Mutex);
+		s_FileName = a_FileName;
+	}
+	s_IsEnabled = true;
+	if (a_ShouldFlushPeriodically && !s_FlushThread.joinable())
+	{
+		s_FlushThread = std::thread(&cTracer::FlushThread);
+	}
+}
+
+
+
+
+
+void cTracer::Stop(void)
+{
+	if (!s_IsEnabled.exchange(false))
+	{
+		return;
+	}
+	if (s_FlushThread.joinable())
+	{
+		// Lock the mutex, so that the flushing thread is either waiting, or yet to check the flag:
+		{
+			std::unique_lock<std::mutex> Lock(s_Mutex);
+		}
+		s_CondStop.notify_all();
+		s_FlushThread.join();
+	}
+	Flush();
+}
+
+
+
+
+
+void cTracer::SetThreadName(const char * a_Name)
+{
+	if (!IsEnabled())
+	{
+		return;
+	}
+	auto & Buffer = GetThreadBuffer();
+	std::unique_lock<std::mutex> Lock(s_Mutex);
+	Buffer.m_Name = a_Name;
+}
+
+
+
+
+
+void cTracer::AddEvent(const char * a_Name, Int64 a_StartUsec, Int64 a_DurUsec, Int64 a_ID, const AString & a_Detail)
+{
+	auto & Buffer = GetThreadBuffer();
+	UInt64 Index = Buffer.m_NumEvents.load(std::memory_order_relaxed);
+	auto & Event = Buffer.m_Events[Index % TRACE_EVENTS_PER_THREAD];
+
+	// Invalidate the slot before overwriting it, so that a concurrent reader rejects it:
+	Event.m_Seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Event.m_Name.store(a_Name, std::memory_order_relaxed);
+	Event.m_StartUsec.store(a_StartUsec, std::memory_order_relaxed);
+	Event.m_DurUsec.store(a_DurUsec, std::memory_order_relaxed);
+	Event.m_ID.store(a_ID, std::memory_order_relaxed);
+
+	// Keep the end of the detail, file names are most distinctive at their end:
+	char Detail[DETAIL_SIZE] = {0};
+	size_t Len = std::min(a_Detail.size(), DETAIL_SIZE - 1);
+	memcpy(Detail, a_Detail.data() + a_Detail.size() - Len, Len);
+	for (size_t i = 0; i < DETAIL_SIZE / 8; i++)
+	{
+		UInt64 Word;
+		memcpy(&Word, Detail + i * 8, 8);
+		Event.m_Detail[i].store(Word, std::memory_order_relaxed);
+	}
+
+	Event.m_Seq.store(Index + 1, std::memory_order_release);
+	Buffer.m_NumEvents.store(Index + 1, std::memory_order_release);
+}
+
+
+
+
+
+Int64 cTracer::NowUsec(void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+
+
+
+cTracer::cThreadBuffer & cTracer::GetThreadBuffer(void)
+{
+	if (t_Buffer.m_Buffer == nullptr)
+	{
+		std::unique_lock<std::mutex> Lock(s_Mutex);
+		if (s_FreeBuffers.empty())
+		{
+			s_Buffers.emplace_back(new cThreadBuffer(static_cast<int>(s_Buffers.size()) + 1));
+			t_Buffer.m_Buffer = s_Buffers.back().get();
+		}
+		else
+		{
+			t_Buffer.m_Buffer = s_FreeBuffers.back();
+			s_FreeBuffers.pop_back();
+		}
+	}
+	return *t_Buffer.m_Buffer;
+}
+
+
+
+
+
+void cTracer::Flush(void)
+{
+	std::unique_lock<std::mutex> Lock(s_Mutex);
+	AString Out("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool IsFirst = true;
+	for (const auto & Buffer: s_Buffers)
+	{
+		if (!Buffer->m_Name.empty())
+		{
+			AppendPrintf(Out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+				IsFirst ? "" : ",\n", Buffer->m_TID
+			);
+			AppendJsonString(Out, Buffer->m_Name.c_str());
+			Out.append("}}");
+			IsFirst = false;
+		}
+
+		// Read the events in the buffer; those overwritten while being read are skipped:
+		UInt64 NumEvents = Buffer->m_NumEvents.load(std::memory_order_acquire);
+		UInt64 First = (NumEvents > TRACE_EVENTS_PER_THREAD) ? NumEvents - TRACE_EVENTS_PER_THREAD : 0;
+		for (UInt64 Index = First; Index < NumEvents; Index++)
+		{
+			const auto & Event = Buffer->m_Events[Index % TRACE_EVENTS_PER_THREAD];
+			if (Event.m_Seq.load(std::memory_order_acquire) != Index + 1)
+			{
+				continue;
+			}
+			const char * Name = Event.m_Name.load(std::memory_order_relaxed);
+			Int64 StartUsec = Event.m_StartUsec.load(std::memory_order_relaxed);
+			Int64 DurUsec = Event.m_DurUsec.load(std::memory_order_relaxed);
+			Int64 ID = Event.m_ID.load(std::memory_order_relaxed);
+			char Detail[DETAIL_SIZE];
+			for (size_t i = 0; i < DETAIL_SIZE / 8; i++)
+			{
+				UInt64 Word = Event.m_Detail[i].load(std::memory_order_relaxed);
+				memcpy(Detail + i * 8, &Word, 8);
+			}
+			Detail[DETAIL_SIZE - 1] = 0;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Event.m_Seq.load(std::memory_order_relaxed) != Index + 1)
+			{
+				continue;
+			}
+
+			AppendPrintf(Out, "%s{\"name\": ", IsFirst ? "" : ",\n");
+			AppendJsonString(Out, Name);
+			AppendPrintf(Out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld, \"args\": {\"id\": %lld",
+				Buffer->m_TID, StartUsec, DurUsec, ID
+			);
+			if (Detail[0] != 0)
+			{
+				Out.append(", \"detail\": ");
+				AppendJsonString(Out, Detail);
+			}
+			Out.append("}}");
+			IsFirst = false;
+		}
+	}
+	Out.append("\n]}\n");
+
+	// Write into a temporary file and rename, so that the viewers never see a partially written trace:
+	AString TempFileName = s_FileName + ".tmp";
+	{
+		cFile f(TempFileName, cFile::fmWrite);
+		if (!f.IsOpen() || (f.Write(Out.data(), Out.size()) != static_cast<int>(Out.size())))
+		{
+			LOGWARNING("Cannot write trace file \"%s\".", TempFileName.c_str());
+			f.Close();
+			cFile::Delete(TempFileName);
+			return;
+		}
+	}
+
+	// Rename() replaces the file atomically on POSIX; elsewhere it fails if the file exists, delete it and retry then:
+	if (!cFile::Rename(TempFileName, s_FileName))
+	{
+		cFile::Delete(s_FileName);
+		if (!cFile::Rename(TempFileName, s_FileName))
+		{
+			LOGWARNING("Cannot rename trace file \"%s\" to \"%s\".", TempFileName.c_str(), s_FileName.c_str());
+			cFile::Delete(TempFileName);
+		}
+	}
+}
+
+
+
+
+
+void cTracer::FlushThread(void)
+{
+	SetThreadName("trace flush");
+	std::unique_lock<std::mutex> Lock(s_Mutex);
+	while (IsEnabled())
+	{
+		s_CondStop.wait_for(Lock, std::chrono::seconds(TRACE_FLUSH_INTERVAL_SEC), []() { return !IsEnabled(); });
+		if (IsEnabled())
+		{
+			Lock.unlock();
+			Flush();
+			Lock.lock();
+		}
+	}
+}
+
+
+
+
+
+#endif  // ENABLE_TRACING
+
+
+
+
@@ -0,0 +1,195 @@
+
+// Tracer.h
+
+// Declares the cTracer class that records a timeline of the work done by each thread, exported as a Chrome trace
+
+/*
+The code is instrumented using the TRACE_ macros, which compile to nothing unless ENABLE_TRACING is defined
+(the SCHEMATICTOPNG_TRACING CMake option). When compiled in, the tracing is still off until started (the "-trace"
+commandline parameter); until then each instrumented scope costs only a check of a flag.
+
+Each thread records its events into its own ring buffer, without any locking; once the buffer is full, the oldest
+events are overwritten. The events are written as the Chrome trace-event JSON, which can be opened in Perfetto
+(ui.perfetto.dev) or in chrome://tracing. The file is written when the tracing stops; the long-running modes
+(daemons, watching folders) also rewrite it periodically, with the most recent events.
+
+Usage:
+	void Stage(const cItem & a_Item)
+	{
+		TRACE_SCOPE_DETAIL("stage", a_Item.m_ID, a_Item.m_Name);
+		... the traced work ...
+	}
+*/
+
+
+
+
+
+#pragma once
+
+#ifdef ENABLE_TRACING
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+
+
+
+class cTracer
+{
+public:
+	/** Records an event spanning the lifetime of the object, if the tracing is enabled when it's created. */
+	class cScope
+	{
+	public:
+		cScope(const char * a_Name, Int64 a_ID):
+			m_Name(a_Name),
+			m_ID(a_ID),
+			m_StartUsec(IsEnabled() ? NowUsec() : -1)
+		{
+		}
+
+		~cScope()
+		{
+			if (m_StartUsec >= 0)
+			{
+				AddEvent(m_Name, m_StartUsec, NowUsec() - m_StartUsec, m_ID, m_Detail);
+			}
+		}
+
+		/** Returns true if the event is being recorded, so that its details are worth building. */
+		bool IsActive(void) const { return (m_StartUsec >= 0); }
+
+		void SetDetail(const AString & a_Detail) { m_Detail = a_Detail; }
+
+	protected:
+		const char * m_Name;
+		Int64 m_ID;
+		Int64 m_StartUsec;
+		AString m_Detail;
+	};
+
+
+	/** Starts recording the events, to be written into the specified file.
+	If a_ShouldFlushPeriodically is true, the file is also rewritten periodically while tracing. */
+	static void Start(const AString & a_FileName, bool a_ShouldFlushPeriodically);
+
+	/** Stops recording the events and writes them into the file. */
+	static void Stop(void);
+
+	/** Returns true if the events are being recorded. */
+	static bool IsEnabled(void) { return s_IsEnabled.load(std::memory_order_relaxed); }
+
+	/** Sets the name of the calling thread, shown for its track in the timeline. */
+	static void SetThreadName(const char * a_Name);
+
+	/** Adds an event of the calling thread into its buffer. a_Name must be a string literal (only the pointer is stored).
+	The detail is truncated to DETAIL_SIZE - 1 chars, keeping its end. */
+	static void AddEvent(const char * a_Name, Int64 a_StartUsec, Int64 a_DurUsec, Int64 a_ID, const AString & a_Detail);
+
+	/** Returns the current time of a monotonic clock, in microseconds. */
+	static Int64 NowUsec(void);
+
+protected:
+	/** The maximum length of the event's detail, including the terminating NUL. Multiple of 8. */
+	static const size_t DETAIL_SIZE = 64;
+
+	/** A single recorded event. All the members are atomic, so that the buffer can be read while being written;
+	m_Seq makes the reader reject the events that are being overwritten (a seqlock). */
+	struct cEvent
+	{
+		/** The index of the event in the buffer's sequence plus 1, 0 while the event is being written. */
+		std::atomic<UInt64> m_Seq;
+
+		std::atomic<const char *> m_Name;
+		std::atomic<Int64> m_StartUsec;
+		std::atomic<Int64> m_DurUsec;
+		std::atomic<Int64> m_ID;
+		std::atomic<UInt64> m_Detail[DETAIL_SIZE / 8];
+	};
+
+
+	/** The ring buffer of the events of a single thread. Written only by its thread, read by the flushing. */
+	struct cThreadBuffer
+	{
+		/** The ID of the thread's track in the timeline. */
+		int m_TID;
+
+		/** The name of the thread, shown for its track. Protected by s_Mutex. */
+		AString m_Name;
+
+		/** The number of the events ever added; the event with index i is stored at m_Events[i % capacity]. */
+		std::atomic<UInt64> m_NumEvents;
+
+		std::unique_ptr<cEvent[]> m_Events;
+
+		cThreadBuffer(int a_TID);
+	};
+
+	/** Returns the buffer to the free list when its thread terminates, so that the next thread reuses it. */
+	struct cThreadBufferHolder
+	{
+		cThreadBuffer * m_Buffer;
+
+		cThreadBufferHolder(void): m_Buffer(nullptr) {}
+		~cThreadBufferHolder();
+	};
+
+
+	static std::atomic<bool> s_IsEnabled;
+
+	/** Protects the buffers' list and the free list, and the flushing. */
+	static std::mutex s_Mutex;
+
+	/** All the buffers ever created, in the order of their TIDs. Kept until the program terminates. */
+	static std::vector<std::unique_ptr<cThreadBuffer>> s_Buffers;
+
+	/** The buffers of the terminated threads, to be reused by new threads. */
+	static std::vector<cThreadBuffer *> s_FreeBuffers;
+
+	static AString s_FileName;
+
+	/** The thread rewriting the file periodically, if requested. */
+	static std::thread s_FlushThread;
+	static std::condition_variable s_CondStop;
+
+	static thread_local cThreadBufferHolder t_Buffer;
+
+
+	/** Returns the calling thread's buffer, assigning it one on the first call. */
+	static cThreadBuffer & GetThreadBuffer(void);
+
+	/** Writes all the events currently in the buffers into the file. */
+	static void Flush(void);
+
+	/** The body of s_FlushThread. */
+	static void FlushThread(void);
+};
+
+
+
+
+
+#define TRACE_SCOPE(a_Name, a_ID) cTracer::cScope TraceScope(a_Name, a_ID)
+#define TRACE_SCOPE_DETAIL(a_Name, a_ID, a_Detail) \
+	cTracer::cScope TraceScope(a_Name, a_ID); \
+	if (TraceScope.IsActive()) \
+	{ \
+		TraceScope.SetDetail(a_Detail); \
+	}
+#define TRACE_THREAD_NAME(a_Name) cTracer::SetThreadName(a_Name)
+
+#else  // ENABLE_TRACING
+
+#define TRACE_SCOPE(a_Name, a_ID)
+#define TRACE_SCOPE_DETAIL(a_Name, a_ID, a_Detail)
+#define TRACE_THREAD_NAME(a_Name)
+
+#endif  // else ENABLE_TRACING
+
+
+
+